@@ -14,6 +14,7 @@ HEADERS += \
         ordermanager.h \
         productmodel.h \
         shoppingcart.h \
+        wireprotocol.h \
 
 
 SOURCES += \
@@ -24,6 +25,7 @@ SOURCES += \
         ordermanager.cpp \
         productmodel.cpp \
         shoppingcart.cpp \
+        wireprotocol.cpp \
 
 RESOURCES += qml.qrc \
              images.qrc \
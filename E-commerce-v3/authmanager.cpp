@@ -13,8 +13,9 @@
 extern GlobalState* globalStateInstance; // 假设在main.cpp定义和初始化
 
 // 辅助函数：发送请求并等待响应
-QJsonObject AuthManager::sendRequestAndWait(const QJsonObject& requestData, int timeoutMs) {
-    if (!NetworkClient::instance()->isConnected()) {
+QJsonObject AuthManager::sendRequestAndWait(const QJsonObject& requestData, int timeoutMs, NetworkClient* client) {
+    if (!client) client = NetworkClient::instance();
+    if (!client->isConnected()) {
         qWarning() << "AuthManager: Not connected to server.";
         // 返回一个QML能识别的错误格式，或者让调用者处理连接错误
         return QJsonObject{{"status", "error"}, {"message", "Not connected to server"}};
@@ -29,7 +30,7 @@ QJsonObject AuthManager::sendRequestAndWait(const QJsonObject& requestData, int
     QTimer timer;
     timer.setSingleShot(true);
 
-    QMetaObject::Connection conn = QObject::connect(NetworkClient::instance(), &NetworkClient::responseReceived,
+    QMetaObject::Connection conn = QObject::connect(client, &NetworkClient::responseReceived,
                                                     [&](const QJsonObject& res) {
                                                         // 检查响应是否包含requestId并且与我们发送的匹配
                                                         if (res.value("requestId").toString() == requestId) {
@@ -46,14 +47,98 @@ QJsonObject AuthManager::sendRequestAndWait(const QJsonObject& requestData, int
         loop.quit();
     });
 
-    NetworkClient::instance()->sendRequest(mutableRequestData); // 发送带有requestId的请求
+    // 连接在等待期间断开时回复不会再来，不必等到超时
+    QMetaObject::Connection lost = QObject::connect(client, &NetworkClient::disconnected, &loop, [&]() {
+        responseJson = QJsonObject{{"status", "error"}, {"message", "Connection lost"}};
+        loop.quit();
+    });
+
+    client->sendRequest(mutableRequestData); // 发送带有requestId的请求
     timer.start(timeoutMs);
     loop.exec();
 
     QObject::disconnect(conn);
+    QObject::disconnect(lost);
     return responseJson;
 }
 
+QJsonArray AuthManager::sendBatchAndWait(const QJsonArray& requests, bool stopOnError, int timeoutMs, NetworkClient* client) {
+    QJsonObject request;
+    request["action"] = "batch";
+    QJsonObject payload;
+    payload["requests"] = requests;
+    payload["stopOnError"] = stopOnError;
+    request["payload"] = payload;
+
+    QJsonObject response = sendRequestAndWait(request, timeoutMs, client);
+    if (response["status"].toString() == "success") {
+        return response["data"].toObject()["results"].toArray();
+    }
+
+    QJsonArray results;
+    if (!response["message"].toString().startsWith("Unknown action")) {
+        // 整个 batch 失败（超时、断线等），每条子请求都返回同样的错误
+        for (int i = 0; i < requests.size(); ++i) results.append(response);
+        return results;
+    }
+    // 旧服务器：逐条发送
+    bool failed = false;
+    for (const QJsonValue& val : requests) {
+        if (failed && stopOnError) {
+            results.append(QJsonObject{{"status", "error"}, {"message", "Skipped because an earlier request in the batch failed."}});
+            continue;
+        }
+        QJsonObject sub = sendRequestAndWait(val.toObject(), timeoutMs, client);
+        if (sub["status"].toString() != "success") failed = true;
+        results.append(sub);
+    }
+    return results;
+}
+
+bool AuthManager::negotiateProtocol(NetworkClient* client) {
+    QJsonObject request;
+    request["action"] = "hello";
+    QJsonObject payload;
+    payload["framing"] = WireProtocol::framingToString(WireProtocol::Framing::LengthPrefixed);
+    payload["encoding"] = WireProtocol::encodingToString(WireProtocol::Encoding::Cbor);
+    // 大的目录、订单列表由服务器压缩后发送；不认识该字段的旧服务器会忽略它
+    payload["compression"] = QJsonArray{WireProtocol::compressionToString(WireProtocol::Compression::Zlib)};
+    request["payload"] = payload;
+
+    // 回复到达时 NetworkClient 已经完成切换；失败（旧服务器）则继续使用换行分帧 + JSON
+    QJsonObject response = sendRequestAndWait(request, 5000, client);
+    if (response["status"].toString() != "success") {
+        qInfo() << "AuthManager: Protocol negotiation not supported, using newline framing -" << response["message"].toString();
+        return false;
+    }
+    return true;
+}
+
+// 登录和恢复会话的回复格式相同：username、type、balance 以及 sessionToken
+static void applyUserData(const QJsonObject& userData) {
+    if (!globalStateInstance) return; // 确保 globalStateInstance 已初始化
+    globalStateInstance->setUsername(userData["username"].toString());
+    globalStateInstance->setUserType(userData["type"].toString());
+    globalStateInstance->setBalance(userData["balance"].toDouble());
+    globalStateInstance->setIsConsumer(userData["type"].toString() == "Consumer");
+    globalStateInstance->setIsMerchant(userData["type"].toString() == "Merchant");
+    globalStateInstance->setSessionToken(userData["sessionToken"].toString());
+}
+
+bool AuthManager::resumeSession() {
+    if (!globalStateInstance || globalStateInstance->sessionToken().isEmpty()) return false;
+    QJsonObject request;
+    request["action"] = "resume";
+    request["payload"] = QJsonObject{{"token", globalStateInstance->sessionToken()}};
+
+    QJsonObject response = sendRequestAndWait(request);
+    if (response["status"].toString() != "success") {
+        qInfo() << "AuthManager: Session could not be resumed -" << response["message"].toString();
+        return false;
+    }
+    applyUserData(response["data"].toObject());
+    return true;
+}
 
 bool AuthManager::verifyLogin(const QString &username, const QString &password) {
     QJsonObject request;
@@ -66,14 +151,7 @@ bool AuthManager::verifyLogin(const QString &username, const QString &password)
     QJsonObject response = sendRequestAndWait(request);
 
     if (response["status"].toString() == "success") {
-        QJsonObject userData = response["data"].toObject();
-        if (globalStateInstance) { // 确保 globalStateInstance 已初始化
-            globalStateInstance->setUsername(userData["username"].toString());
-            globalStateInstance->setUserType(userData["type"].toString());
-            globalStateInstance->setBalance(userData["balance"].toDouble());
-            globalStateInstance->setIsConsumer(userData["type"].toString() == "Consumer");
-            globalStateInstance->setIsMerchant(userData["type"].toString() == "Merchant");
-        }
+        applyUserData(response["data"].toObject());
         return true;
     } else {
         qDebug() << "Login failed:" << response["message"].toString();
@@ -119,7 +197,11 @@ bool AuthManager::changePassword(const QString &username, const QString &oldPwd,
     request["payload"] = payload;
 
     QJsonObject response = sendRequestAndWait(request);
-    return response["status"].toString() == "success";
+    if (response["status"].toString() != "success") return false;
+    // 修改密码后旧令牌全部作废，换成服务器发的新令牌
+    const QString token = response["data"].toObject()["sessionToken"].toString();
+    if (globalStateInstance && !token.isEmpty()) globalStateInstance->setSessionToken(token);
+    return true;
 }
 
 bool AuthManager::recharge(const QString& username, double amount) {
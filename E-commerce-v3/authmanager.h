@@ -4,8 +4,11 @@
 #include <QObject>
 #include <QVariantMap>
 #include <QJsonObject>
+#include <QJsonArray>
 #include "globalstate.h" // 需要包含 GlobalState 来更新它
 
+class NetworkClient;
+
 class AuthManager : public QObject { // QObject 基类是为了使用信号槽机制（如果 sendRequestAndWait 内部需要）
     Q_OBJECT // 即使是静态方法为主的类，为了配合 QEventLoop，有时会临时创建实例或使用全局实例
 
@@ -22,9 +25,23 @@ public:
     Q_INVOKABLE static bool addBalance(const QString& username, double amount);
     Q_INVOKABLE static QString getUserType(const QString& username); // 假设 User 类有此方法
 
+    // 连接建立后与服务器协商传输方式（分帧等），旧服务器不支持时保持默认
+    // client 为空表示主连接
+    static bool negotiateProtocol(NetworkClient* client = nullptr);
+    // 断线重连后凭登录时拿到的会话令牌恢复服务器上的登录状态，不再需要密码。
+    // 没有令牌或令牌已过期时返回 false，调用方应退回登录界面
+    static bool resumeSession();
+
     // 辅助函数，发送请求并等待响应
     // 这个函数现在需要一个机制来确保它只处理它发出的那个请求的响应
-    static QJsonObject sendRequestAndWait(const QJsonObject& requestData, int timeoutMs = 5000);
+    // client 为空表示主连接；只读的目录请求可传 NetworkClient::forReads()
+    static QJsonObject sendRequestAndWait(const QJsonObject& requestData, int timeoutMs = 5000, NetworkClient* client = nullptr);
+
+    // 把多条请求放进一个 "batch" 请求，一次往返完成；返回与 requests 一一对应的响应。
+    // 子请求可设置 "independent": true 允许服务器并发执行；stopOnError 时第一条失败后其余不再执行。
+    // 服务器不支持 batch 时自动退回逐条发送。
+    static QJsonArray sendBatchAndWait(const QJsonArray& requests, bool stopOnError = false, int timeoutMs = 5000,
+                                       NetworkClient* client = nullptr);
 };
 
 #endif // AUTHMANAGER_H
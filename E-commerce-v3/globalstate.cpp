@@ -1,4 +1,5 @@
 #include "globalstate.h"
+#include "networkclient.h"
 #include <QDebug>
 
 GlobalState* GlobalState::m_instance = nullptr;
@@ -71,6 +72,15 @@ void GlobalState::setBalance(double balance) {
 }
 
 void GlobalState::logout() {
+    if (!m_sessionToken.isEmpty() && NetworkClient::instance()->isConnected()) {
+        // 让服务器作废令牌；不等回复
+        QJsonObject request;
+        request["action"] = "logout";
+        request["requestId"] = "logout";
+        request["payload"] = QJsonObject{{"token", m_sessionToken}};
+        NetworkClient::instance()->sendRequest(request);
+    }
+    m_sessionToken.clear();
     setUsername("");
     setUserType("");
     setBalance(0.0);
@@ -20,6 +20,7 @@ public:
     bool isConsumer() const;
     bool isMerchant() const;
     double balance() const;
+    QString sessionToken() const { return m_sessionToken; } // 登录时服务器发放，断线重连后用来恢复登录
 
     // Setter 方法
     void setUsername(const QString &username);
@@ -27,6 +28,7 @@ public:
     void setIsConsumer(bool isConsumer);
     void setIsMerchant(bool isMerchant);
     void setBalance(double balance);
+    void setSessionToken(const QString &token) { m_sessionToken = token; }
 
     static GlobalState * instance();
     Q_INVOKABLE void logout();
@@ -38,6 +40,8 @@ signals:
     void isConsumerChanged();
     void isMerchantChanged();
     void balanceChanged();
+    // 断线重连成功并已恢复登录（或确认会话已过期）之后发出，各模块据此重新订阅、刷新数据
+    void connectionRestored();
 
 private:
     // 私有成员变量
@@ -46,6 +50,7 @@ private:
     bool m_isConsumer = false;
     bool m_isMerchant = false;
     double m_balance = 0.0;
+    QString m_sessionToken;
     static GlobalState * m_instance;
 };
 
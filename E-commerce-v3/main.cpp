@@ -9,6 +9,8 @@
 #include "ordermanager.h"
 #include "globalstate.h"
 #include <QQuickStyle>
+#include <QCommandLineParser>
+#include <QDebug>
 
 // 全局实例指针，供 AuthManager 等内部使用
 GlobalState* globalStateInstance = nullptr;
@@ -18,13 +20,41 @@ int main(int argc, char *argv[]) {
     QQmlApplicationEngine engine;
     QQuickStyle::setStyle("Material");
 
+    QCommandLineParser parser;
+    QCommandLineOption replicaOption("read-replica", "Read-only catalog replica (host:port) for browsing and search.", "address");
+    parser.addOption(replicaOption);
+    parser.process(app);
+
     // 1. 初始化 NetworkClient 并尝试连接
-    NetworkClient::instance()->connectToServer("localhost", 8080);
+    if (NetworkClient::instance()->connectToServer("localhost", 8080)) {
+        AuthManager::negotiateProtocol(); // 在发出任何其他请求之前完成
+    }
+    if (parser.isSet(replicaOption)) {
+        const QString address = parser.value(replicaOption);
+        const int colon = address.lastIndexOf(':');
+        if (colon > 0 && NetworkClient::connectReadReplica(address.left(colon), address.mid(colon + 1).toUShort())) {
+            AuthManager::negotiateProtocol(NetworkClient::readReplica());
+        } else {
+            qWarning() << "Read replica" << address << "unavailable, reading the catalog from the primary server.";
+        }
+    }
 
     // 2. 初始化 GlobalState
     globalStateInstance = new GlobalState(); // 其他C++类将通过此指针更新它
     engine.rootContext()->setContextProperty("global", globalStateInstance);
 
+    // 断线自动重连之后：重新协商协议，凭会话令牌恢复登录，再通知各模块重新订阅
+    QObject::connect(NetworkClient::instance(), &NetworkClient::connected, globalStateInstance, []() {
+        AuthManager::negotiateProtocol();
+        if (!globalStateInstance->sessionToken().isEmpty() && !AuthManager::resumeSession()) {
+            globalStateInstance->logout(); // 会话已过期，回到登录界面
+        }
+        emit globalStateInstance->connectionRestored();
+    });
+    if (NetworkClient* replica = NetworkClient::readReplica()) {
+        QObject::connect(replica, &NetworkClient::connected, replica, [replica]() { AuthManager::negotiateProtocol(replica); });
+    }
+
 
     // 3. 注册其他管理器 - QML通过这些名字调用方法
     // AuthManager 主要通过静态方法被QML调用，如果QML中没有AuthManager.xxx的用法，则不需要注册
@@ -1,9 +1,11 @@
 #include "networkclient.h"
 #include <QHostAddress>
 #include <QJsonParseError>
+#include <QRandomGenerator>
 #include <QDebug>
 
 NetworkClient* NetworkClient::m_pInstance = nullptr;
+NetworkClient* NetworkClient::m_pReplica = nullptr;
 
 NetworkClient* NetworkClient::instance() {
     if (!m_pInstance)
@@ -11,8 +13,21 @@ NetworkClient* NetworkClient::instance() {
     return m_pInstance;
 }
 
+bool NetworkClient::connectReadReplica(const QString& host, quint16 port) {
+    if (!m_pReplica)
+        m_pReplica = new NetworkClient();
+    return m_pReplica->connectToServer(host, port);
+}
+
+NetworkClient* NetworkClient::forReads() {
+    return (m_pReplica && m_pReplica->isConnected()) ? m_pReplica : instance();
+}
+
 NetworkClient::NetworkClient(QObject *parent) : QObject(parent) {
     m_socket = new QTcpSocket(this);
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout, this, &NetworkClient::reconnect);
     connect(m_socket, &QTcpSocket::connected, this, &NetworkClient::onSocketConnected);
     connect(m_socket, &QTcpSocket::disconnected, this, &NetworkClient::onSocketDisconnected);
     connect(m_socket, &QTcpSocket::readyRead, this, &NetworkClient::onSocketReadyRead);
@@ -23,17 +38,38 @@ NetworkClient::~NetworkClient() {
 }
 
 bool NetworkClient::connectToServer(const QString& host, quint16 port) {
+    m_host = host;
+    m_port = port;
+    m_reconnectTimer->stop();
     if (m_socket->state() == QAbstractSocket::UnconnectedState) {
         qInfo() << "NetworkClient: Connecting to" << host << ":" << port;
         m_socket->connectToHost(QHostAddress(host), port);
     }
-    return m_socket->waitForConnected(3000);
+    bool ok = m_socket->waitForConnected(3000);
+    if (ok) m_autoReconnect = true;
+    return ok;
 }
 
 void NetworkClient::disconnectFromServer() {
+    m_autoReconnect = false;
+    m_reconnectTimer->stop();
     if (m_socket->isOpen()) m_socket->disconnectFromHost();
 }
 
+void NetworkClient::scheduleReconnect() {
+    if (!m_autoReconnect || m_reconnectTimer->isActive()) return;
+    // 随机抖动，避免服务器重启后所有客户端在同一时刻涌入
+    const int delay = m_reconnectDelayMs / 2 + int(QRandomGenerator::global()->bounded(m_reconnectDelayMs / 2 + 1));
+    m_reconnectDelayMs = qMin(m_reconnectDelayMs * 2, MaxReconnectDelayMs);
+    qInfo() << "NetworkClient: Reconnecting to" << m_host << ":" << m_port << "in" << delay << "ms";
+    m_reconnectTimer->start(delay);
+}
+
+void NetworkClient::reconnect() {
+    if (m_socket->state() != QAbstractSocket::UnconnectedState) return;
+    m_socket->connectToHost(QHostAddress(m_host), m_port); // 不阻塞界面；失败时 onSocketError 安排下一次
+}
+
 bool NetworkClient::isConnected() const {
     return m_socket && m_socket->state() == QAbstractSocket::ConnectedState;
 }
@@ -43,48 +79,91 @@ void NetworkClient::sendRequest(const QJsonObject& request) {
         qWarning() << "NetworkClient: Not connected. Cannot send request:" << request["action"].toString();
         return;
     }
-    QByteArray data = QJsonDocument(request).toJson(QJsonDocument::Compact) + "\n";
-    m_socket->write(data);
+    QByteArray data = WireProtocol::encodeMessage(request, m_encoding);
+    m_socket->write(WireProtocol::encodeFrame(data, m_reader.framing()));
     m_socket->flush();
-    qDebug() << "NetworkClient TX:" << data.trimmed();
+    qDebug() << "NetworkClient TX:" << request["action"].toString() << data.size() << "bytes";
 }
 
 void NetworkClient::onSocketConnected() {
     qInfo() << "NetworkClient: Connected to server.";
+    m_reconnectDelayMs = InitialReconnectDelayMs;
     emit connected();
 }
 
 void NetworkClient::onSocketDisconnected() {
     qInfo() << "NetworkClient: Disconnected from server.";
+    // 重连后需要重新协商
+    m_reader = FrameReader();
+    m_encoding = WireProtocol::Encoding::Json;
+    m_compression = WireProtocol::Compression::None;
     emit disconnected();
+    scheduleReconnect();
 }
 
 void NetworkClient::onSocketError(QAbstractSocket::SocketError socketError) {
     qWarning() << "NetworkClient: Socket error:" << m_socket->errorString();
     emit errorOccurred(socketError, m_socket->errorString());
+    // 连接尝试失败时不会有 disconnected 信号
+    if (m_socket->state() == QAbstractSocket::UnconnectedState) scheduleReconnect();
 }
 
 void NetworkClient::onSocketReadyRead() {
-    m_buffer.append(m_socket->readAll());
+    m_reader.append(m_socket->readAll());
+    QByteArray jsonData;
+    bool compressed = false;
     while (true) {
-        int newlinePos = m_buffer.indexOf('\n');
-        if (newlinePos == -1) {
+        FrameReader::Result result = m_reader.next(&jsonData, &compressed);
+        if (result == FrameReader::NeedMoreData) {
             break;
         }
+        if (result == FrameReader::FrameTooLarge) {
+            qWarning() << "NetworkClient: Frame exceeds size limit, dropping connection.";
+            m_socket->abort();
+            return;
+        }
 
-        QByteArray jsonData = m_buffer.left(newlinePos);
-        m_buffer = m_buffer.mid(newlinePos + 1);
-
-        if (jsonData.isEmpty()) continue;
-
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(jsonData, &error);
-
-        if (error.error == QJsonParseError::NoError && doc.isObject()) {
-            qDebug() << "NetworkClient RX:" << doc.toJson(QJsonDocument::Compact);
-            emit responseReceived(doc.object());
+        QJsonObject response;
+        QString errorString;
+        if (compressed) {
+            QByteArray inflated;
+            if (!WireProtocol::decompressPayload(jsonData, &inflated)) {
+                qWarning() << "NetworkClient: Invalid compressed frame, bytes:" << jsonData.size();
+                continue;
+            }
+            jsonData = inflated;
+        }
+        if (WireProtocol::decodeMessage(jsonData, m_encoding, &response, &errorString)) {
+            qDebug() << "NetworkClient RX:" << response["response_to_action"].toString() << jsonData.size() << "bytes";
+            // 必须在解析下一帧之前切换，服务器在 hello 回复之后就改用新的分帧和编码
+            applyNegotiation(response);
+            if (response.value("response_to_action").toString() == "event") {
+                emit eventReceived(response.value("event").toString(), response.value("data").toObject());
+            } else {
+                emit responseReceived(response);
+            }
         } else {
-            qWarning() << "NetworkClient: JSON parse error:" << error.errorString() << "Data:" << jsonData;
+            qWarning() << "NetworkClient: Parse error:" << errorString << "Bytes:" << jsonData.size();
         }
     }
 }
+
+void NetworkClient::applyNegotiation(const QJsonObject& response) {
+    if (response.value("response_to_action").toString() != "hello"
+        || response.value("status").toString() != "success") {
+        return;
+    }
+    QJsonObject data = response.value("data").toObject();
+    WireProtocol::Framing framing = m_reader.framing();
+    WireProtocol::Encoding encoding = m_encoding;
+    WireProtocol::framingFromString(data.value("framing").toString(), &framing);
+    WireProtocol::encodingFromString(data.value("encoding").toString(), &encoding);
+    // 压缩帧带标志位，收到时按帧解压即可；这里只记录协商结果
+    WireProtocol::compressionFromString(data.value("compression").toString(), &m_compression);
+    if (framing != m_reader.framing() || encoding != m_encoding) {
+        m_reader.setFraming(framing);
+        m_encoding = encoding;
+        qInfo() << "NetworkClient: Switched to" << WireProtocol::framingToString(framing) << "framing,"
+                << WireProtocol::encodingToString(encoding) << "encoding";
+    }
+}
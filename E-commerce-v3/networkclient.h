@@ -5,34 +5,62 @@
 #include <QTcpSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QTimer>
+#include "wireprotocol.h"
 
 class NetworkClient : public QObject {
     Q_OBJECT
 public:
     static NetworkClient* instance(); // Singleton
+    // 可选的目录只读副本连接：getProducts/searchProducts 和目录订阅走这里，减轻主服务器负担。
+    // 未配置或连接断开时 forReads() 返回主连接。
+    static bool connectReadReplica(const QString& host, quint16 port);
+    static NetworkClient* readReplica() { return m_pReplica; }
+    static NetworkClient* forReads();
     ~NetworkClient();
 
+    // 连接成功过一次之后，意外断线会按指数退避（带随机抖动，上限 MaxReconnectDelayMs）自动重连；
+    // 重连成功同样发出 connected()，调用方需要重新协商协议并恢复登录
     bool connectToServer(const QString& host, quint16 port);
-    void disconnectFromServer();
+    void disconnectFromServer(); // 主动断开，不再自动重连
     bool isConnected() const;
     void sendRequest(const QJsonObject& request); // 发送请求
+    WireProtocol::Framing framing() const { return m_reader.framing(); }
+    WireProtocol::Encoding encoding() const { return m_encoding; }
+    WireProtocol::Compression compression() const { return m_compression; }
 
 signals:
     void connected();
     void disconnected();
     void errorOccurred(QAbstractSocket::SocketError socketError, const QString& errorString);
     void responseReceived(const QJsonObject& response); // 接收到响应时发射
+    void eventReceived(const QString& event, const QJsonObject& data); // 服务器推送的订阅事件（不对应任何请求）
 
 private slots:
     void onSocketConnected();
     void onSocketDisconnected();
     void onSocketReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void reconnect();
 
 private:
     explicit NetworkClient(QObject *parent = nullptr);
+    static constexpr int InitialReconnectDelayMs = 250;
+    static constexpr int MaxReconnectDelayMs = 10000;
+
     QTcpSocket *m_socket;
+    QTimer *m_reconnectTimer;
+    QString m_host;
+    quint16 m_port = 0;
+    bool m_autoReconnect = false;
+    int m_reconnectDelayMs = InitialReconnectDelayMs; // 下一次重连前的等待时间，连上后复位
     static NetworkClient* m_pInstance;
-    QByteArray m_buffer;
+    static NetworkClient* m_pReplica;
+    FrameReader m_reader; // 接收缓冲，同时记录当前分帧方式（收发一致）
+    WireProtocol::Encoding m_encoding = WireProtocol::Encoding::Json;
+    WireProtocol::Compression m_compression = WireProtocol::Compression::None; // 只用于解压服务器的回复，请求不压缩
+
+    void applyNegotiation(const QJsonObject& response);
+    void scheduleReconnect();
 };
 #endif // NETWORKCLIENT_H
@@ -1,12 +1,35 @@
 #include "ordermanager.h"
 #include "authmanager.h" // For sendRequestAndWait
 #include "globalstate.h" // For username and updating balance
+#include "networkclient.h"
 #include <QJsonArray>
 #include <QDebug>
 
 extern GlobalState* globalStateInstance;
 
 OrderManager::OrderManager(QObject *parent) : QObject(parent), m_shoppingCart(nullptr) {
+    connect(NetworkClient::instance(), &NetworkClient::eventReceived, this, &OrderManager::onServerEvent);
+    if (globalStateInstance) {
+        connect(globalStateInstance, &GlobalState::usernameChanged, this, &OrderManager::onUserChanged);
+        connect(globalStateInstance, &GlobalState::connectionRestored, this, &OrderManager::onUserChanged);
+    }
+}
+
+void OrderManager::onUserChanged() {
+    m_ordersCursor.clear(); // 游标属于上一次加载的订单列表
+    // 登录后订阅自己的订单，超时取消等服务器端的状态变化不用再轮询；旧服务器返回错误时忽略
+    if (globalStateInstance->username().isEmpty()) return;
+    QJsonObject request;
+    request["action"] = "subscribe";
+    request["payload"] = QJsonObject{{"topics", QJsonArray{"orders"}}};
+    QJsonObject response = AuthManager::sendRequestAndWait(request);
+    if (response["status"].toString() != "success") {
+        qInfo() << "OrderManager: Order push not available -" << response["message"].toString();
+    }
+}
+
+void OrderManager::onServerEvent(const QString& event, const QJsonObject& data) {
+    if (event == "orderChanged") emit orderUpdated(data.toVariantMap());
 }
 
 void OrderManager::setCartInstance(ShoppingCart* cart) {
@@ -68,7 +91,11 @@ bool OrderManager::payOrder(const QString& orderId) {
     payload["orderId"] = orderId;
     request["payload"] = payload;
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request);
+    // 支付和取回（已被服务器清空的）购物车合并成一次往返
+    QJsonObject getCart;
+    getCart["action"] = "getCart";
+    QJsonArray results = AuthManager::sendBatchAndWait(QJsonArray{request, getCart}, true);
+    QJsonObject response = results.at(0).toObject();
     if (response["status"].toString() == "success") {
         QJsonObject data = response["data"].toObject();
         double newBalance;
@@ -79,9 +106,9 @@ bool OrderManager::payOrder(const QString& orderId) {
             newBalance = globalStateInstance->balance();
         }        globalStateInstance->setBalance(newBalance); // 更新全局余额
 
-        // 支付成功后，购物车通常会被清空 (服务器端处理)
+        // 支付成功后，购物车由服务器端清空，这里同步本地
         if (m_shoppingCart) {
-            m_shoppingCart->clearCart();
+            m_shoppingCart->applyCartResponse(results.at(1).toObject());
         }
         emit stockPossiblyChanged(); // 通知UI（间接通知ProductModel）库存可能变了
         emit orderPaid(true, orderId, "Order paid successfully. New balance: " + QString::number(newBalance));
@@ -94,26 +121,40 @@ bool OrderManager::payOrder(const QString& orderId) {
     }
 }
 
-QVariantList OrderManager::getUserOrders() {
+QVariantList OrderManager::getUserOrders(int limit) {
     if (!globalStateInstance || globalStateInstance->username().isEmpty()) {
         emit ordersLoaded(false, QVariantList(), "User not logged in.");
         return QVariantList();
     }
+    m_ordersPageSize = limit;
+    m_ordersCursor.clear();
+    QJsonObject payload;
+    if (limit > 0) payload["limit"] = limit;
+    return requestOrders(payload);
+}
 
-    QJsonObject request;
-    request["action"] = "getOrders"; // 获取当前用户的所有订单
-    // QJsonObject payload; payload["username"] = globalStateInstance->username();
-    // request["payload"] = payload;
+QVariantList OrderManager::loadMoreOrders() {
+    if (m_ordersCursor.isEmpty()) return QVariantList();
+    QJsonObject payload;
+    payload["limit"] = m_ordersPageSize;
+    payload["cursor"] = m_ordersCursor;
+    return requestOrders(payload);
+}
 
+QVariantList OrderManager::requestOrders(const QJsonObject& payload) {
+    QJsonObject request;
+    request["action"] = "getOrders"; // 获取当前用户的订单
+    request["payload"] = payload;
 
     QJsonObject response = AuthManager::sendRequestAndWait(request);
     if (response["status"].toString() == "success") {
-        QJsonArray ordersArray = response["data"].toObject()["orders"].toArray();
+        const QJsonObject data = response["data"].toObject();
+        QJsonArray ordersArray = data["orders"].toArray();
         QVariantList ordersData;
         for (const QJsonValue& val : ordersArray) {
             ordersData.append(val.toObject().toVariantMap());
         }
-        // m_userOrders = ordersData; // (可选) 本地缓存
+        m_ordersCursor = data["nextCursor"].toString();
         emit ordersLoaded(true, ordersData, "Orders loaded successfully.");
         return ordersData;
     } else {
@@ -19,8 +19,10 @@ public:
     Q_INVOKABLE QVariantMap prepareOrderFromCart(); // 返回订单预览信息 (含总价、商品列表等)
     // 2. 支付订单
     Q_INVOKABLE bool payOrder(const QString& orderId); // 支付指定ID的订单
-    // 3. 获取用户历史订单
-    Q_INVOKABLE QVariantList getUserOrders();
+    // 3. 获取用户历史订单（从新到旧）。limit > 0 时只取最新的 limit 个，之后用 loadMoreOrders 取更早的一页
+    Q_INVOKABLE QVariantList getUserOrders(int limit = 0);
+    Q_INVOKABLE QVariantList loadMoreOrders();
+    Q_INVOKABLE bool hasMoreOrders() const { return !m_ordersCursor.isEmpty(); }
 
 signals:
     void orderPrepared(bool success, const QVariantMap& orderData, const QString& message);
@@ -28,9 +30,17 @@ signals:
     void ordersLoaded(bool success, const QVariantList& ordersData, const QString& message);
     void paymentError(const QString& message); // 特定于支付的错误
     void stockPossiblyChanged(); // 通知ProductModel可能需要刷新
+    void orderUpdated(const QVariantMap& orderData); // 服务器推送的订单创建/状态变化（支付、超时取消），不含商品明细
+
+private slots:
+    void onUserChanged();
+    void onServerEvent(const QString& event, const QJsonObject& data);
 
 private:
     // QList<QVariantMap> m_userOrders; // 本地缓存的用户历史订单 (可选)
+    QVariantList requestOrders(const QJsonObject& payload); // 发送 getOrders，记录下一页的游标
+    int m_ordersPageSize = 0;
+    QString m_ordersCursor; // 为空表示没有更早的订单
     ShoppingCart* m_shoppingCart; // 指向购物车实例
 };
 
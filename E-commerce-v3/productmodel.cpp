@@ -23,32 +23,106 @@ ProductModel::ProductModel(QObject *parent) : QAbstractListModel(parent) {
     m_roleNamesH[MerchantUsernameRole] = "merchantUsername";
     m_roleNamesH[BasePriceRole] = "basePrice";
 
-    loadProductsFromServer();
+    connect(NetworkClient::instance(), &NetworkClient::eventReceived, this, &ProductModel::onServerEvent);
+    if (NetworkClient* replica = NetworkClient::readReplica()) {
+        // 目录从只读副本读取；副本断开后改为在主服务器上订阅
+        connect(replica, &NetworkClient::eventReceived, this, &ProductModel::onServerEvent);
+        connect(replica, &NetworkClient::disconnected, this, &ProductModel::subscribeAndLoad);
+    }
+    if (globalStateInstance) {
+        // 主连接重连后重新订阅；从副本读取时目录订阅不受影响
+        connect(globalStateInstance, &GlobalState::connectionRestored, this, [this]() {
+            if (NetworkClient::forReads() == NetworkClient::instance()) subscribeAndLoad();
+        });
+    }
+    subscribeAndLoad();
 }
 
 QHash<int, QByteArray> ProductModel::roleNames() const {
     return m_roleNamesH;
 }
 
+void ProductModel::subscribeAndLoad() {
+    QJsonObject subscribe;
+    subscribe["action"] = "subscribe";
+    subscribe["payload"] = QJsonObject{{"topics", QJsonArray{"catalog"}}};
+    QJsonObject request;
+    request["action"] = "getProducts";
+    request["payload"] = QJsonObject{{"limit", PageSize}}; // 只取第一页，其余随滚动加载
+
+    // 先订阅再取第一页：两者之间发生的变化会以事件形式在第一页之前到达，随后被覆盖
+    QJsonArray results = AuthManager::sendBatchAndWait(QJsonArray{subscribe, request}, false, 5000, NetworkClient::forReads());
+    m_subscribed = results.at(0).toObject()["status"].toString() == "success";
+    QJsonObject response = results.at(1).toObject();
+    if (response["status"].toString() == "success") {
+        m_showingSearch = false;
+        resetFromPage(request, response);
+    } else {
+        qWarning() << "ProductModel: Failed to load products -" << response["message"].toString();
+    }
+}
+
 void ProductModel::loadProductsFromServer() {
     QJsonObject request;
     request["action"] = "getProducts";
+    request["payload"] = QJsonObject{{"limit", PageSize}};
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request); // 使用 AuthManager 的辅助函数
+    QJsonObject response = AuthManager::sendRequestAndWait(request, 5000, NetworkClient::forReads()); // 使用 AuthManager 的辅助函数
 
     if (response["status"].toString() == "success") {
-        beginResetModel();
-        m_productsData.clear();
-        QJsonArray productsArray = response["data"].toObject()["products"].toArray();
-        for (const QJsonValue &val : productsArray) {
-            m_productsData.append(val.toObject().toVariantMap());
-        }
-        endResetModel();
+        m_showingSearch = false;
+        resetFromPage(request, response);
     } else {
         qWarning() << "ProductModel: Failed to load products -" << response["message"].toString();
     }
 }
 
+void ProductModel::resetFromPage(const QJsonObject& request, const QJsonObject& response) {
+    const QJsonObject data = response["data"].toObject();
+    beginResetModel();
+    m_productsData.clear();
+    for (const QJsonValue &val : data["products"].toArray()) {
+        m_productsData.append(val.toObject().toVariantMap());
+    }
+    m_pageRequest = request;
+    m_nextCursor = data["nextCursor"].toString();
+    endResetModel();
+}
+
+bool ProductModel::canFetchMore(const QModelIndex &parent) const {
+    return !parent.isValid() && !m_nextCursor.isEmpty();
+}
+
+void ProductModel::fetchMore(const QModelIndex &parent) {
+    if (parent.isValid() || m_nextCursor.isEmpty()) return;
+    const QJsonObject pageRequest = m_pageRequest;
+    QJsonObject request = pageRequest;
+    QJsonObject payload = request["payload"].toObject();
+    payload["cursor"] = m_nextCursor;
+    request["payload"] = payload;
+    m_nextCursor.clear(); // 请求期间视图可能再次调用 fetchMore，不重复请求
+
+    QJsonObject response = AuthManager::sendRequestAndWait(request, 5000, NetworkClient::forReads());
+    if (m_pageRequest != pageRequest || !m_nextCursor.isEmpty()) return; // 等待期间列表已被重新加载
+    if (response["status"].toString() != "success") {
+        qWarning() << "ProductModel: Failed to load more products -" << response["message"].toString();
+        m_nextCursor = payload["cursor"].toString(); // 下次滚动到底时重试
+        return;
+    }
+    const QJsonObject data = response["data"].toObject();
+    QList<QVariantMap> page;
+    for (const QJsonValue &val : data["products"].toArray()) {
+        // 等待期间可能已由 productAdded 事件插入
+        if (findRow(val.toObject()["id"].toInteger()) < 0) page.append(val.toObject().toVariantMap());
+    }
+    if (!page.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_productsData.size(), m_productsData.size() + page.size() - 1);
+        m_productsData.append(page);
+        endInsertRows();
+    }
+    m_nextCursor = data["nextCursor"].toString();
+}
+
 // QML调用的 search
 void ProductModel::search(const QString &keyword, int searchType, const QString& minPriceStr, const QString& maxPriceStr) {
     QJsonObject request;
@@ -64,17 +138,13 @@ void ProductModel::search(const QString &keyword, int searchType, const QString&
     if(okMin && minP >=0) payload["minPrice"] = minP;
     if(okMax && maxP >=0) payload["maxPrice"] = maxP;
 
+    payload["limit"] = PageSize;
     request["payload"] = payload;
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request);
+    QJsonObject response = AuthManager::sendRequestAndWait(request, 5000, NetworkClient::forReads());
     if (response["status"].toString() == "success") {
-        beginResetModel();
-        m_productsData.clear();
-        QJsonArray productsArray = response["data"].toObject()["products"].toArray();
-        for (const QJsonValue &val : productsArray) {
-            m_productsData.append(val.toObject().toVariantMap());
-        }
-        endResetModel();
+        m_showingSearch = !keyword.isEmpty() || payload.contains("minPrice") || payload.contains("maxPrice");
+        resetFromPage(request, response);
     } else {
         qWarning() << "ProductModel: Search failed -" << response["message"].toString();
     }
@@ -97,8 +167,8 @@ bool ProductModel::addProduct(const QString &name, const QString &desc, double p
 
     QJsonObject response = AuthManager::sendRequestAndWait(request);
     if (response["status"].toString() == "success") {
-        // 添加成功后，重新从服务器加载所有商品以更新模型
-        loadProductsFromServer();
+        // 添加成功后，重新从服务器加载所有商品以更新模型（已订阅时 productAdded 事件已经更新了模型）
+        if (!m_subscribed) loadProductsFromServer();
         return true;
     }
     qWarning() << "ProductModel: Failed to add product -" << response["message"].toString();
@@ -129,7 +199,7 @@ bool ProductModel::updateProduct(Product *productToUpdate, const QString &name,
 
     QJsonObject response = AuthManager::sendRequestAndWait(request);
     if (response["status"].toString() == "success") {
-        loadProductsFromServer(); // 更新成功后刷新
+        if (!m_subscribed) loadProductsFromServer(); // 更新成功后刷新
         return true;
     }
     qWarning() << "ProductModel: Failed to update product -" << response["message"].toString();
@@ -157,7 +227,7 @@ bool ProductModel::purchaseProduct(int index, const QString& username) {
     QJsonObject response = AuthManager::sendRequestAndWait(request);
     if (response["status"].toString() == "success") {
         // 购买成功，需要更新本地商品库存（通过刷新）和用户余额
-        loadProductsFromServer(); // 刷新商品列表（库存变化）
+        if (!m_subscribed) loadProductsFromServer(); // 刷新商品列表（库存变化）
         if (globalStateInstance && globalStateInstance->username() == username) {
             // 服务器应在响应中返回新的余额
             QJsonObject data = response["data"].toObject();
@@ -183,7 +253,7 @@ void ProductModel::setCategoryDiscount(const QString& category, double discount)
 
     QJsonObject response = AuthManager::sendRequestAndWait(request);
     if (response["status"].toString() == "success") {
-        loadProductsFromServer(); // 价格会变，刷新列表
+        if (!m_subscribed) loadProductsFromServer(); // 价格会变，刷新列表
     } else {
         qWarning() << "ProductModel: Failed to set category discount -" << response["message"].toString();
     }
@@ -245,6 +315,50 @@ QVariant ProductModel::data(const QModelIndex &index, int role) const {
     }
 }
 
+int ProductModel::findRow(qint64 productId) const {
+    for (int i = 0; i < m_productsData.size(); ++i) {
+        if (m_productsData.at(i).value("id").toLongLong() == productId) return i;
+    }
+    return -1;
+}
+
+void ProductModel::onServerEvent(const QString& event, const QJsonObject& data) {
+    if (event == "productAdded") {
+        const qint64 id = data["id"].toInteger();
+        if (m_showingSearch || findRow(id) >= 0) return;
+        // 浏览列表按 ID 升序分页：排在尚未加载的页里的商品，翻到那一页时自然会取回
+        if (!m_nextCursor.isEmpty() && !m_productsData.isEmpty() && id > m_productsData.last().value("id").toLongLong()) return;
+        int row = 0;
+        while (row < m_productsData.size() && m_productsData.at(row).value("id").toLongLong() < id) ++row;
+        beginInsertRows(QModelIndex(), row, row);
+        m_productsData.insert(row, data.toVariantMap());
+        endInsertRows();
+    } else if (event == "productChanged") {
+        int row = findRow(data["id"].toInteger()); // 按 ID 定位，改名不影响
+        if (row < 0) return; // 不在当前列表（例如搜索结果之外）
+        QVariantMap updated = data.toVariantMap();
+        updated.remove("previousName");
+        m_productsData[row] = updated;
+        emit dataChanged(index(row), index(row));
+    } else if (event == "catalogResync") {
+        // 服务器在本连接发送积压时合并掉了目录事件，按当前列表的请求重新取第一页
+        if (m_pageRequest.isEmpty()) return;
+        const QJsonObject request = m_pageRequest;
+        QJsonObject response = AuthManager::sendRequestAndWait(request, 5000, NetworkClient::forReads());
+        if (response["status"].toString() == "success" && m_pageRequest == request) resetFromPage(request, response);
+    } else if (event == "discountChanged") {
+        QString category = data["category"].toString();
+        double discount = data["discount"].toDouble();
+        for (int i = 0; i < m_productsData.size(); ++i) {
+            QVariantMap& pData = m_productsData[i];
+            if (pData.value("category").toString() != category) continue;
+            pData["discount"] = discount;
+            pData["price"] = pData.value("basePrice").toDouble() * discount; // 与服务器 getPrice() 一致
+            emit dataChanged(index(i), index(i), {PriceRole, DiscountRole});
+        }
+    }
+}
+
 QVariantMap ProductModel::findProductData(const QString& name, const QString& merchantUsername) const {
     for(const QVariantMap& pData : m_productsData) {
         if (pData.value("name").toString() == name && pData.value("merchantUsername").toString() == merchantUsername) {
@@ -4,6 +4,7 @@
 #include <QAbstractListModel>
 #include <QList>
 #include <QVariantMap>
+#include <QJsonObject>
 #include "product.h"
 
 class ProductModel : public QAbstractListModel {
@@ -36,11 +37,25 @@ public:
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QHash<int, QByteArray> roleNames() const override;
+    // 商品列表分页加载：视图滚动到末尾时调用 fetchMore 取下一页
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
 
     QVariantMap findProductData(const QString& name, const QString& merchantUsername) const; // 返回 QVariantMap 更安全
 
+private slots:
+    void onServerEvent(const QString& event, const QJsonObject& data); // 订阅的目录变化，按行增量更新
+
 private:
     void loadProductsFromServer(); // 内部方法，从服务器加载数据到 m_productsData
+    void subscribeAndLoad();       // 订阅 "catalog" 并加载全部商品，一次往返
+    int findRow(qint64 productId) const; // 服务器分配的商品 ID，改名后不变
+    void resetFromPage(const QJsonObject& request, const QJsonObject& response); // 用第一页替换列表
+    static constexpr int PageSize = 50;
+    QJsonObject m_pageRequest; // 当前列表对应的请求（getProducts 或 searchProducts），翻页时带上 cursor 重发
+    QString m_nextCursor;      // 为空表示已全部取回
+    bool m_subscribed = false; // 服务器会推送目录变化，修改后不必整表重新加载
+    bool m_showingSearch = false; // 当前是搜索结果，新增的商品不一定匹配，不追加
     QList<QVariantMap> m_productsData; // 存储从服务器获取的商品数据
     QHash<int, QByteArray> m_roleNamesH;
     // static ProductModel* instance; // 如果是单例，需要有实例
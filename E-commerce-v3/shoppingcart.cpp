@@ -1,12 +1,19 @@
 #include "shoppingcart.h"
 #include "authmanager.h"
 #include "globalstate.h"
+#include "networkclient.h"
 #include <QJsonArray>
 #include <QDebug>
 
 extern GlobalState* globalStateInstance;
 
 ShoppingCart::ShoppingCart(QObject *parent) : QObject(parent) {
+    connect(NetworkClient::instance(), &NetworkClient::eventReceived, this, &ShoppingCart::onServerEvent);
+    if (globalStateInstance) {
+        connect(globalStateInstance, &GlobalState::usernameChanged, this, &ShoppingCart::onUserChanged);
+        // 重连后服务器端是新会话，订阅要重新建立，断线期间的修改也要重新取回
+        connect(globalStateInstance, &GlobalState::connectionRestored, this, &ShoppingCart::onUserChanged);
+    }
     if (globalStateInstance && !globalStateInstance->username().isEmpty()) {
         loadCartFromServer();
     }
@@ -19,11 +26,43 @@ void ShoppingCart::loadCartFromServer() {
         return;
     }
 
+    QJsonObject subscribe;
+    subscribe["action"] = "subscribe";
+    subscribe["payload"] = QJsonObject{{"topics", QJsonArray{"cart"}}};
     QJsonObject request;
     request["action"] = "getCart";
 
+    // 订阅与首次加载一次往返；旧服务器不认识 subscribe 时照常加载，之后继续在修改后取回
+    QJsonArray results = AuthManager::sendBatchAndWait(QJsonArray{subscribe, request});
+    m_subscribed = results.at(0).toObject()["status"].toString() == "success";
+    applyCartResponse(results.at(1).toObject());
+}
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request);
+void ShoppingCart::onUserChanged() {
+    if (globalStateInstance->username().isEmpty()) {
+        if (m_subscribed) {
+            // 服务器端此时仍是原来的用户，"cart" 指的就是他的购物车
+            AuthManager::sendRequestAndWait(QJsonObject{{"action", "unsubscribe"},
+                                                        {"payload", QJsonObject{{"topics", QJsonArray{"cart"}}}}});
+            m_subscribed = false;
+        }
+        m_cartItems.clear();
+        emit totalPriceChanged();
+        return;
+    }
+    loadCartFromServer(); // 服务器换用户时会退订上一个用户的推送，这里重新订阅
+}
+
+void ShoppingCart::onServerEvent(const QString& event, const QJsonObject& data) {
+    if (event != "cartChanged") return;
+    m_cartItems.clear();
+    for (const QJsonValue& val : data["items"].toArray()) {
+        m_cartItems.append(val.toObject().toVariantMap());
+    }
+    emit totalPriceChanged();
+}
+
+void ShoppingCart::applyCartResponse(const QJsonObject& response) {
     m_cartItems.clear(); // 清空本地旧数据
 
     if (response["status"].toString() == "success") {
@@ -37,6 +76,47 @@ void ShoppingCart::loadCartFromServer() {
     emit totalPriceChanged();
 }
 
+bool ShoppingCart::mutateCart(const QJsonObject& request, const QString& successMessage) {
+    if (m_subscribed) {
+        // 服务器先推送 cartChanged 再回复，等到回复时本地购物车已经是最新的
+        QJsonObject response = AuthManager::sendRequestAndWait(request);
+        if (response["status"].toString() == "success") {
+            emit cartUpdated(true, successMessage);
+            return true;
+        }
+        qWarning() << "ShoppingCart:" << request["action"].toString() << "failed -" << response["message"].toString();
+        emit cartUpdated(false, response["message"].toString());
+        return false;
+    }
+
+    QJsonObject getCart;
+    getCart["action"] = "getCart";
+    // 修改失败时不需要重新加载购物车
+    QJsonArray results = AuthManager::sendBatchAndWait(QJsonArray{request, getCart}, true);
+    QJsonObject response = results.at(0).toObject();
+    if (response["status"].toString() == "success") {
+        applyCartResponse(results.at(1).toObject()); // 操作成功后，用同一批次返回的购物车替换本地数据
+        emit cartUpdated(true, successMessage);
+        return true;
+    } else {
+        qWarning() << "ShoppingCart:" << request["action"].toString() << "failed -" << response["message"].toString();
+        emit cartUpdated(false, response["message"].toString());
+        return false;
+    }
+}
+
+void ShoppingCart::addProductRef(QJsonObject& payload, const QString& productName, const QString& merchantUsername) const {
+    for (const QVariantMap& item : m_cartItems) {
+        if (item.value("name").toString() == productName && item.value("merchantUsername").toString() == merchantUsername
+            && item.contains("productId")) {
+            payload["productId"] = item.value("productId").toLongLong();
+            break;
+        }
+    }
+    payload["productName"] = productName;
+    payload["merchantUsername"] = merchantUsername;
+}
+
 bool ShoppingCart::addItem(const QString& productName, const QString& merchantUsername, int quantity) {
     if (!globalStateInstance || globalStateInstance->username().isEmpty()) {
         emit cartUpdated(false, "User not logged in.");
@@ -50,21 +130,11 @@ bool ShoppingCart::addItem(const QString& productName, const QString& merchantUs
     QJsonObject request;
     request["action"] = "addToCart";
     QJsonObject payload;
-    payload["productName"] = productName;
-    payload["merchantUsername"] = merchantUsername;
+    addProductRef(payload, productName, merchantUsername);
     payload["quantity"] = quantity;
     request["payload"] = payload;
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request);
-    if (response["status"].toString() == "success") {
-        loadCartFromServer(); // 操作成功后，重新从服务器加载整个购物车
-        emit cartUpdated(true, "Item added to cart.");
-        return true;
-    } else {
-        qWarning() << "ShoppingCart: Failed to add item -" << response["message"].toString();
-        emit cartUpdated(false, response["message"].toString());
-        return false;
-    }
+    return mutateCart(request, "Item added to cart.");
 }
 
 bool ShoppingCart::removeItem(const QString& productName, const QString& merchantUsername) {
@@ -76,20 +146,10 @@ bool ShoppingCart::removeItem(const QString& productName, const QString& merchan
     QJsonObject request;
     request["action"] = "removeFromCart";
     QJsonObject payload;
-    payload["productName"] = productName;
-    payload["merchantUsername"] = merchantUsername;
+    addProductRef(payload, productName, merchantUsername);
     request["payload"] = payload;
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request);
-    if (response["status"].toString() == "success") {
-        loadCartFromServer();
-        emit cartUpdated(true, "Item removed from cart.");
-        return true;
-    } else {
-        qWarning() << "ShoppingCart: Failed to remove item -" << response["message"].toString();
-        emit cartUpdated(false, response["message"].toString());
-        return false;
-    }
+    return mutateCart(request, "Item removed from cart.");
 }
 
 bool ShoppingCart::updateQuantity(const QString& productName, const QString& merchantUsername, int newQuantity) {
@@ -109,21 +169,11 @@ bool ShoppingCart::updateQuantity(const QString& productName, const QString& mer
     QJsonObject request;
     request["action"] = "updateCartQuantity";
     QJsonObject payload;
-    payload["productName"] = productName;
-    payload["merchantUsername"] = merchantUsername;
+    addProductRef(payload, productName, merchantUsername);
     payload["newQuantity"] = newQuantity;
     request["payload"] = payload;
 
-    QJsonObject response = AuthManager::sendRequestAndWait(request);
-    if (response["status"].toString() == "success") {
-        loadCartFromServer();
-        emit cartUpdated(true, "Cart quantity updated.");
-        return true;
-    } else {
-        qWarning() << "ShoppingCart: Failed to update quantity -" << response["message"].toString();
-        emit cartUpdated(false, response["message"].toString());
-        return false;
-    }
+    return mutateCart(request, "Cart quantity updated.");
 }
 
 void ShoppingCart::clearCart() {
@@ -172,6 +222,7 @@ QVariantList ShoppingCart::getCartItemsForOrder() const {
     QVariantList orderItems;
     for (const QVariantMap& cartItem : m_cartItems) {
         QVariantMap orderItem;
+        if (cartItem.contains("productId")) orderItem["productId"] = cartItem.value("productId");
         orderItem["productName"] = cartItem.value("name");
         orderItem["merchantUsername"] = cartItem.value("merchantUsername");
         orderItem["quantity"] = cartItem.value("quantity");
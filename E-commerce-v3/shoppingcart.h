@@ -24,16 +24,27 @@ public:
 
     // 供 OrderManager 使用，获取当前购物车内容以创建订单
     QVariantList getCartItemsForOrder() const;
+    // 用 getCart 的响应替换本地购物车（OrderManager 在同一个 batch 里顺带取回购物车时使用）
+    void applyCartResponse(const QJsonObject& response);
 
 signals:
     void totalPriceChanged();
     void cartUpdated(bool success, const QString& message); // 通用更新信号
 
+private slots:
+    void onUserChanged();
+    void onServerEvent(const QString& event, const QJsonObject& data);
+
 private:
-    void loadCartFromServer(); // 从服务器加载购物车到 m_cartItems
+    void loadCartFromServer(); // 从服务器加载购物车到 m_cartItems，同时订阅购物车推送
+    // 发送一条修改购物车的请求，并在同一个 batch 里取回最新购物车，省掉一次往返
+    bool mutateCart(const QJsonObject& request, const QString& successMessage);
     void syncCartWithServer();
+    // 购物车里已有该商品时带上服务器分配的 productId（商品改名后名称可能已过时）；名称和商家照常发送，供服务器兜底
+    void addProductRef(QJsonObject& payload, const QString& productName, const QString& merchantUsername) const;
 
-    QList<QVariantMap> m_cartItems; // 存储购物车项 {productName, merchantUsername, quantity, price, itemTotalPrice, imagePath, ...}
+    bool m_subscribed = false; // 服务器会推送 cartChanged，修改后不必再取回购物车
+    QList<QVariantMap> m_cartItems; // 存储购物车项 {productId, name, merchantUsername, quantity, price, itemTotalPrice, imagePath, ...}
     // price 是单个商品当前售价，itemTotalPrice = price * quantity
 };
 
@@ -0,0 +1,96 @@
+#ifndef WIREPROTOCOL_H
+#define WIREPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QJsonObject>
+
+// 客户端与服务器共用的传输层定义（server 与 E-commerce-v3 各保留一份相同的拷贝）。
+//
+// 两种分帧方式：
+//   Newline        —— 每条消息是一行紧凑 JSON，以 '\n' 结尾（默认，兼容旧客户端）
+//   LengthPrefixed —— 4 字节大端帧头 + 负载；帧头低 31 位是负载长度，最高位表示负载经过压缩
+// 两种消息编码：
+//   Json —— 紧凑 JSON 文本（默认）
+//   Cbor —— 二进制 CBOR（RFC 8949），只能与 LengthPrefixed 一起使用，因为负载里可能出现 '\n'
+// 压缩（可选，只能与 LengthPrefixed 一起使用）：
+//   Zlib —— qCompress 格式（4 字节大端原始长度 + zlib 流），只压缩超过阈值的帧，逐帧用标志位标明
+// 连接建立后双方默认使用 Newline + Json，客户端通过 "hello" 请求协商切换。
+namespace WireProtocol {
+
+enum class Framing {
+    Newline,
+    LengthPrefixed
+};
+
+enum class Encoding {
+    Json,
+    Cbor
+};
+
+enum class Compression {
+    None,
+    Zlib
+};
+
+constexpr int FrameHeaderSize = 4;
+constexpr quint32 FrameLengthMask = 0x7FFFFFFFu;
+constexpr quint32 FrameCompressedFlag = 0x80000000u;
+constexpr quint32 MaxFrameSize = 64u * 1024u * 1024u; // 防止恶意帧头导致无限缓存
+
+QString framingToString(Framing framing);
+// 无法识别时返回 false，framing 不变
+bool framingFromString(const QString& name, Framing* framing);
+
+QString encodingToString(Encoding encoding);
+bool encodingFromString(const QString& name, Encoding* encoding);
+
+QString compressionToString(Compression compression);
+bool compressionFromString(const QString& name, Compression* compression);
+
+// 按指定分帧方式包装一条消息；compressed 只对 LengthPrefixed 有效
+QByteArray encodeFrame(const QByteArray& payload, Framing framing, bool compressed = false);
+
+// 帧负载的压缩与解压；解压后超过 MaxFrameSize 或数据损坏时返回 false
+QByteArray compressPayload(const QByteArray& payload, int level);
+bool decompressPayload(const QByteArray& payload, QByteArray* out);
+
+// 消息对象 <-> 帧负载
+QByteArray encodeMessage(const QJsonObject& message, Encoding encoding);
+// 与 encodeMessage 相同，但 key 字段的值 encodedValue 已经按同一编码编好（例如缓存的大块数据），直接拼接不再重新编码。
+// message 中不能含有 key；JSON 中该字段排在最前面
+QByteArray encodeMessageWith(const QJsonObject& message, const QString& key, const QByteArray& encodedValue, Encoding encoding);
+bool decodeMessage(const QByteArray& data, Encoding encoding, QJsonObject* message, QString* errorString);
+
+} // namespace WireProtocol
+
+// 增量解析收到的字节流。内部只维护一个读游标，取出的帧直接引用内部缓冲区，
+// 不再为每条消息做 left()/mid() 拷贝；已消费的前缀在下一次 append() 时批量丢弃。
+class FrameReader {
+public:
+    enum Result {
+        NeedMoreData,
+        FrameReady,
+        FrameTooLarge // 帧头声明的长度超过 MaxFrameSize，连接应当关闭
+    };
+
+    void setFraming(WireProtocol::Framing framing) { m_framing = framing; }
+    WireProtocol::Framing framing() const { return m_framing; }
+
+    void append(const QByteArray& data);
+
+    // 取出下一帧。*frame 通过 QByteArray::fromRawData 指向内部缓冲区，
+    // 只在下一次 append() 之前有效；调用方需要在此之前完成解析。
+    // compressed 非空时返回该帧是否带压缩标志（Newline 分帧总是 false）。
+    Result next(QByteArray* frame, bool* compressed = nullptr);
+
+    qsizetype bufferedBytes() const { return m_buffer.size() - m_readPos; }
+
+private:
+    QByteArray m_buffer;
+    qsizetype m_readPos = 0; // 下一帧的起始位置
+    qsizetype m_scanPos = 0; // Newline 模式下已确认不含 '\n' 的位置，避免重复扫描
+    WireProtocol::Framing m_framing = WireProtocol::Framing::Newline;
+};
+
+#endif // WIREPROTOCOL_H
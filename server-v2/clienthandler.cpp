@@ -6,6 +6,15 @@
 #include <QDir>
 #include <QFile>
 #include <QTextStream>
+#include "outputqueue.h"
+#include <QLoggingCategory>
+
+// 每条请求的原始内容/路由过程，默认关闭；需要时用 QT_LOGGING_RULES="serverv2.request.debug=true" 打开。
+// 关闭时 qCDebug 不会对后面的参数求值，也就不会再序列化 JSON 或打印整块缓冲区。
+Q_LOGGING_CATEGORY(lcRequest, "serverv2.request", QtInfoMsg)
+
+// 暂停读取后多出的数据留在内核里，由 TCP 流控反压到客户端
+static const qint64 SocketReadBufferSize = 1024 * 1024;
 
 
 ClientHandler::ClientHandler(qintptr socketDescriptor, QObject *parent)
@@ -22,6 +31,11 @@ void ClientHandler::process() {
         return;
     }
 
+    m_socket->setReadBufferSize(SocketReadBufferSize);
+    m_output = new OutputQueue(m_socket, this);
+    connect(m_output, &OutputQueue::highWaterReached, this, &ClientHandler::onOutputHighWater);
+    connect(m_output, &OutputQueue::drained, this, &ClientHandler::onOutputDrained);
+
     connect(m_socket, &QTcpSocket::readyRead, this, &ClientHandler::onReadyRead);
     connect(m_socket, &QTcpSocket::disconnected, this, &ClientHandler::onSocketDisconnected);
     connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred), this, &ClientHandler::onSocketError);
@@ -30,11 +44,12 @@ void ClientHandler::process() {
 }
 
 void ClientHandler::onReadyRead() {
-    qDebug() << "Server CH(" << m_socketDescriptor << "): onReadyRead CALLED. Current buffer size:" << m_buffer.size();
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): onReadyRead CALLED. Current buffer size:" << m_buffer.size();
+    if (m_readPaused) return; // 数据留在 socket 里，恢复时再读
     m_buffer.append(m_socket->readAll());
-    qDebug() << "Server CH(" << m_socketDescriptor << "): Buffer after append, size:" << m_buffer.size() << "Content:" << m_buffer.constData(); // 打印原始数据
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): Buffer after append, size:" << m_buffer.size() << "Content:" << m_buffer.constData(); // 打印原始数据
     // 使用换行符作为简单消息边界（客户端 NetworkClient 也应配合发送带换行符的请求）
-    while(m_buffer.contains('\n')) {
+    while(!m_readPaused && m_buffer.contains('\n')) { // 处理过程中可能触发高水位，剩下的消息留到恢复后
         int newlinePos = m_buffer.indexOf('\n');
         QByteArray jsonData = m_buffer.left(newlinePos);
         m_buffer.remove(0, newlinePos + 1); // 移除已处理的消息和换行符
@@ -45,7 +60,7 @@ void ClientHandler::onReadyRead() {
         QJsonDocument doc = QJsonDocument::fromJson(jsonData, &parseError);
 
         if (parseError.error == QJsonParseError::NoError && doc.isObject()) {
-            qDebug() << "Server RX (RawFileOp):" << doc.toJson(QJsonDocument::Compact);
+            qCDebug(lcRequest) << "Server RX (RawFileOp):" << doc.toJson(QJsonDocument::Compact);
             processMessage(doc.object());
         } else {
             qWarning() << "Server RX (RawFileOp): JSON Parse Error -" << parseError.errorString() << "Data:" << jsonData;
@@ -57,7 +72,7 @@ void ClientHandler::onReadyRead() {
             sendResponse(errResponse);
         }
     }
-    qDebug() << "Server CH(" << m_socketDescriptor << "): onReadyRead FINISHED. Remaining buffer size:" << m_buffer.size();
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): onReadyRead FINISHED. Remaining buffer size:" << m_buffer.size();
 }
 
 
@@ -77,41 +92,47 @@ void ClientHandler::sendResponse(const QJsonObject& response) {
     if (m_socket && m_socket->isOpen() && m_socket->isWritable()) {
         // 将JSON对象转换为QByteArray
         QByteArray data = QJsonDocument(response).toJson(QJsonDocument::Compact) + "\n"; // 使用 Compact 格式减少传输大小
-        qint64 bytesWritten = m_socket->write(data);
-        if (bytesWritten == -1) {
-            qWarning() << "Server TX (AbsPath): Failed to write data to socket:" << m_socket->errorString();
-        } else if (bytesWritten < data.size()) {
-            qWarning() << "Server TX (AbsPath): Not all data written to socket. Wrote" << bytesWritten << "of" << data.size();
-            // 这里可能需要处理未写完的数据，但对于简单场景，先忽略
-        } else {
-            qDebug() << "Server TX (AbsPath):" << data;
-        }
-        m_socket->flush(); // 确保数据被发送
+        // 交给发送队列：同一轮事件循环内的响应合并写出，未写完的部分在 bytesWritten 时继续
+        m_output->enqueue(data);
+        qCDebug(lcRequest) << "Server TX (AbsPath):" << data.size() << "bytes queued, pending" << m_output->pendingBytes();
     } else {
         qWarning() << "ClientHandler (AbsPath): Cannot send response, socket not valid, open, or writable.";
     }
 }
 
+void ClientHandler::onOutputHighWater() {
+    m_readPaused = true;
+    qInfo() << "ClientHandler (" << m_socketDescriptor << ") Output backlog" << m_output->pendingBytes()
+            << "bytes above high-water mark, pausing reads.";
+}
+
+void ClientHandler::onOutputDrained() {
+    m_readPaused = false;
+    qInfo() << "ClientHandler (" << m_socketDescriptor << ") Output backlog drained, resuming reads.";
+    // 暂停期间到达的数据不会再触发 readyRead，这里主动补一次
+    QMetaObject::invokeMethod(this, &ClientHandler::onReadyRead, Qt::QueuedConnection);
+}
+
 void ClientHandler::processMessage(const QJsonObject& request) {
-    qDebug() << "Server CH(" << m_socketDescriptor << "): processMessage CALLED with request:" << request;
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): processMessage CALLED with request:" << request;
     QString action = request["action"].toString();
     QJsonObject payload = request["payload"].toObject();
     QJsonObject responseDataSection; // 用于存放 handleXXX 返回的、将放入最终响应 "data" 字段的内容
     QString status = "success";
     QString message = "";
 
-    qDebug() << "Server CH(" << m_socketDescriptor << "): Action:" << action << "Payload:" << payload;
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): Action:" << action << "Payload:" << payload;
 
     // 使用 try-catch 块来捕获可能的异常，这在文件操作中很重要
     try {
         if (action == "readFile") {
-            qDebug() << "Server CH(" << m_socketDescriptor << "): Routing to handleReadFile.";
+            qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): Routing to handleReadFile.";
             responseDataSection = handleReadFile(payload);
         } else if (action == "writeFile") {
-            qDebug() << "Server CH(" << m_socketDescriptor << "): Routing to handleWriteFile.";
+            qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): Routing to handleWriteFile.";
             responseDataSection = handleWriteFile(payload);
         } else if (action == "fileExists") {
-            qDebug() << "Server CH(" << m_socketDescriptor << "): Routing to handleFileExists.";
+            qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): Routing to handleFileExists.";
             responseDataSection = handleFileExists(payload);
         } else {
             qWarning() << "Server CH(" << m_socketDescriptor << "): Unknown file action:" << action;
@@ -152,9 +173,9 @@ void ClientHandler::processMessage(const QJsonObject& request) {
     } else {
         finalResponse["message"] = message;
     }
-    qDebug() << "Server CH(" << m_socketDescriptor << "): Sending final response:" << finalResponse;
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): Sending final response:" << finalResponse;
     sendResponse(finalResponse);
-    qDebug() << "Server CH(" << m_socketDescriptor << "): processMessage FINISHED.";
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): processMessage FINISHED.";
 }
 
 // --- 文件操作处理方法实现 ---
@@ -163,7 +184,7 @@ QJsonObject ClientHandler::handleReadFile(const QJsonObject& payload) {
     QString absoluteFilePath = payload["filePath"].toString();
     QJsonObject responseData; // 只包含数据或错误信息
 
-    qDebug() << "Server CH(" << m_socketDescriptor << "): handleReadFile CALLED with filePath:" << absoluteFilePath;
+    qCDebug(lcRequest) << "Server CH(" << m_socketDescriptor << "): handleReadFile CALLED with filePath:" << absoluteFilePath;
 
     if (absoluteFilePath.isEmpty()) {
         responseData["status"] = "error";
@@ -5,6 +5,7 @@
 #include <QTcpSocket>
 #include <QJsonObject>
 
+class OutputQueue;
 
 class ClientHandler : public QObject {
     Q_OBJECT
@@ -23,9 +24,13 @@ private slots:
     void onReadyRead();
     void onSocketDisconnected();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onOutputHighWater();
+    void onOutputDrained();
 
 private:
     QTcpSocket *m_socket = nullptr;
+    OutputQueue *m_output = nullptr; // 合并写出的发送队列，积压过多时暂停读取
+    bool m_readPaused = false;
     qintptr m_socketDescriptor;
     QByteArray m_buffer;
 
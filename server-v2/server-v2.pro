@@ -8,10 +8,12 @@ QT += quick \
 
 HEADERS += server.h \
     clienthandler.h \
+    outputqueue.h \
 
 SOURCES += \
         clienthandler.cpp \
         main.cpp \
+        outputqueue.cpp \
         server.cpp \
 
 RESOURCES += qml.qrc
@@ -0,0 +1,95 @@
+#ifndef ACTIONREGISTRY_H
+#define ACTIONREGISTRY_H
+
+#include <QString>
+
+// 请求 action 的编号：名字的 32 位 FNV-1a 哈希，编译期算好。
+// 分发时只对收到的 action 字符串哈希一次，之后全部按整数查表/比较。
+namespace ActionId {
+
+constexpr quint32 hash(const char* name) {
+    quint32 h = 2166136261u;
+    for (; *name; ++name) {
+        h ^= quint8(*name);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// action 名字都是 ASCII；含其他字符的一律返回 Invalid，不会命中任何 action
+constexpr quint32 Invalid = 0;
+inline quint32 hash(const QString& name) {
+    quint32 h = 2166136261u;
+    for (QChar c : name) {
+        if (c.unicode() > 0x7F) return Invalid;
+        h ^= quint8(c.unicode());
+        h *= 16777619u;
+    }
+    return h;
+}
+
+constexpr quint32 Hello = hash("hello");
+constexpr quint32 ServerStats = hash("serverStats");
+constexpr quint32 Batch = hash("batch");
+constexpr quint32 Login = hash("login");
+constexpr quint32 Register = hash("register");
+constexpr quint32 ChangePassword = hash("changePassword");
+constexpr quint32 Recharge = hash("recharge");
+constexpr quint32 GetBalance = hash("getBalance");
+constexpr quint32 GetProducts = hash("getProducts");
+constexpr quint32 SearchProducts = hash("searchProducts");
+constexpr quint32 AddProduct = hash("addProduct");
+constexpr quint32 UpdateProduct = hash("updateProduct");
+constexpr quint32 SetCategoryDiscount = hash("setCategoryDiscount");
+constexpr quint32 GetCart = hash("getCart");
+constexpr quint32 AddToCart = hash("addToCart");
+constexpr quint32 RemoveFromCart = hash("removeFromCart");
+constexpr quint32 UpdateCartQuantity = hash("updateCartQuantity");
+constexpr quint32 PrepareOrder = hash("prepareOrder");
+constexpr quint32 PayOrder = hash("payOrder");
+constexpr quint32 GetOrders = hash("getOrders");
+constexpr quint32 Subscribe = hash("subscribe");
+constexpr quint32 Unsubscribe = hash("unsubscribe");
+constexpr quint32 ShardAuth = hash("shardAuth");
+constexpr quint32 ShardCredit = hash("shardCredit");
+constexpr quint32 CatalogSnapshot = hash("catalogSnapshot");
+constexpr quint32 CatalogVersion = hash("catalogVersion");
+constexpr quint32 Resume = hash("resume");
+constexpr quint32 Logout = hash("logout");
+
+constexpr quint32 All[] = {
+    Hello, ServerStats, Batch, Login, Register, ChangePassword, Recharge, GetBalance,
+    GetProducts, SearchProducts, AddProduct, UpdateProduct, SetCategoryDiscount,
+    GetCart, AddToCart, RemoveFromCart, UpdateCartQuantity, PrepareOrder, PayOrder, GetOrders,
+    Subscribe, Unsubscribe, ShardAuth, ShardCredit, CatalogSnapshot, CatalogVersion, Resume, Logout
+};
+
+constexpr bool allDistinct() {
+    constexpr int n = sizeof(All) / sizeof(All[0]);
+    for (int i = 0; i < n; ++i) {
+        if (All[i] == Invalid) return false;
+        for (int j = i + 1; j < n; ++j) {
+            if (All[i] == All[j]) return false;
+        }
+    }
+    return true;
+}
+static_assert(allDistinct(), "action name hash collision, rename the action");
+
+} // namespace ActionId
+
+// 执行一个 action 之前要求的身份，由分发层统一检查
+enum class ActionRole {
+    Anyone,   // 不需要登录
+    LoggedIn, // 任意已登录用户
+    Merchant  // 已登录的商家
+};
+
+// 在请求线程池中的优先级（数值直接传给 QThreadPool::start）
+enum class ActionPriority {
+    Low = 0,    // 整个目录的查询、统计
+    Normal = 1,
+    High = 2    // 登录、下单、支付等用户正在等待的操作
+};
+
+#endif // ACTIONREGISTRY_H
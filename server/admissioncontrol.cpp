@@ -0,0 +1,98 @@
+#include "admissioncontrol.h"
+#include "servermetrics.h"
+
+TokenBucket::TokenBucket(double ratePerSecond, double burst)
+    : m_rate(ratePerSecond), m_burst(qMax(1.0, burst)), m_tokens(qMax(1.0, burst)) {
+}
+
+void TokenBucket::refill(qint64 nowMs) {
+    if (nowMs > m_lastRefillMs) {
+        m_tokens = qMin(m_burst, m_tokens + (nowMs - m_lastRefillMs) * m_rate / 1000.0);
+        m_lastRefillMs = nowMs;
+    }
+}
+
+bool TokenBucket::tryTake(qint64 nowMs, double cost) {
+    if (isUnlimited()) return true;
+    refill(nowMs);
+    // 单个请求的代价超过桶容量时按桶容量算，否则大 batch 永远无法执行
+    cost = qMin(cost, m_burst);
+    if (m_tokens < cost) return false;
+    m_tokens -= cost;
+    return true;
+}
+
+void TokenBucket::giveBack(double cost) {
+    if (isUnlimited()) return;
+    m_tokens = qMin(m_burst, m_tokens + qMin(cost, m_burst));
+}
+
+bool TokenBucket::isIdle(qint64 nowMs) const {
+    if (isUnlimited()) return true;
+    return m_tokens + (nowMs - m_lastRefillMs) * m_rate / 1000.0 >= m_burst;
+}
+
+AdmissionControl::AdmissionControl(const AdmissionConfig& config) : m_config(config) {
+    m_clock.start();
+}
+
+bool AdmissionControl::takeUserTokens(const QString& username, double cost) {
+    if (username.isEmpty() || m_config.userRate <= 0.0) return true;
+    const qint64 now = nowMs();
+    QMutexLocker locker(&m_userMutex);
+    // 定期清掉已经补满的桶，避免不活跃用户一直占内存
+    if (++m_takesSincePrune >= 4096) {
+        m_takesSincePrune = 0;
+        for (auto it = m_userBuckets.begin(); it != m_userBuckets.end();) {
+            it = it.value().isIdle(now) ? m_userBuckets.erase(it) : std::next(it);
+        }
+    }
+    auto it = m_userBuckets.find(username);
+    if (it == m_userBuckets.end()) {
+        it = m_userBuckets.insert(username, TokenBucket(m_config.userRate, m_config.userBurst));
+    }
+    return it.value().tryTake(now, cost);
+}
+
+void AdmissionControl::giveBackUserTokens(const QString& username, double cost) {
+    if (username.isEmpty() || m_config.userRate <= 0.0) return;
+    QMutexLocker locker(&m_userMutex);
+    auto it = m_userBuckets.find(username);
+    if (it != m_userBuckets.end()) it.value().giveBack(cost);
+}
+
+bool AdmissionControl::tryAcquireSlot() {
+    if (m_config.maxInFlight <= 0) {
+        m_inFlight.fetchAndAddRelaxed(1);
+        return true;
+    }
+    int current = m_inFlight.loadRelaxed();
+    do {
+        if (current >= m_config.maxInFlight) return false;
+    } while (!m_inFlight.testAndSetOrdered(current, current + 1, current));
+    return true;
+}
+
+void AdmissionControl::releaseSlot() {
+    m_inFlight.fetchAndAddRelaxed(-1);
+}
+
+QString AdmissionControl::reject(Verdict verdict) {
+    switch (verdict) {
+    case ConnectionRateExceeded:
+        ServerMetrics::instance().increment("rejected.connectionRate");
+        return "Too many requests on this connection, retry later.";
+    case UserRateExceeded:
+        ServerMetrics::instance().increment("rejected.userRate");
+        return "Too many requests for this user, retry later.";
+    case InFlightLimitReached:
+        ServerMetrics::instance().increment("rejected.inFlight");
+        return "Server is busy, retry later.";
+    case QueueFull:
+        ServerMetrics::instance().increment("rejected.queueFull");
+        return "Too many pending requests on this connection, retry later.";
+    case Admitted:
+    default:
+        return QString();
+    }
+}
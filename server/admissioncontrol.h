@@ -0,0 +1,79 @@
+#ifndef ADMISSIONCONTROL_H
+#define ADMISSIONCONTROL_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+// 令牌桶：每秒补充 rate 个令牌，最多攒 burst 个。rate <= 0 表示不限速。
+// 本身不加锁，由调用方保证只在一个线程里使用（或自己加锁）。
+class TokenBucket {
+public:
+    TokenBucket(double ratePerSecond = 0.0, double burst = 0.0);
+
+    bool tryTake(qint64 nowMs, double cost = 1.0);
+    void giveBack(double cost); // 撤销一次 tryTake（请求最终没有被接收）
+    bool isIdle(qint64 nowMs) const; // 已经补满，删掉也不影响限流结果
+    bool isUnlimited() const { return m_rate <= 0.0; }
+
+private:
+    void refill(qint64 nowMs);
+
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    qint64 m_lastRefillMs = 0;
+};
+
+// 限速默认关闭（与加入准入控制之前的行为一致），用 --conn-rate / --user-rate 打开
+struct AdmissionConfig {
+    double connectionRate = 0.0;    // 每个连接每秒请求数，0 表示不限
+    double connectionBurst = 100.0;
+    double userRate = 0.0;          // 每个登录用户每秒请求数（同一用户的多个连接合计），0 表示不限
+    double userBurst = 40.0;
+    int maxInFlight = 2048;         // 全局已接收、尚未回复的请求数上限
+    int maxQueuedPerConnection = 64; // 每个连接排队等待串行执行的请求数上限
+};
+
+// 全局准入控制（线程安全）。在 ClientHandler 收到请求、交给线程池之前检查，
+// 超限的请求直接回复 "overloaded"，不进入任何队列，保证已接收请求的延迟有上界。
+class AdmissionControl {
+public:
+    enum Verdict {
+        Admitted,
+        ConnectionRateExceeded,
+        UserRateExceeded,
+        InFlightLimitReached,
+        QueueFull
+    };
+
+    explicit AdmissionControl(const AdmissionConfig& config = AdmissionConfig());
+
+    const AdmissionConfig& config() const { return m_config; }
+    qint64 nowMs() const { return m_clock.elapsed(); }
+
+    TokenBucket makeConnectionBucket() const { return TokenBucket(m_config.connectionRate, m_config.connectionBurst); }
+    bool takeUserTokens(const QString& username, double cost);
+    void giveBackUserTokens(const QString& username, double cost);
+
+    // 全局在途请求计数；tryAcquire 成功后必须在回复时 release
+    bool tryAcquireSlot();
+    void releaseSlot();
+    int inFlight() const { return m_inFlight.loadRelaxed(); }
+
+    // 记录一次拒绝（计入 ServerMetrics），返回给客户端的说明
+    static QString reject(Verdict verdict);
+
+private:
+    AdmissionConfig m_config;
+    QElapsedTimer m_clock;
+    QAtomicInt m_inFlight;
+
+    QMutex m_userMutex;
+    QHash<QString, TokenBucket> m_userBuckets;
+    int m_takesSincePrune = 0;
+};
+
+#endif // ADMISSIONCONTROL_H
@@ -0,0 +1,227 @@
+#include "asynclogger.h"
+#include "servermetrics.h"
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QLoggingCategory>
+#include <QObject>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cstdio>
+
+namespace {
+
+// 单个线程的日志环：只有所属线程写入（tail），只有写出线程读取（head）
+struct LogRing {
+    static constexpr quint32 Capacity = 4096; // 2 的幂
+    static constexpr quint32 Mask = Capacity - 1;
+
+    QString lines[Capacity];
+    std::atomic<quint32> head{0};
+    std::atomic<quint32> tail{0};
+    std::atomic<bool> orphaned{false}; // 所属线程已退出，写完即可回收
+
+    bool push(QString&& line) {
+        const quint32 t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        lines[t & Mask] = std::move(line);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 把当前已提交的行追加到 out，返回行数
+    int drainTo(QByteArray* out) {
+        quint32 h = head.load(std::memory_order_relaxed);
+        const quint32 t = tail.load(std::memory_order_acquire);
+        const int count = int(t - h);
+        for (; h != t; ++h) {
+            QString& line = lines[h & Mask];
+            out->append(line.toUtf8());
+            out->append('\n');
+            line = QString(); // 在写出线程释放内存
+        }
+        head.store(t, std::memory_order_release);
+        return count;
+    }
+
+    bool isEmpty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+class LogWriter : public QThread {
+public:
+    explicit LogWriter(const QString& filePath) : m_filePath(filePath) {
+        setObjectName("log-writer");
+    }
+
+    std::shared_ptr<LogRing> registerRing() {
+        auto ring = std::make_shared<LogRing>();
+        QMutexLocker locker(&m_mutex);
+        m_rings.push_back(ring);
+        return ring;
+    }
+
+    void wake() {
+        QMutexLocker locker(&m_mutex);
+        m_wakeup.wakeOne();
+    }
+
+    void stop() {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stopping = true;
+            m_wakeup.wakeOne();
+        }
+        wait();
+    }
+
+    std::atomic<qint64> dropped{0};
+
+protected:
+    void run() override {
+        QFile file;
+        bool opened = false;
+        if (!m_filePath.isEmpty()) {
+            file.setFileName(m_filePath);
+            opened = file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+            if (!opened) {
+                fprintf(stderr, "AsyncLogger: cannot open %s, logging to stderr\n", qPrintable(m_filePath));
+            }
+        }
+        if (!opened) opened = file.open(stderr, QIODevice::WriteOnly);
+
+        qint64 reportedDropped = 0;
+        bool stopping = false;
+        while (!stopping) {
+            std::vector<std::shared_ptr<LogRing>> rings;
+            {
+                QMutexLocker locker(&m_mutex);
+                if (!m_stopping) m_wakeup.wait(&m_mutex, FlushIntervalMs);
+                stopping = m_stopping;
+                rings = m_rings;
+            }
+
+            QByteArray out;
+            for (const auto& ring : rings) ring->drainTo(&out);
+
+            const qint64 droppedNow = dropped.load(std::memory_order_relaxed);
+            if (droppedNow != reportedDropped) {
+                out.append(QString("AsyncLogger: dropped %1 messages (ring buffer full)\n").arg(droppedNow - reportedDropped).toUtf8());
+                ServerMetrics::instance().setGauge("logDropped", droppedNow);
+                reportedDropped = droppedNow;
+            }
+            if (!out.isEmpty() && opened) {
+                file.write(out);
+                file.flush();
+            }
+
+            // 回收已退出线程的环
+            QMutexLocker locker(&m_mutex);
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::shared_ptr<LogRing>& r) {
+                              return r->orphaned.load() && r->isEmpty();
+                          }), m_rings.end());
+        }
+    }
+
+private:
+    static constexpr unsigned long FlushIntervalMs = 50;
+
+    QString m_filePath;
+    QMutex m_mutex; // 只保护 m_rings 的增删和唤醒；普通日志只在线程第一次写日志时获取
+    QWaitCondition m_wakeup;
+    bool m_stopping = false;
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+};
+
+std::atomic<LogWriter*> s_writer{nullptr};
+QtMessageHandler s_previousHandler = nullptr;
+
+// 线程退出时把自己的环标记为可回收
+struct ThreadRing {
+    std::shared_ptr<LogRing> ring;
+    LogWriter* owner = nullptr;
+    ~ThreadRing() {
+        if (ring) ring->orphaned.store(true);
+    }
+};
+thread_local ThreadRing t_ring;
+
+void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
+    LogWriter* writer = s_writer.load(std::memory_order_acquire);
+    QString line = qFormatLogMessage(type, context, message);
+
+    if (!writer || type == QtFatalMsg) {
+        // 致命错误马上要 abort，直接同步写出
+        fprintf(stderr, "%s\n", line.toLocal8Bit().constData());
+        fflush(stderr);
+        return;
+    }
+
+    if (!t_ring.ring || t_ring.owner != writer) {
+        t_ring.ring = writer->registerRing();
+        t_ring.owner = writer;
+    }
+    if (!t_ring.ring->push(std::move(line))) {
+        writer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (type == QtWarningMsg || type == QtCriticalMsg) writer->wake(); // 警告及以上尽快落盘
+}
+
+} // namespace
+
+void AsyncLogger::install(const QString& filePath) {
+    if (s_writer.load()) return;
+    qSetMessagePattern("%{time yyyy-MM-dd hh:mm:ss.zzz} %{if-debug}D%{endif}%{if-info}I%{endif}%{if-warning}W%{endif}"
+                       "%{if-critical}C%{endif}%{if-fatal}F%{endif} [%{category}] %{message}");
+    LogWriter* writer = new LogWriter(filePath);
+    writer->start(QThread::LowPriority);
+    s_writer.store(writer, std::memory_order_release);
+    s_previousHandler = qInstallMessageHandler(messageHandler);
+}
+
+void AsyncLogger::shutdown() {
+    LogWriter* writer = s_writer.exchange(nullptr);
+    if (!writer) return;
+    qInstallMessageHandler(s_previousHandler);
+    writer->stop(); // 停止前会把所有环写完
+    delete writer;
+}
+
+qint64 AsyncLogger::droppedCount() {
+    LogWriter* writer = s_writer.load(std::memory_order_acquire);
+    return writer ? writer->dropped.load() : 0;
+}
+
+void AsyncLogger::setRules(const QString& rules) {
+    QString normalized = rules;
+    normalized.replace(';', '\n');
+    QLoggingCategory::setFilterRules(normalized);
+    qInfo() << "AsyncLogger: Applied log rules:" << normalized.split('\n', Qt::SkipEmptyParts);
+}
+
+void AsyncLogger::watchRulesFile(const QString& path, QObject* context) {
+    auto apply = [path]() {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            qWarning() << "AsyncLogger: Cannot read log rules file" << path;
+            return;
+        }
+        setRules(QString::fromUtf8(file.readAll()));
+    };
+    apply();
+
+    QFileSystemWatcher* watcher = new QFileSystemWatcher(context);
+    watcher->addPath(path);
+    QObject::connect(watcher, &QFileSystemWatcher::fileChanged, context, [watcher, path, apply]() {
+        // 很多编辑器保存时会替换文件，监视会随之失效，需要重新加入
+        if (!watcher->files().contains(path) && QFileInfo::exists(path)) watcher->addPath(path);
+        apply();
+    });
+}
@@ -0,0 +1,25 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QString>
+
+class QObject;
+
+// 异步日志：接管 Qt 的消息处理函数，调用线程只负责格式化一行文本并放进
+// 本线程自己的环形缓冲区（单生产者/单消费者，无锁），由后台线程统一写出。
+// 缓冲区满时丢弃新消息并计数，不会阻塞请求线程。
+class AsyncLogger {
+public:
+    // filePath 为空时写到 stderr
+    static void install(const QString& filePath = QString());
+    // 写出剩余日志，停止后台线程，恢复默认的消息处理函数
+    static void shutdown();
+    static qint64 droppedCount();
+
+    // 立即应用一组 QLoggingCategory 过滤规则（多条规则用 ';' 或换行分隔）
+    static void setRules(const QString& rules);
+    // 从文件读取规则，并在文件变化时重新应用；context 销毁时停止监视
+    static void watchRulesFile(const QString& path, QObject* context);
+};
+
+#endif // ASYNCLOGGER_H
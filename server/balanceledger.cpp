@@ -0,0 +1,224 @@
+#include "balanceledger.h"
+#include "filemanager.h"
+#include "servermetrics.h"
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QDebug>
+
+static QString ledgerFile(const char* name) {
+    return FileManager::dataDirectory() + QLatin1String(name);
+}
+
+BalanceLedger::~BalanceLedger() {
+    qDeleteAll(m_accounts);
+}
+
+void BalanceLedger::load(const QHash<QString, qint64>& base) {
+    QHash<QString, qint64> balances = base;
+    quint64 snapshotSeq = 0;
+
+    QFile snapshotFile(ledgerFile("ledger.snapshot"));
+    if (snapshotFile.open(QIODevice::ReadOnly)) {
+        const QJsonObject snapshot = QJsonDocument::fromJson(snapshotFile.readAll()).object();
+        snapshotSeq = quint64(snapshot["seq"].toInteger());
+        const QJsonObject saved = snapshot["balances"].toObject();
+        for (auto it = saved.constBegin(); it != saved.constEnd(); ++it) balances[it.key()] = it.value().toInteger();
+        const QJsonObject keys = snapshot["keys"].toObject();
+        for (auto it = keys.constBegin(); it != keys.constEnd(); ++it) m_appliedKeys.insert(it.key(), it.value().toInteger());
+    }
+
+    // 快照之后的记录按变动额叠加；最后一行可能只写了一半（进程被杀），解析失败的行跳过
+    quint64 lastSeq = snapshotSeq;
+    int replayed = 0;
+    QFile journal(ledgerFile("ledger.journal"));
+    const bool hadJournal = journal.size() > 0;
+    if (journal.open(QIODevice::ReadOnly)) {
+        while (!journal.atEnd()) {
+            const QJsonObject record = QJsonDocument::fromJson(journal.readLine()).object();
+            const quint64 seq = quint64(record["seq"].toInteger());
+            if (seq == 0 || seq <= snapshotSeq) continue;
+            balances[record["user"].toString()] += record["delta"].toInteger();
+            if (record.contains("key")) m_appliedKeys.insert(record["key"].toString(), record["ts"].toInteger());
+            lastSeq = qMax(lastSeq, seq);
+            ++replayed;
+        }
+    }
+
+    for (auto it = balances.constBegin(); it != balances.constEnd(); ++it) {
+        m_accounts.insert(it.key(), new Account(it.value()));
+    }
+    m_nextSeq = lastSeq + 1;
+    qInfo() << "BalanceLedger: Loaded" << m_accounts.size() << "accounts, replayed" << replayed << "journal records.";
+
+    QMutexLocker fileLocker(&m_fileMutex);
+    if (hadJournal) {
+        // 把恢复出的余额固化成快照，日志从头开始（也去掉可能写了一半的最后一行）
+        for (auto it = balances.constBegin(); it != balances.constEnd(); ++it) m_changedSinceSnapshot.insert(it.key());
+        compact();
+    } else {
+        openJournal(QIODevice::Append);
+    }
+}
+
+bool BalanceLedger::openJournal(QIODevice::OpenMode mode) {
+    m_journal.close();
+    m_journal.setFileName(ledgerFile("ledger.journal"));
+    if (!m_journal.open(QIODevice::WriteOnly | mode)) {
+        qWarning() << "BalanceLedger: Cannot open journal" << m_journal.fileName() << m_journal.errorString();
+        return false;
+    }
+    return true;
+}
+
+void BalanceLedger::addAccount(const QString& username, qint64 cents) {
+    QWriteLocker locker(&m_lock);
+    if (!m_accounts.contains(username)) m_accounts.insert(username, new Account(cents));
+}
+
+bool BalanceLedger::contains(const QString& username) const {
+    QReadLocker locker(&m_lock);
+    return m_accounts.contains(username);
+}
+
+BalanceLedger::Account* BalanceLedger::account(const QString& username) const {
+    return m_accounts.value(username, nullptr);
+}
+
+qint64 BalanceLedger::balance(const QString& username) const {
+    QReadLocker locker(&m_lock);
+    const Account* a = account(username);
+    return a ? a->cents.load() : 0;
+}
+
+bool BalanceLedger::debit(const QString& username, qint64 cents, qint64* newBalance) {
+    QReadLocker locker(&m_lock);
+    Account* a = account(username);
+    if (!a || cents <= 0) return false;
+    qint64 current = a->cents.load();
+    do {
+        if (current < cents) return false; // 余额不足
+    } while (!a->cents.compare_exchange_weak(current, current - cents));
+    append(username, -cents);
+    if (newBalance) *newBalance = current - cents;
+    return true;
+}
+
+bool BalanceLedger::credit(const QString& username, qint64 cents, qint64* newBalance) {
+    QReadLocker locker(&m_lock);
+    Account* a = account(username);
+    if (!a || cents <= 0) return false;
+    const qint64 updated = a->cents.fetch_add(cents) + cents;
+    append(username, cents);
+    if (newBalance) *newBalance = updated;
+    return true;
+}
+
+bool BalanceLedger::creditOnce(const QString& key, const QString& username, qint64 cents, bool* duplicate) {
+    QReadLocker locker(&m_lock);
+    Account* a = account(username);
+    if (!a || cents <= 0 || key.isEmpty()) return false;
+    // 查键、入账、记录在同一段 m_queueMutex 内完成：同一个键并发到达时只有一个生效，
+    // 压缩（持 m_lock 写锁）看到的余额和键也总是一致的
+    QMutexLocker queueLocker(&m_queueMutex);
+    *duplicate = m_appliedKeys.contains(key);
+    if (*duplicate) return true;
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    a->cents.fetch_add(cents);
+    m_appliedKeys.insert(key, now);
+    m_queue.append(Record{m_nextSeq++, username, cents, key, now});
+    return true;
+}
+
+void BalanceLedger::append(const QString& username, qint64 delta) {
+    QMutexLocker locker(&m_queueMutex);
+    m_queue.append(Record{m_nextSeq++, username, delta});
+}
+
+QSet<QString> BalanceLedger::flush(bool force) {
+    QMutexLocker fileLocker(&m_fileMutex);
+    QList<Record> records;
+    {
+        QMutexLocker locker(&m_queueMutex);
+        records.swap(m_queue);
+    }
+    if (!records.isEmpty()) {
+        QByteArray data;
+        for (const Record& r : std::as_const(records)) {
+            QJsonObject obj;
+            obj["seq"] = qint64(r.seq);
+            obj["user"] = r.username;
+            obj["delta"] = r.delta;
+            if (!r.key.isEmpty()) {
+                obj["key"] = r.key;
+                obj["ts"] = r.ts;
+            }
+            data += QJsonDocument(obj).toJson(QJsonDocument::Compact);
+            data += '\n';
+            m_changedSinceSnapshot.insert(r.username);
+        }
+        if (!m_journal.isOpen() || m_journal.write(data) != data.size() || !m_journal.flush()) {
+            // 写失败时内存中的余额仍然正确，立即压缩成快照，不丢这些变动
+            qWarning() << "BalanceLedger: Journal write failed," << records.size() << "records, compacting instead.";
+            {
+                QMutexLocker locker(&m_queueMutex);
+                records.append(m_queue);
+                m_queue.swap(records);
+            }
+            return compact();
+        }
+        ServerMetrics::instance().increment("ledgerJournalRecords", records.size());
+    }
+    if (force || m_journal.size() >= CompactBytes) return compact();
+    return QSet<QString>();
+}
+
+QSet<QString> BalanceLedger::compact() {
+    QJsonObject balances;
+    QJsonObject keys;
+    QList<Record> included; // 已包含在这次快照里、不必再写日志的记录
+    quint64 seq = 0;
+    {
+        // 写锁下没有进行中的变动：余额与序号一致，队列中的记录都已包含在余额里
+        QWriteLocker locker(&m_lock);
+        QMutexLocker queueLocker(&m_queueMutex);
+        included.swap(m_queue);
+        seq = m_nextSeq - 1;
+        for (auto it = m_accounts.constBegin(); it != m_accounts.constEnd(); ++it) {
+            balances.insert(it.key(), it.value()->cents.load());
+        }
+        const qint64 expired = QDateTime::currentMSecsSinceEpoch() - KeyRetentionDays * 24 * 3600 * 1000;
+        for (auto it = m_appliedKeys.begin(); it != m_appliedKeys.end();) {
+            if (it.value() < expired) {
+                it = m_appliedKeys.erase(it);
+            } else {
+                keys.insert(it.key(), it.value());
+                ++it;
+            }
+        }
+    }
+
+    QJsonObject snapshot;
+    snapshot["seq"] = qint64(seq);
+    snapshot["balances"] = balances;
+    snapshot["keys"] = keys;
+    QSaveFile file(ledgerFile("ledger.snapshot"));
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(snapshot).toJson(QJsonDocument::Compact)) < 0
+        || !file.commit()) {
+        qWarning() << "BalanceLedger: Cannot write snapshot" << file.fileName() << file.errorString();
+        // 放回队列最前面，下次 flush 照常写日志
+        QMutexLocker locker(&m_queueMutex);
+        included.append(m_queue);
+        m_queue.swap(included);
+        openJournal(QIODevice::Append);
+        return QSet<QString>();
+    }
+    for (const Record& r : std::as_const(included)) m_changedSinceSnapshot.insert(r.username);
+    // 快照已落盘才清空日志；两步之间崩溃时，重放会按序号跳过已包含的记录
+    openJournal(QIODevice::Truncate);
+    ServerMetrics::instance().increment("ledgerCompactions");
+    QSet<QString> changed;
+    changed.swap(m_changedSinceSnapshot);
+    return changed;
+}
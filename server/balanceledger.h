@@ -0,0 +1,78 @@
+#ifndef BALANCELEDGER_H
+#define BALANCELEDGER_H
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QFile>
+#include <atomic>
+
+// 用户余额账本：余额以整数"分"保存在内存中，扣款、入账用 CAS 原子完成，不需要全局锁。
+// 每次变动追加一条记录（序号、用户、变动额）到 ledger.journal；记录先进内存队列，由后台 flush() 批量写入。
+// 日志超过 CompactBytes 时把所有余额写成 ledger.snapshot 并清空日志。
+// 启动时：余额 = 快照（没有快照时用 users.json 的 balance）+ 快照序号之后的日志记录。
+// 其他分片送来的入账带幂等键，键随日志记录和快照一起保存 KeyRetentionDays 天，期间重发的同一笔只入账一次。
+// 除 load() 外所有方法线程安全。
+class BalanceLedger {
+public:
+    BalanceLedger() = default;
+    ~BalanceLedger();
+
+    static qint64 toCents(double amount) { return qRound64(amount * 100.0); }
+    static double fromCents(qint64 cents) { return double(cents) / 100.0; }
+
+    // 启动时调用一次；base 为 users.json 中的余额（分）
+    void load(const QHash<QString, qint64>& base);
+    void addAccount(const QString& username, qint64 cents = 0); // 新注册的用户
+    bool contains(const QString& username) const;
+    qint64 balance(const QString& username) const; // 账户不存在时为 0
+
+    // 账户不存在或余额不足时返回 false；成功时 *newBalance 为变动后的余额
+    bool debit(const QString& username, qint64 cents, qint64* newBalance = nullptr);
+    bool credit(const QString& username, qint64 cents, qint64* newBalance = nullptr);
+    // 按幂等键入账：这个键已经入过账时不再变动余额，*duplicate 为真，仍返回 true
+    bool creditOnce(const QString& key, const QString& username, qint64 cents, bool* duplicate);
+
+    // 把排队的记录追加到日志，需要时压缩。返回压缩时余额有变化的用户（调用方据此更新 users.json），
+    // 没有压缩时为空。force 为真时无论日志多大都压缩（关闭时调用）
+    QSet<QString> flush(bool force = false);
+
+private:
+    static constexpr qint64 CompactBytes = 1024 * 1024;
+    static constexpr qint64 KeyRetentionDays = 30;
+
+    struct Account {
+        std::atomic<qint64> cents;
+        explicit Account(qint64 c) : cents(c) {}
+    };
+    struct Record {
+        quint64 seq;
+        QString username;
+        qint64 delta;
+        QString key;   // creditOnce 的幂等键，普通变动为空
+        qint64 ts = 0; // 有键时的入账时间（毫秒），过了保留期的键在压缩时丢弃
+    };
+
+    Account* account(const QString& username) const; // 持有 m_lock（读）
+    void append(const QString& username, qint64 delta); // 持有 m_lock（读）
+    QSet<QString> compact();                             // 持有 m_fileMutex
+    bool openJournal(QIODevice::OpenMode mode);          // 持有 m_fileMutex
+
+    // m_lock 保护账户表；变动操作持读锁，压缩时持写锁截取一致的余额和序号
+    mutable QReadWriteLock m_lock;
+    QHash<QString, Account*> m_accounts; // 只增不删，指针在析构前一直有效
+
+    QMutex m_queueMutex;     // 保护 m_queue、m_nextSeq 和 m_appliedKeys，只在追加记录时短暂持有
+    QList<Record> m_queue;   // 已生效、尚未写入日志的记录，按序号排列
+    quint64 m_nextSeq = 1;
+    QHash<QString, qint64> m_appliedKeys; // 已入账的幂等键 -> 入账时间
+
+    QMutex m_fileMutex;      // 保证写日志和压缩不会交错
+    QFile m_journal;
+    QSet<QString> m_changedSinceSnapshot;
+};
+
+#endif // BALANCELEDGER_H
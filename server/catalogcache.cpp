@@ -0,0 +1,47 @@
+#include "catalogcache.h"
+#include "servermetrics.h"
+
+QString CatalogCache::etag(const QString& epoch, quint64 version, const QString& page) {
+    return epoch + '.' + QString::number(version) + '.' + page;
+}
+
+bool CatalogCache::find(const QString& etag, QJsonObject* data) {
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.constFind(etag);
+    if (it == m_entries.constEnd()) {
+        ServerMetrics::instance().increment("catalogCacheMisses");
+        return false;
+    }
+    *data = it->data;
+    ServerMetrics::instance().increment("catalogCacheHits");
+    return true;
+}
+
+void CatalogCache::insert(const QString& epoch, quint64 version, const QString& etag, const QJsonObject& data) {
+    QMutexLocker locker(&m_mutex);
+    if (epoch != m_epoch || version != m_version || m_entries.size() >= MaxEntries) {
+        m_entries.clear();
+        m_epoch = epoch;
+        m_version = version;
+    }
+    m_entries.insert(etag, Entry{data, QByteArray(), QByteArray()});
+}
+
+QByteArray CatalogCache::encoded(const QJsonObject& data, WireProtocol::Encoding encoding) {
+    const QString etag = data["etag"].toString();
+    if (etag.isEmpty()) return QByteArray();
+    const bool cbor = encoding == WireProtocol::Encoding::Cbor;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_entries.constFind(etag);
+        if (it == m_entries.constEnd()) return QByteArray(); // 已被更新的版本淘汰，由调用方按普通回复编码
+        const QByteArray& bytes = cbor ? it->cbor : it->json;
+        if (!bytes.isEmpty()) return bytes;
+    }
+    // 编码大块数据时不持锁，其他连接可以同时查缓存；同时编码的两个请求结果相同，谁先写入都可以
+    const QByteArray bytes = WireProtocol::encodeMessage(data, encoding);
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(etag);
+    if (it != m_entries.end()) (cbor ? it->cbor : it->json) = bytes;
+    return bytes;
+}
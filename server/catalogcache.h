@@ -0,0 +1,40 @@
+#ifndef CATALOGCACHE_H
+#define CATALOGCACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QJsonObject>
+#include <QByteArray>
+#include "wireprotocol.h"
+
+// getProducts 回复数据的缓存。目录读远多于写：同一目录版本的同一页只构造一次，每种编码只序列化一次，
+// 之后的回复只编码回复头，数据部分直接拼接缓存的字节（WireProtocol::encodeMessageWith）。
+// 缓存项以 etag（"<目录纪元>.<目录版本号>.<页>"）标识；etag 也放在回复数据里，发送时据此找回编码结果。
+// 纪元来自 ServerProductManager::epoch()：副本取主服务器的纪元，主服务器重启后版本号从头计数也不会与旧 etag 重复。
+// 纪元或版本号变化后旧的缓存项全部丢弃。所有方法线程安全。
+class CatalogCache {
+public:
+    static QString etag(const QString& epoch, quint64 version, const QString& page);
+    bool find(const QString& etag, QJsonObject* data);
+    // data 中应已带 etag；epoch、version 与已缓存的不同时先清空
+    void insert(const QString& epoch, quint64 version, const QString& etag, const QJsonObject& data);
+    // data 是本缓存给出的数据时返回它按 encoding 编码的结果（第一次调用时编码并保存），否则返回空
+    QByteArray encoded(const QJsonObject& data, WireProtocol::Encoding encoding);
+
+private:
+    static constexpr int MaxEntries = 256; // 不同 limit 与游标的组合过多时整个清空
+
+    struct Entry {
+        QJsonObject data;
+        QByteArray json;
+        QByteArray cbor;
+    };
+
+    QMutex m_mutex;
+    QString m_epoch;
+    quint64 m_version = 0;
+    QHash<QString, Entry> m_entries;
+};
+
+#endif // CATALOGCACHE_H
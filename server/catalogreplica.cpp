@@ -0,0 +1,216 @@
+#include "catalogreplica.h"
+#include "serverproductmanager.h"
+#include "servermetrics.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QDebug>
+
+static const int ReconnectIntervalMs = 1000;
+static const int PollIntervalMs = 1000;
+
+CatalogReplica::CatalogReplica(ServerProductManager* productManager, const QString& primaryHost, quint16 primaryPort,
+                               QObject* parent)
+    : QObject(parent), m_productManager(productManager), m_host(primaryHost), m_port(primaryPort),
+    m_socket(new QTcpSocket(this)), m_reconnectTimer(new QTimer(this)), m_pollTimer(new QTimer(this)) {
+    m_reconnectTimer->setSingleShot(true);
+    m_reconnectTimer->setInterval(ReconnectIntervalMs);
+    connect(m_reconnectTimer, &QTimer::timeout, this, &CatalogReplica::start);
+    m_pollTimer->setInterval(PollIntervalMs);
+    connect(m_pollTimer, &QTimer::timeout, this, &CatalogReplica::pollVersion);
+    m_pollTimer->start(); // 断线期间也运行，刷新延迟
+    ServerMetrics::instance().setGauge("replicaConnected", 0);
+    connect(m_socket, &QTcpSocket::connected, this, &CatalogReplica::onConnected);
+    connect(m_socket, &QTcpSocket::readyRead, this, &CatalogReplica::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &CatalogReplica::onDisconnected);
+    connect(m_socket, &QTcpSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        if (m_socket->state() == QAbstractSocket::UnconnectedState) onDisconnected();
+    });
+}
+
+void CatalogReplica::start() {
+    m_reader = FrameReader();
+    m_helloDone = false;
+    setSynced(false);
+    m_buffered.clear();
+    m_socket->connectToHost(m_host, m_port);
+}
+
+void CatalogReplica::onConnected() {
+    qInfo() << "CatalogReplica: Connected to primary" << m_host << m_port;
+    ServerMetrics::instance().setGauge("replicaConnected", 1);
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    // hello 之后立刻按新的分帧发送，主服务器在读下一帧之前已切换
+    QJsonObject hello;
+    hello["framing"] = WireProtocol::framingToString(WireProtocol::Framing::LengthPrefixed);
+    hello["encoding"] = WireProtocol::encodingToString(WireProtocol::Encoding::Cbor);
+    hello["compression"] = QJsonArray{WireProtocol::compressionToString(WireProtocol::Compression::Zlib)};
+    QJsonObject request;
+    request["action"] = "hello";
+    request["requestId"] = "replica-hello";
+    request["payload"] = hello;
+    m_socket->write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(request, WireProtocol::Encoding::Json),
+                                              WireProtocol::Framing::Newline));
+    // 先订阅再取快照：快照之后的变化一定会以事件形式到达，不会漏掉
+    send("subscribe", QJsonObject{{"topics", QJsonArray{"catalog"}}});
+}
+
+void CatalogReplica::onDisconnected() {
+    if (m_reconnectTimer->isActive()) return;
+    m_reconnectTimer->start(); // 先启动：abort() 会再次触发 disconnected
+    m_socket->abort();
+    setSynced(false);
+    ServerMetrics::instance().setGauge("replicaConnected", 0);
+    qWarning() << "CatalogReplica: Lost primary" << m_host << m_port << "- retrying; serving version" << m_version;
+}
+
+void CatalogReplica::send(const QString& action, const QJsonObject& payload) {
+    QJsonObject request;
+    request["action"] = action;
+    request["requestId"] = "replica-" + action;
+    request["payload"] = payload;
+    m_socket->write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(request, WireProtocol::Encoding::Cbor),
+                                              WireProtocol::Framing::LengthPrefixed));
+}
+
+void CatalogReplica::onReadyRead() {
+    m_reader.append(m_socket->readAll());
+    QByteArray frame;
+    bool compressed = false;
+    while (true) {
+        FrameReader::Result result = m_reader.next(&frame, &compressed);
+        if (result == FrameReader::NeedMoreData) break;
+        if (result == FrameReader::FrameTooLarge) {
+            qWarning() << "CatalogReplica: Oversized frame from primary.";
+            onDisconnected();
+            return;
+        }
+        QByteArray payload = frame; // next() 返回的帧只在下一次 append() 之前有效
+        if (compressed && !WireProtocol::decompressPayload(frame, &payload)) {
+            qWarning() << "CatalogReplica: Invalid compressed frame from primary.";
+            onDisconnected();
+            return;
+        }
+        QJsonObject message;
+        QString errorString;
+        const WireProtocol::Encoding encoding = m_helloDone ? WireProtocol::Encoding::Cbor : WireProtocol::Encoding::Json;
+        if (!WireProtocol::decodeMessage(payload, encoding, &message, &errorString)) {
+            qWarning() << "CatalogReplica: Bad message from primary:" << errorString;
+            continue;
+        }
+        if (!m_helloDone) {
+            // 第一条是 hello 的回复（换行 JSON），之后才是长度前缀 + CBOR
+            m_helloDone = true;
+            m_reader.setFraming(WireProtocol::Framing::LengthPrefixed);
+            if (message["status"].toString() != "success") {
+                qWarning() << "CatalogReplica: Primary rejected hello:" << message["message"].toString();
+                onDisconnected();
+                return;
+            }
+            continue;
+        }
+        onMessage(message);
+    }
+}
+
+void CatalogReplica::onMessage(const QJsonObject& message) {
+    const QString action = message["response_to_action"].toString();
+    if (action == "event") {
+        if (message["event"].toString() == "catalogResync") {
+            // 主服务器在本连接积压时丢弃了事件
+            ServerMetrics::instance().increment("replicaResyncs");
+            m_buffered.clear();
+            requestSnapshot();
+        } else if (m_synced) {
+            applyEvent(message);
+        } else {
+            m_buffered.append(message);
+        }
+        return;
+    }
+    if (message["status"].toString() != "success") {
+        qWarning() << "CatalogReplica:" << action << "failed on primary:" << message["message"].toString();
+        if (action == "subscribe") onDisconnected(); // 主服务器不支持变更流，稍后再试
+        return;
+    }
+    if (action == "subscribe") {
+        requestSnapshot();
+    } else if (action == "catalogSnapshot") {
+        applySnapshot(message["data"].toObject());
+    } else if (action == "catalogVersion") {
+        const QJsonObject data = message["data"].toObject();
+        const qint64 primaryVersion = data["version"].toInteger();
+        const qint64 behind = qMax<qint64>(0, primaryVersion - qint64(m_version));
+        ServerMetrics::instance().setGauge("replicaVersionsBehind", behind);
+        if (behind == 0 && m_synced) {
+            // 已追平，空闲时不保留旧的延迟
+            m_freshAsOfMs = qMax(m_freshAsOfMs, data["ts"].toInteger());
+            ServerMetrics::instance().setGauge("replicaLagMs", 0);
+        }
+    }
+}
+
+void CatalogReplica::requestSnapshot() {
+    setSynced(false);
+    send("catalogSnapshot");
+}
+
+void CatalogReplica::applySnapshot(const QJsonObject& data) {
+    m_productManager->applySnapshot(data);
+    m_version = quint64(data["version"].toInteger());
+    setSynced(true);
+    ServerMetrics::instance().setGauge("replicaVersion", qint64(m_version));
+    updateLag(data["ts"].toInteger());
+    qInfo() << "CatalogReplica: Synced to primary catalog version" << m_version;
+
+    // 快照之前已生效的事件丢弃，之后的按顺序补上
+    const QList<QJsonObject> buffered = std::move(m_buffered);
+    m_buffered.clear();
+    for (const QJsonObject& event : buffered) {
+        if (!m_synced) break; // 补的过程中又发现跳号，已重新请求快照
+        applyEvent(event);
+    }
+}
+
+void CatalogReplica::applyEvent(const QJsonObject& event) {
+    const QJsonObject data = event["data"].toObject();
+    const quint64 version = quint64(data["version"].toInteger());
+    if (version <= m_version) return; // 已包含在快照中
+    if (version != m_version + 1) {
+        qWarning() << "CatalogReplica: Change stream gap (have" << m_version << ", got" << version << "), resyncing.";
+        ServerMetrics::instance().increment("replicaResyncs");
+        requestSnapshot();
+        return;
+    }
+    const QString name = event["event"].toString();
+    if (name == "discountChanged") {
+        m_productManager->applyDiscountChange(data["category"].toString(), data["discount"].toDouble(), version);
+    } else if (name == "productAdded" || name == "productChanged") {
+        m_productManager->applyProductChange(data, version);
+    }
+    m_version = version;
+    ServerMetrics::instance().increment("replicaEventsApplied");
+    ServerMetrics::instance().setGauge("replicaVersion", qint64(m_version));
+    updateLag(data["ts"].toInteger());
+}
+
+void CatalogReplica::setSynced(bool synced) {
+    m_synced = synced;
+    ServerMetrics::instance().setGauge("replicaSynced", synced ? 1 : 0);
+}
+
+void CatalogReplica::updateLag(qint64 eventTs) {
+    if (eventTs <= 0) return;
+    m_freshAsOfMs = qMax(m_freshAsOfMs, eventTs);
+    // 依赖两台机器的时钟同步；同机部署时就是真实的传播延迟
+    ServerMetrics::instance().setGauge("replicaLagMs", qMax<qint64>(0, QDateTime::currentMSecsSinceEpoch() - eventTs));
+}
+
+void CatalogReplica::pollVersion() {
+    if (m_helloDone && m_socket->state() == QAbstractSocket::ConnectedState) send("catalogVersion");
+    // 没有同步（断线、等快照）时收不到事件：延迟就是旧目录已经过去的时间，不能停在断线前的值
+    if (!m_synced && m_freshAsOfMs > 0) {
+        ServerMetrics::instance().setGauge("replicaLagMs", qMax<qint64>(0, QDateTime::currentMSecsSinceEpoch() - m_freshAsOfMs));
+    }
+}
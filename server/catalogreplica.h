@@ -0,0 +1,56 @@
+#ifndef CATALOGREPLICA_H
+#define CATALOGREPLICA_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QList>
+#include "wireprotocol.h"
+
+class QTcpSocket;
+class QTimer;
+class ServerProductManager;
+
+// 只读副本一侧：连到主服务器，订阅 "catalog" 变更流，再取一次全量快照，之后按版本号顺序应用事件。
+// 发现版本号跳跃（连接断开、事件丢失）时重新取快照；断线后每秒重连一次。
+// 应用结果写进本进程的 ServerProductManager，本进程的 getProducts/searchProducts 和目录订阅照常工作。
+// 指标：replicaVersion、replicaVersionsBehind、replicaLagMs（事件从主服务器生成到在副本上生效的时间），
+// replicaConnected、replicaSynced（0/1），以及 replicaEventsApplied、replicaResyncs 计数。
+// 断线或重新同步期间仍照常提供旧目录，replicaLagMs 按"现在 - 最后一次确认与主服务器一致的时间"每秒刷新。
+class CatalogReplica : public QObject {
+    Q_OBJECT
+public:
+    CatalogReplica(ServerProductManager* productManager, const QString& primaryHost, quint16 primaryPort,
+                   QObject* parent = nullptr);
+
+    void start();
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void pollVersion();
+
+private:
+    void send(const QString& action, const QJsonObject& payload = QJsonObject());
+    void onMessage(const QJsonObject& message);
+    void applyEvent(const QJsonObject& event);
+    void requestSnapshot();
+    void applySnapshot(const QJsonObject& data);
+    void updateLag(qint64 eventTs);
+    void setSynced(bool synced);
+
+    ServerProductManager* m_productManager;
+    QString m_host;
+    quint16 m_port;
+    QTcpSocket* m_socket;
+    QTimer* m_reconnectTimer;
+    QTimer* m_pollTimer;
+    FrameReader m_reader;
+    bool m_helloDone = false;
+    bool m_synced = false;          // 已应用快照，事件可以直接生效
+    QList<QJsonObject> m_buffered;  // 等快照期间到达的事件
+    quint64 m_version = 0;          // 已应用到的主服务器目录版本
+    qint64 m_freshAsOfMs = 0;       // 最后确认与主服务器一致的时刻（主服务器时钟，毫秒）
+};
+
+#endif // CATALOGREPLICA_H
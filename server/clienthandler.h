@@ -3,21 +3,17 @@
 
 #include <QObject>
 #include <QTcpSocket>
-#include <QJsonObject>
+#include "clientsession.h"
 
-class ServerAuthManager;
-class ServerProductManager;
-class ServerShoppingCartManager;
-class ServerOrderManager;
+class OutputQueue;
 
-class ClientHandler : public QObject {
+// Qt 网络后端：一个连接一个 QTcpSocket，运行在 WorkerPool 的某个事件循环线程里。
+// 协议和请求处理都在 ClientSession 中，这里只负责 socket 收发、发送队列和背压。
+class ClientHandler : public QObject, private ClientSession::Transport {
     Q_OBJECT
 public:
     explicit ClientHandler(qintptr socketDescriptor,
-                           ServerAuthManager* authMgr,
-                           ServerProductManager* prodMgr,
-                           ServerShoppingCartManager* cartMgr,
-                           ServerOrderManager* orderMgr,
+                           const ServerContext& context,
                            QObject *parent = nullptr); // Parent will be null when moved to thread
     ~ClientHandler();
 
@@ -31,43 +27,23 @@ private slots:
     void onReadyRead();
     void onSocketDisconnected();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onOutputHighWater();
+    void onOutputDrained();
 
 private:
     QTcpSocket *m_socket = nullptr;
+    OutputQueue *m_output = nullptr; // 合并写出的发送队列，积压过多时暂停读取
     qintptr m_socketDescriptor;
-    QString m_loggedInUsername; // Track user for this connection
+    ClientSession m_session;
 
-    // Pointers to server-wide manager instances
-    ServerAuthManager* m_authManager_s;
-    ServerProductManager* m_productManager_s;
-    ServerShoppingCartManager* m_shoppingCartManager_s;
-    ServerOrderManager* m_orderManager_s;
+    // ClientSession::Transport
+    void writeData(const QByteArray& data) override;
+    void post(std::function<void()> task) override;
+    void abortConnection() override;
+    void sessionFinished() override;
 
-    QByteArray m_buffer; // Buffer for incoming data
-
-    void processMessage(const QJsonObject& request);
-    void sendResponse(const QJsonObject& response);
-
-    QJsonObject handleLogin(const QJsonObject& payload);
-    QJsonObject handleRegister(const QJsonObject& payload);
-    QJsonObject handleChangePassword(const QJsonObject& payload);
-    QJsonObject handleRecharge(const QJsonObject& payload);
-    QJsonObject handleGetBalance(const QJsonObject& payload);
-
-    QJsonObject handleGetProducts(const QJsonObject& payload);
-    QJsonObject handleSearchProducts(const QJsonObject& payload);
-    QJsonObject handleAddProduct(const QJsonObject& payload);
-    QJsonObject handleUpdateProduct(const QJsonObject& payload);
-    QJsonObject handleSetCategoryDiscount(const QJsonObject& payload);
-
-    QJsonObject handleGetCart(const QJsonObject& payload);
-    QJsonObject handleAddToCart(const QJsonObject& payload);
-    QJsonObject handleRemoveFromCart(const QJsonObject& payload);
-    QJsonObject handleUpdateCartQuantity(const QJsonObject& payload);
-
-    QJsonObject handlePrepareOrder(const QJsonObject& payload);
-    QJsonObject handlePayOrder(const QJsonObject& payload);
-    QJsonObject handleGetOrders(const QJsonObject& payload);
+    void publishQueueDepth();
+    QString queueDepthGauge() const { return QString("outQueueBytes.%1").arg(m_session.id()); }
 };
 
 #endif // CLIENTHANDLER_H
@@ -0,0 +1,1134 @@
+#include "clientsession.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QReadLocker>
+#include <QHash>
+#include <QDateTime>
+#include <QSemaphore>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QAtomicInteger>
+
+// Include server-side manager headers
+#include "serverauthmanager.h"
+#include "serverproductmanager.h"
+#include "servershoppingcartmanager.h"
+#include "serverordermanager.h"
+#include "product.h"
+#include "order.h"
+#include "servermetrics.h"
+#include "logcategories.h"
+#include "eventhub.h"
+#include "sessionstore.h"
+#include "catalogcache.h"
+
+static QAtomicInteger<quint64> s_nextConnectionId;
+
+ClientSession::ClientSession(Transport* transport, const ServerContext& context)
+    : m_id(s_nextConnectionId.fetchAndAddRelaxed(1) + 1), m_transport(transport),
+    m_authManager_s(context.authManager), m_productManager_s(context.productManager),
+    m_shoppingCartManager_s(context.shoppingCartManager), m_orderManager_s(context.orderManager),
+    m_requestPool(context.requestPool), m_admission(context.admission),
+    m_connectionBucket(context.admission->makeConnectionBucket()), m_eventHub(context.eventHub),
+    m_sessions(context.sessions), m_catalogCache(context.catalogCache), m_shard(context.shard), m_readOnlyReplica(context.readOnlyReplica), m_compressionConfig(context.compression) {
+    m_pushChannel = std::make_shared<PushChannel>(
+        [transport](std::function<void()> task) { transport->post(std::move(task)); },
+        [this](const QList<QJsonObject>& events) {
+            for (const QJsonObject& event : events) sendResponse(event);
+        });
+}
+
+void ClientSession::feed(const QByteArray& data) {
+    m_reader.append(data);
+    processFrames();
+}
+
+void ClientSession::setInputPaused(bool paused) {
+    m_inputPaused = paused;
+    PushChannel::setCongested(m_pushChannel, paused); // 暂停读取即发送积压超过高水位
+    if (!paused) processFrames(); // 暂停时留在缓冲区里的完整帧
+}
+
+void ClientSession::processFrames() {
+    QByteArray jsonData;
+    bool compressed = false;
+    while (!m_inputPaused && !m_closing) { // 处理过程中可能触发高水位，剩下的帧留到恢复后
+        FrameReader::Result result = m_reader.next(&jsonData, &compressed);
+        if (result == FrameReader::NeedMoreData) {
+            break; // No complete message yet
+        }
+        if (result == FrameReader::FrameTooLarge) {
+            qWarning() << "ClientSession (" << m_id << ") Frame exceeds size limit, closing connection.";
+            m_transport->abortConnection();
+            return;
+        }
+
+        QJsonObject request;
+        QString errorString;
+        QElapsedTimer decodeTimer;
+        decodeTimer.start();
+        bool ok = true;
+        if (compressed) {
+            QByteArray inflated;
+            ok = m_compression != WireProtocol::Compression::None && WireProtocol::decompressPayload(jsonData, &inflated);
+            if (ok) {
+                jsonData = inflated;
+            } else {
+                errorString = "Invalid compressed frame";
+            }
+        }
+        ok = ok && WireProtocol::decodeMessage(jsonData, m_encoding, &request, &errorString);
+        qint64 decodeNs = decodeTimer.nsecsElapsed();
+
+        if (ok) {
+            ServerMetrics::instance().recordReceived(request["action"].toString(), WireProtocol::encodingToString(m_encoding),
+                                                     jsonData.size(), decodeNs);
+            // 只有打开 server.request.debug 时才会重新序列化整条请求
+            qCDebug(lcRequest) << "ClientSession (" << m_id << ") RX:" << QJsonDocument(request).toJson(QJsonDocument::Compact);
+            dispatchRequest(request);
+        } else {
+            qWarning() << "ClientSession (" << m_id << ") Parse error:" << errorString << ". Bytes:" << jsonData.size();
+            QJsonObject errResponse;
+            errResponse["status"] = "error";
+            errResponse["message"] = "Invalid request: " + errorString;
+            errResponse["response_to_action"] = "unknown_malformed";
+            errResponse["requestId"] = "invalid_request";
+            sendResponse(errResponse); // Send error back
+        }
+    }
+}
+
+void ClientSession::close() {
+    if (m_closing) return;
+    // 还在执行的请求完成后再销毁，未开始的串行请求直接丢弃
+    m_closing = true;
+    // 先 detach 再退订：之后不会有新事件送来，正在执行的 subscribe 也无法再把通道加回去
+    m_pushChannel->detach();
+    m_eventHub->unsubscribeAll(m_pushChannel.get());
+    for (int i = 0; i < m_serialQueue.size(); ++i) m_admission->releaseSlot(); // 排队中的请求不会再执行
+    m_serialQueue.clear();
+    if (m_inFlight == 0) {
+        m_transport->sessionFinished();
+    }
+}
+
+void ClientSession::sendResponse(const QJsonObject& response) {
+    if (m_closing) return; // 连接已断开，丢弃
+    QElapsedTimer encodeTimer;
+    encodeTimer.start();
+    const QString action = response["response_to_action"].toString();
+    QByteArray data;
+    // 目录数据按本连接的编码缓存过：只编码回复头，数据部分直接拼接缓存的字节
+    const QByteArray cachedData = action == QLatin1String("getProducts")
+        ? m_catalogCache->encoded(response["data"].toObject(), m_encoding) : QByteArray();
+    if (!cachedData.isEmpty()) {
+        QJsonObject head = response;
+        head.remove("data");
+        data = WireProtocol::encodeMessageWith(head, "data", cachedData, m_encoding);
+    } else {
+        data = WireProtocol::encodeMessage(response, m_encoding);
+    }
+    qint64 encodeNs = encodeTimer.nsecsElapsed();
+    const QString encodingName = WireProtocol::encodingToString(m_encoding);
+
+    // 小回复压缩不划算，只有超过阈值的帧才压；压完没有变小就原样发送
+    bool compressed = false;
+    if (m_compression == WireProtocol::Compression::Zlib && data.size() >= m_compressionConfig.threshold) {
+        encodeTimer.restart();
+        QByteArray packed = WireProtocol::compressPayload(data, m_compressionConfig.level);
+        qint64 compressNs = encodeTimer.nsecsElapsed();
+        compressed = !packed.isEmpty() && packed.size() < data.size();
+        ServerMetrics::instance().recordCompression(action, encodingName, data.size(), packed.size(), compressNs, compressed);
+        if (compressed) data = packed;
+    }
+    m_transport->writeData(WireProtocol::encodeFrame(data, m_reader.framing(), compressed));
+    ServerMetrics::instance().recordSent(action, encodingName, data.size(), encodeNs);
+    qCDebug(lcRequest) << "ClientSession (" << m_id << ") TX:" << QJsonDocument(response).toJson(QJsonDocument::Compact);
+}
+
+// --- Action registry ---
+// 新增 action 时在 ActionId 中加编号，再在这里登记一行
+const ClientSession::ActionSpec ClientSession::s_actions[] = {
+    // id                           name                   role                      readOnly  priority                  handler (, asyncHandler)
+    // --- Connection ---
+    {ActionId::Hello,               "hello",               ActionRole::Anyone,       true,     ActionPriority::High,     nullptr},
+    {ActionId::ServerStats,         "serverStats",         ActionRole::Anyone,       true,     ActionPriority::Low,      &ClientSession::handleServerStats},
+    {ActionId::Batch,               "batch",               ActionRole::Anyone,       false,    ActionPriority::Normal,   &ClientSession::handleBatch},
+    {ActionId::Subscribe,           "subscribe",           ActionRole::Anyone,       false,    ActionPriority::Normal,   &ClientSession::handleSubscribe},
+    {ActionId::Unsubscribe,         "unsubscribe",         ActionRole::Anyone,       false,    ActionPriority::Normal,   &ClientSession::handleUnsubscribe},
+    {ActionId::ShardAuth,           "shardAuth",           ActionRole::Anyone,       false,    ActionPriority::High,     &ClientSession::handleShardAuth},
+    {ActionId::ShardCredit,         "shardCredit",         ActionRole::Anyone,       false,    ActionPriority::High,     &ClientSession::handleShardCredit},
+    // --- Authentication ---
+    {ActionId::Login,               "login",               ActionRole::Anyone,       false,    ActionPriority::High,     nullptr, &ClientSession::handleLogin},
+    {ActionId::Resume,              "resume",              ActionRole::Anyone,       false,    ActionPriority::High,     &ClientSession::handleResume},
+    {ActionId::Logout,              "logout",              ActionRole::Anyone,       false,    ActionPriority::Normal,   &ClientSession::handleLogout},
+    {ActionId::Register,            "register",            ActionRole::Anyone,       false,    ActionPriority::High,     nullptr, &ClientSession::handleRegister},
+    {ActionId::ChangePassword,      "changePassword",      ActionRole::LoggedIn,     false,    ActionPriority::Normal,   nullptr, &ClientSession::handleChangePassword},
+    {ActionId::Recharge,            "recharge",            ActionRole::LoggedIn,     false,    ActionPriority::Normal,   &ClientSession::handleRecharge},
+    {ActionId::GetBalance,          "getBalance",          ActionRole::LoggedIn,     true,     ActionPriority::High,     &ClientSession::handleGetBalance},
+    // --- Products ---
+    {ActionId::GetProducts,         "getProducts",         ActionRole::Anyone,       true,     ActionPriority::Low,      &ClientSession::handleGetProducts},
+    {ActionId::SearchProducts,      "searchProducts",      ActionRole::Anyone,       true,     ActionPriority::Low,      &ClientSession::handleSearchProducts},
+    {ActionId::CatalogSnapshot,     "catalogSnapshot",     ActionRole::Anyone,       true,     ActionPriority::Low,      &ClientSession::handleCatalogSnapshot},
+    {ActionId::CatalogVersion,      "catalogVersion",      ActionRole::Anyone,       true,     ActionPriority::High,     &ClientSession::handleCatalogVersion},
+    {ActionId::AddProduct,          "addProduct",          ActionRole::Merchant,     false,    ActionPriority::Normal,   &ClientSession::handleAddProduct},
+    {ActionId::UpdateProduct,       "updateProduct",       ActionRole::Merchant,     false,    ActionPriority::Normal,   &ClientSession::handleUpdateProduct},
+    {ActionId::SetCategoryDiscount, "setCategoryDiscount", ActionRole::Merchant,     false,    ActionPriority::Normal,   &ClientSession::handleSetCategoryDiscount},
+    // --- Shopping Cart ---
+    {ActionId::GetCart,             "getCart",             ActionRole::LoggedIn,     true,     ActionPriority::Normal,   &ClientSession::handleGetCart},
+    {ActionId::AddToCart,           "addToCart",           ActionRole::LoggedIn,     false,    ActionPriority::Normal,   &ClientSession::handleAddToCart},
+    {ActionId::RemoveFromCart,      "removeFromCart",      ActionRole::LoggedIn,     false,    ActionPriority::Normal,   &ClientSession::handleRemoveFromCart},
+    {ActionId::UpdateCartQuantity,  "updateCartQuantity",  ActionRole::LoggedIn,     false,    ActionPriority::Normal,   &ClientSession::handleUpdateCartQuantity},
+    // --- Orders ---
+    {ActionId::PrepareOrder,        "prepareOrder",        ActionRole::LoggedIn,     false,    ActionPriority::High,     &ClientSession::handlePrepareOrder},
+    {ActionId::PayOrder,            "payOrder",            ActionRole::LoggedIn,     false,    ActionPriority::High,     &ClientSession::handlePayOrder},
+    {ActionId::GetOrders,           "getOrders",           ActionRole::LoggedIn,     true,     ActionPriority::Normal,   &ClientSession::handleGetOrders},
+};
+
+const ClientSession::ActionSpec* ClientSession::findAction(const QString& action) {
+    static const QHash<quint32, const ActionSpec*> index = []() {
+        QHash<quint32, const ActionSpec*> h;
+        for (const ActionSpec& spec : s_actions) h.insert(spec.id, &spec);
+        return h;
+    }();
+    const quint32 id = ActionId::hash(action);
+    const ActionSpec* spec = id == ActionId::Invalid ? nullptr : index.value(id, nullptr);
+    // 未登记的名字也可能与某个 action 的哈希相同，命中后再比一次名字
+    return spec && action == QLatin1String(spec->name) ? spec : nullptr;
+}
+
+quint32 ClientSession::actionId(const QString& action) {
+    const ActionSpec* spec = findAction(action);
+    return spec ? spec->id : ActionId::Invalid;
+}
+
+// 只读且不依赖登录状态的请求，可以与同一连接上的其他请求并发执行
+bool ClientSession::isConcurrentAction(const ActionSpec* spec) {
+    return spec && spec->readOnly && spec->role == ActionRole::Anyone && spec->handler;
+}
+
+void ClientSession::dispatchRequest(const QJsonObject& request) {
+    const ActionSpec* spec = findAction(request["action"].toString());
+    qCDebug(lcRequest) << "ClientSession (" << m_id << ") dispatch" << (spec ? spec->name : "<unknown>");
+
+    if (spec && spec->id == ActionId::Hello) {
+        // 会改变后续帧的解析方式，必须在读下一帧之前于本线程完成
+        processHello(request);
+        return;
+    }
+    // 前面还有串行请求（可能是写操作）没执行完时，读请求也排到它后面，保证读到本连接自己的写入
+    const bool serial = !isConcurrentAction(spec) || m_serialBusy || !m_serialQueue.isEmpty();
+    AdmissionControl::Verdict verdict = admit(request, spec, serial);
+    if (verdict != AdmissionControl::Admitted) {
+        // 直接拒绝，不占用线程池和队列
+        QJsonObject rejected;
+        rejected["status"] = "overloaded";
+        rejected["message"] = AdmissionControl::reject(verdict);
+        sendResponse(buildResponse(request, rejected));
+        return;
+    }
+    if (!serial) {
+        startRequest({request, spec}, false);
+        return;
+    }
+    // 与用户状态相关的请求（登录、购物车、订单、余额……）按到达顺序逐个执行
+    m_serialQueue.enqueue({request, spec});
+    if (!m_serialBusy) startNextSerial();
+}
+
+AdmissionControl::Verdict ClientSession::admit(const QJsonObject& request, const ActionSpec* spec, bool serial) {
+    // batch 按子请求条数计费
+    double cost = 1.0;
+    if (spec && spec->id == ActionId::Batch) {
+        cost = qMax<qsizetype>(1, request["payload"].toObject()["requests"].toArray().size());
+    }
+    // 先检查全局容量：因为服务器过载被拒绝的请求不应消耗客户端的限速额度
+    if (serial && m_admission->config().maxQueuedPerConnection > 0
+        && m_serialQueue.size() >= m_admission->config().maxQueuedPerConnection) {
+        return AdmissionControl::QueueFull;
+    }
+    // 成功后一直占用到回复发出（onRequestFinished 中释放）
+    if (!m_admission->tryAcquireSlot()) return AdmissionControl::InFlightLimitReached;
+    const qint64 now = m_admission->nowMs();
+    if (!m_connectionBucket.tryTake(now, cost)) {
+        m_admission->releaseSlot();
+        return AdmissionControl::ConnectionRateExceeded;
+    }
+    if (!m_admission->takeUserTokens(m_sessionUser, cost)) {
+        m_connectionBucket.giveBack(cost);
+        m_admission->releaseSlot();
+        return AdmissionControl::UserRateExceeded;
+    }
+    return AdmissionControl::Admitted;
+}
+
+void ClientSession::startNextSerial() {
+    if (m_serialQueue.isEmpty() || m_closing) return;
+    m_serialBusy = true;
+    startRequest(m_serialQueue.dequeue(), true);
+}
+
+void ClientSession::startRequest(const PendingRequest& pending, bool serial) {
+    m_inFlight++;
+    int priority = int(pending.spec ? pending.spec->priority : ActionPriority::Low);
+    // 完成回调经传输层送回会话线程；在 m_inFlight 归零之前会话不会被销毁
+    m_requestPool->start([this, pending, serial]() {
+        processMessage(pending.request, pending.spec, [this, serial](const QJsonObject& response) {
+            m_transport->post([this, response, serial]() {
+                onRequestFinished(response, serial);
+            });
+        });
+    }, priority);
+}
+
+void ClientSession::onRequestFinished(const QJsonObject& response, bool serial) {
+    m_inFlight--;
+    m_admission->releaseSlot();
+    sendResponse(response);
+    if (serial) {
+        m_serialBusy = false;
+        m_sessionUser = m_loggedInUsername; // 此刻没有串行请求在执行，可以安全读取
+        startNextSerial();
+    }
+    if (m_closing && m_inFlight == 0) {
+        m_transport->sessionFinished();
+    }
+}
+
+void ClientSession::processHello(const QJsonObject& request) {
+    WireProtocol::Framing negotiatedFraming = m_reader.framing();
+    WireProtocol::Encoding negotiatedEncoding = m_encoding;
+    WireProtocol::Compression negotiatedCompression = m_compression;
+    QJsonObject responsePayload = handleHello(request["payload"].toObject(), &negotiatedFraming, &negotiatedEncoding,
+                                              &negotiatedCompression);
+    sendResponse(buildResponse(request, responsePayload));
+
+    // hello 的回复仍按旧的分帧方式、编码和压缩设置发出，之后的收发才切换
+    if (negotiatedFraming != m_reader.framing() || negotiatedEncoding != m_encoding || negotiatedCompression != m_compression) {
+        m_reader.setFraming(negotiatedFraming);
+        m_encoding = negotiatedEncoding;
+        m_compression = negotiatedCompression;
+        qInfo() << "ClientSession (" << m_id << ") Switched to"
+                << WireProtocol::framingToString(negotiatedFraming) << "framing," << WireProtocol::encodingToString(negotiatedEncoding) << "encoding,"
+                << WireProtocol::compressionToString(negotiatedCompression) << "compression";
+    }
+}
+
+bool ClientSession::checkAccess(const ActionSpec& spec, QJsonObject* errorPayload) const {
+    if (spec.role == ActionRole::Anyone) return true;
+    if (m_loggedInUsername.isEmpty()) { // Security: rely on server's logged-in state
+        (*errorPayload)["status"] = "error";
+        (*errorPayload)["message"] = "Not logged in.";
+        return false;
+    }
+    if (spec.role == ActionRole::Merchant && m_loggedInUserType != "Merchant") {
+        (*errorPayload)["status"] = "error";
+        (*errorPayload)["message"] = "Permission denied. Only merchants can " + QString(spec.name) + ".";
+        return false;
+    }
+    return true;
+}
+
+// 在请求线程池中执行；只有串行请求会读写 m_loggedInUsername（异步 action 完成前串行队列不会前进）
+void ClientSession::processMessage(const QJsonObject& request, const ActionSpec* spec,
+                                   std::function<void(const QJsonObject&)> done) {
+    QJsonObject responsePayload; // Data part of the response
+    if (!spec) {
+        responsePayload["status"] = "error";
+        responsePayload["message"] = "Unknown action: " + request["action"].toString();
+    } else if (!spec->handler && !spec->asyncHandler) {
+        responsePayload["status"] = "error";
+        responsePayload["message"] = "Action not allowed here: " + QString(spec->name);
+    } else if (m_readOnlyReplica && !spec->readOnly && spec->id != ActionId::Subscribe
+               && spec->id != ActionId::Unsubscribe && spec->id != ActionId::Batch) {
+        // batch 里的子请求会逐条再经过这里
+        responsePayload["status"] = "error";
+        responsePayload["message"] = "Read-only replica, send " + QString(spec->name) + " to the primary server.";
+    } else if (checkAccess(*spec, &responsePayload)) {
+        if (spec->asyncHandler) {
+            (this->*spec->asyncHandler)(request["payload"].toObject(), [request, done](const QJsonObject& payload) {
+                done(buildResponse(request, payload));
+            });
+            return;
+        }
+        responsePayload = (this->*spec->handler)(request["payload"].toObject());
+    }
+    done(buildResponse(request, responsePayload));
+}
+
+QJsonObject ClientSession::processMessage(const QJsonObject& request, const ActionSpec* spec) {
+    QJsonObject response;
+    QSemaphore finished;
+    processMessage(request, spec, [&response, &finished](const QJsonObject& result) {
+        response = result;
+        finished.release();
+    });
+    finished.acquire();
+    return response;
+}
+
+QJsonObject ClientSession::buildResponse(const QJsonObject& request, const QJsonObject& responsePayload) {
+    QString status = "success"; // Default status
+    QString message = "";       // Error message if any
+
+    // If handler methods set their own status/message, respect it
+    if (responsePayload.contains("status")) status = responsePayload["status"].toString();
+    if (responsePayload.contains("message") && !responsePayload["message"].toString().isEmpty()) {
+        message = responsePayload["message"].toString();
+    }
+
+    QJsonObject finalResponse;
+    finalResponse["requestId"] = request["requestId"].toString();
+    finalResponse["response_to_action"] = request["action"].toString(); // Echo action for client to route
+    finalResponse["status"] = status;
+    if (status == "success") {
+        finalResponse["data"] = responsePayload.value("data"); // Assuming handlers put data under "data" key
+    } else {
+        finalResponse["message"] = message.isEmpty() ? QString("Unknown error") : message;
+    }
+    return finalResponse;
+}
+
+
+// --- Individual Handler Implementations ---
+QJsonObject ClientSession::handleHello(const QJsonObject& payload, WireProtocol::Framing* framing, WireProtocol::Encoding* encoding,
+                                       WireProtocol::Compression* compression) {
+    QJsonObject response;
+    WireProtocol::Framing requestedFraming = m_reader.framing();
+    WireProtocol::Encoding requestedEncoding = m_encoding;
+    WireProtocol::Compression requestedCompression = m_compression;
+    if (payload.contains("framing") && !WireProtocol::framingFromString(payload["framing"].toString(), &requestedFraming)) {
+        response["status"] = "error";
+        response["message"] = "Unsupported framing: " + payload["framing"].toString();
+        return response;
+    }
+    if (payload.contains("encoding") && !WireProtocol::encodingFromString(payload["encoding"].toString(), &requestedEncoding)) {
+        response["status"] = "error";
+        response["message"] = "Unsupported encoding: " + payload["encoding"].toString();
+        return response;
+    }
+    // 二进制负载可能包含 '\n'，只能走长度前缀分帧
+    if (requestedEncoding == WireProtocol::Encoding::Cbor && requestedFraming != WireProtocol::Framing::LengthPrefixed) {
+        response["status"] = "error";
+        response["message"] = "CBOR encoding requires length-prefixed framing.";
+        return response;
+    }
+    if (payload.contains("compression")) {
+        // 可以是一个名字，也可以是按偏好排列的列表；取第一个支持的，都不支持（如 zstd）就不压缩
+        const QJsonValue value = payload["compression"];
+        const QJsonArray offered = value.isArray() ? value.toArray() : QJsonArray{value};
+        requestedCompression = WireProtocol::Compression::None;
+        for (const QJsonValue& name : offered) {
+            WireProtocol::Compression candidate;
+            if (WireProtocol::compressionFromString(name.toString(), &candidate)) {
+                requestedCompression = candidate;
+                break;
+            }
+        }
+        if (m_compressionConfig.threshold <= 0) requestedCompression = WireProtocol::Compression::None; // 服务器关闭了压缩
+    }
+    // 压缩标志位在长度前缀帧头里
+    if (requestedCompression != WireProtocol::Compression::None && requestedFraming != WireProtocol::Framing::LengthPrefixed) {
+        response["status"] = "error";
+        response["message"] = "Compression requires length-prefixed framing.";
+        return response;
+    }
+    *framing = requestedFraming;
+    *encoding = requestedEncoding;
+    *compression = requestedCompression;
+    QJsonObject data;
+    data["framing"] = WireProtocol::framingToString(requestedFraming);
+    data["encoding"] = WireProtocol::encodingToString(requestedEncoding);
+    data["compression"] = WireProtocol::compressionToString(requestedCompression);
+    if (requestedCompression != WireProtocol::Compression::None) data["compressThreshold"] = m_compressionConfig.threshold;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleServerStats(const QJsonObject& payload) {
+    Q_UNUSED(payload);
+    QJsonObject response;
+    response["status"] = "success";
+    response["data"] = ServerMetrics::instance().snapshot();
+    return response;
+}
+
+// 一次往返执行多条子请求：{"requests": [{action, payload, requestId, independent}, ...], "stopOnError": bool}
+// 子请求默认按顺序执行；连续标记为 independent 的子请求并发执行。
+// 返回 {"results": [...]}，每一项与单独发送时的响应格式相同，顺序与请求一致。
+static const int MaxBatchSize = 64;
+
+// 会修改连接状态或传输方式的请求不能并发，也不能嵌套
+static bool canRunInParallel(quint32 id) {
+    return id != ActionId::Login && id != ActionId::Register && id != ActionId::ShardAuth && id != ActionId::Resume
+        && id != ActionId::Logout && id != ActionId::Batch && id != ActionId::Hello;
+}
+
+QJsonObject ClientSession::handleBatch(const QJsonObject& payload) {
+    QJsonObject response;
+    QJsonArray requests = payload["requests"].toArray();
+    if (requests.isEmpty() || requests.size() > MaxBatchSize) {
+        response["status"] = "error";
+        response["message"] = QString("Batch must contain 1 to %1 requests.").arg(MaxBatchSize);
+        return response;
+    }
+    bool stopOnError = payload["stopOnError"].toBool(false);
+
+    QList<QJsonObject> subRequests;
+    QList<quint32> subIds;
+    subRequests.reserve(requests.size());
+    subIds.reserve(requests.size());
+    for (const QJsonValue& val : requests) {
+        subRequests.append(val.toObject());
+        const ActionSpec* subSpec = findAction(subRequests.last()["action"].toString());
+        subIds.append(subSpec ? subSpec->id : ActionId::Invalid);
+    }
+
+    QJsonArray results;
+    bool failed = false;
+    int i = 0;
+    while (i < subRequests.size()) {
+        const QJsonObject& sub = subRequests[i];
+        const quint32 id = subIds[i];
+
+        if (failed && stopOnError) {
+            QJsonObject skipped;
+            skipped["status"] = "error";
+            skipped["message"] = "Skipped because an earlier request in the batch failed.";
+            results.append(buildResponse(sub, skipped));
+            ++i;
+            continue;
+        }
+        if (id == ActionId::Batch || id == ActionId::Hello) {
+            QJsonObject rejected;
+            rejected["status"] = "error";
+            rejected["message"] = "Action not allowed inside a batch: " + sub["action"].toString();
+            results.append(buildResponse(sub, rejected));
+            failed = true;
+            ++i;
+            continue;
+        }
+
+        // 收集一段连续的 independent 子请求
+        int end = i;
+        while (end < subRequests.size() && subRequests[end]["independent"].toBool() && canRunInParallel(subIds[end])) {
+            ++end;
+        }
+
+        if (end - i > 1) {
+            // 用全局线程池而不是请求线程池，避免所有请求线程都在等子任务时饿死
+            QList<QJsonObject> group = subRequests.mid(i, end - i);
+            QList<QJsonObject> groupResults = QtConcurrent::blockingMapped(group, [this](const QJsonObject& r) {
+                return processMessage(r);
+            });
+            for (const QJsonObject& r : groupResults) {
+                results.append(r);
+                if (r["status"].toString() != "success") failed = true;
+            }
+            i = end;
+        } else {
+            QJsonObject r = processMessage(sub);
+            results.append(r);
+            if (r["status"].toString() != "success") failed = true;
+            ++i;
+        }
+    }
+    ServerMetrics::instance().increment("batchRequests");
+    ServerMetrics::instance().increment("batchSubRequests", subRequests.size());
+
+    QJsonObject data;
+    data["results"] = results;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+// --- 分片内部请求 ---
+bool ClientSession::checkShardSecret(const QJsonObject& payload, QJsonObject* errorPayload) const {
+    if (!m_shard.enabled() || m_shard.secret.isEmpty() || payload["secret"].toString() != m_shard.secret) {
+        (*errorPayload)["status"] = "error";
+        (*errorPayload)["message"] = "Shard request rejected.";
+        return false;
+    }
+    return true;
+}
+
+QJsonObject ClientSession::handleShardAuth(const QJsonObject& payload) {
+    QJsonObject response;
+    if (!checkShardSecret(payload, &response)) return response;
+    const QString username = payload["username"].toString();
+    // 用户在主分片上已经验证过密码；空用户名表示退出
+    setLoggedInUser(username, username.isEmpty() ? QString() : payload["userType"].toString());
+    response["status"] = "success";
+    return response;
+}
+
+QJsonObject ClientSession::handleShardCredit(const QJsonObject& payload) {
+    QJsonObject response;
+    if (!checkShardSecret(payload, &response)) return response;
+    const QString username = payload["username"].toString();
+    const QString key = payload["key"].toString();
+    const qint64 cents = payload["cents"].toInteger();
+    if (!m_shard.owns(username)) {
+        // 防止两个配置不一致的分片互相转发
+        response["status"] = "error";
+        response["message"] = "User does not belong to this shard.";
+        return response;
+    }
+    if (key.isEmpty() || cents <= 0) {
+        response["status"] = "error";
+        response["message"] = "Credit requires an idempotency key and a positive amount.";
+        return response;
+    }
+    // 同一个 key 重发时不再入账，仍回复成功
+    bool success = m_authManager_s->applyShardCredit(key, username, cents);
+    response["status"] = success ? "success" : "error";
+    if (!success) response["message"] = "Balance change failed.";
+    return response;
+}
+
+void ClientSession::handleLogin(const QJsonObject& payload, Reply reply) {
+    QString username = payload["username"].toString();
+    QString password = payload["password"].toString();
+    if (m_shard.enabled() && !m_shard.owns(username)) {
+        // 直接连到分片而不是路由器时会走到这里
+        QJsonObject response;
+        response["status"] = "error";
+        response["message"] = QString("User belongs to shard %1.").arg(Sharding::shardOf(username, m_shard.count));
+        reply(response);
+        return;
+    }
+    m_authManager_s->verifyLogin(username, password, [this, username, reply](const QVariantMap& result) {
+        QJsonObject response;
+        if (result["success"].toBool()) {
+            setLoggedInUser(username, result["userData"].toMap().value("type").toString()); // Store for this session
+            QJsonObject data = QJsonObject::fromVariantMap(result["userData"].toMap());
+            data["sessionToken"] = m_sessions->issue(m_loggedInUsername, m_loggedInUserType);
+            data["sessionTtl"] = m_sessions->ttlSeconds();
+            response["status"] = "success";
+            response["data"] = data;
+        } else {
+            response["status"] = "error";
+            response["message"] = result["error"].toString();
+        }
+        reply(response);
+    });
+}
+
+void ClientSession::setLoggedInUser(const QString& username, const QString& userType) {
+    if (!m_loggedInUsername.isEmpty() && m_loggedInUsername != username) {
+        // 换了账号：上一个用户的购物车、订单推送不能再发给这个连接
+        m_eventHub->unsubscribe("cart:" + m_loggedInUsername, m_pushChannel.get());
+        m_eventHub->unsubscribe("orders:" + m_loggedInUsername, m_pushChannel.get());
+    }
+    m_loggedInUsername = username;
+    m_loggedInUserType = userType;
+}
+
+QJsonObject ClientSession::handleResume(const QJsonObject& payload) {
+    QJsonObject response;
+    const QString token = payload["token"].toString();
+    SessionStore::Session session;
+    if (token.isEmpty() || !m_sessions->resume(token, &session)) {
+        // 过期、被注销或服务器重启过：客户端应重新登录
+        ServerMetrics::instance().increment("sessionResumeFailed");
+        response["status"] = "error";
+        response["message"] = "Session expired, please log in again.";
+        return response;
+    }
+    setLoggedInUser(session.username, session.userType);
+    ServerMetrics::instance().increment("sessionResumed");
+    QJsonObject data;
+    data["username"] = session.username;
+    data["type"] = session.userType;
+    data["balance"] = m_authManager_s->getBalance(session.username);
+    data["sessionToken"] = token;
+    data["sessionTtl"] = m_sessions->ttlSeconds();
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleLogout(const QJsonObject& payload) {
+    QJsonObject response;
+    const QString token = payload["token"].toString();
+    if (!token.isEmpty()) m_sessions->revoke(token);
+    setLoggedInUser(QString(), QString());
+    response["status"] = "success";
+    return response;
+}
+
+void ClientSession::handleRegister(const QJsonObject& payload, Reply reply) {
+    if (m_shard.enabled() && !m_shard.owns(payload["username"].toString())) {
+        QJsonObject rejected;
+        rejected["status"] = "error";
+        rejected["message"] = QString("User belongs to shard %1.").arg(Sharding::shardOf(payload["username"].toString(), m_shard.count));
+        reply(rejected);
+        return;
+    }
+    m_authManager_s->registerUser(
+        payload["username"].toString(),
+        payload["password"].toString(),
+        payload["type"].toString(),
+        0.0, // New users start with 0 balance
+        [reply](const QVariantMap& result) {
+            QJsonObject response;
+            if (result["success"].toBool()) {
+                response["status"] = "success";
+                // Optionally auto-login: m_loggedInUsername = payload["username"].toString();
+                // response["data"] = ... if sending user data back
+            } else {
+                response["status"] = "error";
+                response["message"] = result["error"].toString();
+            }
+            reply(response);
+        });
+}
+// ... Implement ALL other handle<Action> methods similarly ...
+// They call the corresponding Server<ManagerName> method and format the response.
+
+void ClientSession::handleChangePassword(const QJsonObject &payload, Reply reply) {
+    const QString username = m_loggedInUsername;
+    const QString userType = m_loggedInUserType;
+    SessionStore* sessions = m_sessions;
+    m_authManager_s->changePassword(
+        username, // Use server-side username
+        payload["oldPwd"].toString(),
+        payload["newPwd"].toString(),
+        [reply, sessions, username, userType](const QVariantMap& result) {
+            QJsonObject response;
+            bool success = result["success"].toBool();
+            response["status"] = success ? "success" : "error";
+            if (success) {
+                // 旧密码下发放的令牌全部作废（包括其他设备上的）；当前连接换一个新令牌
+                sessions->revokeUser(username);
+                QJsonObject data;
+                data["sessionToken"] = sessions->issue(username, userType);
+                data["sessionTtl"] = sessions->ttlSeconds();
+                response["data"] = data;
+            } else {
+                response["message"] = "Password change failed: " + result["error"].toString();
+            }
+            reply(response);
+        });
+}
+
+QJsonObject ClientSession::handleRecharge(const QJsonObject &payload) {
+    QJsonObject response;
+    double amount = payload["amount"].toDouble();
+    bool success = m_authManager_s->recharge(m_loggedInUsername, amount);
+    if (success) {
+        response["status"] = "success";
+        QJsonObject data;
+        data["newBalance"] = m_authManager_s->getBalance(m_loggedInUsername);
+        response["data"] = data;
+    } else {
+        response["status"] = "error";
+        response["message"] = "Recharge failed.";
+    }
+    return response;
+}
+
+QJsonObject ClientSession::handleGetBalance(const QJsonObject &payload) {
+    QJsonObject response;
+    QString usernameToQuery = m_loggedInUsername; // Default to current user
+
+    // Optional: Allow admin to query any user, but requires role check
+    // if (payload.contains("username_query") && m_authManager_s->isAdmin(m_loggedInUsername)) {
+    //     usernameToQuery = payload["username_query"].toString();
+    // }
+
+    if (usernameToQuery.isEmpty()) {
+        response["status"] = "error";
+        response["message"] = "Not logged in or user not specified.";
+        return response;
+    }
+    QJsonObject data;
+    data["balance"] = m_authManager_s->getBalance(usernameToQuery);
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+
+// --- 分页 ---
+// payload 带 limit 时分页返回，响应中的 nextCursor 原样放进下一次请求的 cursor；不带 limit 时返回全部（旧客户端）。
+// 游标对客户端不透明：紧凑 JSON 的 base64url，kind 防止把一个动作的游标用在另一个动作上
+static const int MaxPageSize = 200;
+
+static int pageLimit(const QJsonObject& payload) {
+    if (!payload.contains("limit")) return 0;
+    return qBound(1, payload["limit"].toInt(), MaxPageSize);
+}
+
+static QString encodeCursor(const QString& kind, QJsonObject position) {
+    position["k"] = kind;
+    return QString::fromLatin1(QJsonDocument(position).toJson(QJsonDocument::Compact)
+                                   .toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+// 没有 cursor 时返回 true 且 position 为空（从头开始）
+static bool decodeCursor(const QJsonObject& payload, const QString& kind, QJsonObject* position) {
+    *position = QJsonObject();
+    const QString cursor = payload["cursor"].toString();
+    if (cursor.isEmpty()) return true;
+    const QByteArray json = QByteArray::fromBase64(cursor.toLatin1(), QByteArray::Base64UrlEncoding);
+    *position = QJsonDocument::fromJson(json).object();
+    return (*position)["k"].toString() == kind;
+}
+
+static QJsonObject invalidCursor() {
+    QJsonObject response;
+    response["status"] = "error";
+    response["message"] = "Invalid cursor.";
+    return response;
+}
+
+// 调用方持有目录读锁
+static QJsonObject productToJson(const Product* p) {
+    QJsonObject productJson;
+    productJson["id"] = qint64(p->getId());
+    productJson["name"] = p->getName();
+    productJson["description"] = p->getDescription();
+    productJson["basePrice"] = p->getBasePrice();
+    productJson["price"] = p->getPrice(); // Current price with discount
+    productJson["stock"] = p->getStock();
+    productJson["category"] = p->getCategory();
+    productJson["imagePath"] = p->getImagePath();
+    productJson["merchantUsername"] = p->getMerchantUsername();
+    productJson["discount"] = p->getDiscount();
+    return productJson;
+}
+
+QJsonObject ClientSession::handleGetProducts(const QJsonObject& payload) {
+    const int limit = pageLimit(payload);
+    QJsonObject position;
+    if (!decodeCursor(payload, "products", &position)) return invalidCursor();
+    const quint64 afterId = quint64(position["id"].toInteger());
+    QJsonObject data;
+    {
+        // 持有目录读锁：版本号与构造出的数据一致，序列化期间商家也不能并发修改商品
+        QReadLocker locker(m_productManager_s->lock());
+        const quint64 version = m_productManager_s->version();
+        const QString epoch = m_productManager_s->epoch();
+        const QString etag = CatalogCache::etag(epoch, version, limit > 0 ? QString::number(limit) + '.' + QString::number(afterId)
+                                                                          : QStringLiteral("all"));
+        if (!m_catalogCache->find(etag, &data)) {
+            // 分页时按商品 ID 顺序，多取一个用来判断是否还有下一页
+            QList<Product*> products = limit > 0 ? m_productManager_s->productsAfter(afterId, limit + 1)
+                                                 : m_productManager_s->getAllProducts();
+            if (limit > 0 && products.size() > limit) {
+                products.resize(limit);
+                data["nextCursor"] = encodeCursor("products", QJsonObject{{"id", qint64(products.last()->getId())}});
+            }
+            QJsonArray productsArray;
+            for (Product* p : std::as_const(products)) productsArray.append(productToJson(p));
+            data["products"] = productsArray;
+            data["total"] = qint64(m_productManager_s->productCount());
+            data["etag"] = etag;
+            m_catalogCache->insert(epoch, version, etag, data);
+        }
+    }
+    QJsonObject response;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleCatalogSnapshot(const QJsonObject& payload) {
+    Q_UNUSED(payload);
+    QJsonObject data = m_productManager_s->snapshot();
+    data["ts"] = QDateTime::currentMSecsSinceEpoch();
+    QJsonObject response;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleCatalogVersion(const QJsonObject& payload) {
+    Q_UNUSED(payload);
+    QJsonObject data;
+    {
+        QReadLocker locker(m_productManager_s->lock());
+        data["version"] = qint64(m_productManager_s->version());
+    }
+    data["ts"] = QDateTime::currentMSecsSinceEpoch();
+    QJsonObject response;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleSearchProducts(const QJsonObject &payload) {
+    double minPriceVal = -1.0;
+    if (payload.contains("minPrice") && payload["minPrice"].isDouble()) {
+        minPriceVal = payload["minPrice"].toDouble();
+    }
+
+    double maxPriceVal = -1.0;
+    if (payload.contains("maxPrice") && payload["maxPrice"].isDouble()) {
+        maxPriceVal = payload["maxPrice"].toDouble();
+    }
+    const int limit = pageLimit(payload);
+    QJsonObject position;
+    if (!decodeCursor(payload, "search", &position)) return invalidCursor();
+    QReadLocker locker(m_productManager_s->lock());
+    QList<double> rankKeys;
+    QList<Product*> products = m_productManager_s->searchProducts(
+        payload["keyword"].toString(),
+        payload["searchType"].toInt(),
+        minPriceVal,
+        maxPriceVal,
+        &rankKeys
+        );
+    // 搜索结果每次重新计算（代价与命中数量相关），按 (排序键降序, ID 升序) 排列。
+    // 游标记录上一页最后一个商品的 (键, ID)，从排在它之后的第一个商品继续：前面增删商品不会让这一页重复或跳过
+    QJsonObject data;
+    data["total"] = qint64(products.size());
+    if (limit > 0) {
+        qsizetype start = 0;
+        if (position.contains("id")) {
+            const double lastKey = position["s"].toDouble();
+            const quint64 lastId = quint64(position["id"].toInteger());
+            while (start < products.size()
+                   && (rankKeys[start] > lastKey || (rankKeys[start] == lastKey && products[start]->getId() <= lastId))) {
+                ++start;
+            }
+        }
+        const qsizetype end = qMin(products.size(), start + limit);
+        if (end < products.size()) {
+            data["nextCursor"] = encodeCursor("search", QJsonObject{{"s", rankKeys[end - 1]},
+                                                                    {"id", qint64(products[end - 1]->getId())}});
+        }
+        products = products.mid(start, end - start);
+    }
+    QJsonArray productsArray;
+    for (Product* p : std::as_const(products)) productsArray.append(productToJson(p));
+    QJsonObject response;
+    response["status"] = "success";
+    data["products"] = productsArray;
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleAddProduct(const QJsonObject &payload) {
+    QJsonObject response;
+    // 分片模式下 0 号分片分配商品 ID，路由器再把它带给其他分片，各分片上的 ID 一致
+    quint64 id = 0;
+    if (m_shard.enabled() && m_shard.index != 0) {
+        id = quint64(payload["id"].toInteger());
+        if (id == 0) {
+            response["status"] = "error";
+            response["message"] = "Product id must be assigned by shard 0.";
+            return response;
+        }
+    }
+    quint64 assignedId = 0;
+    bool success = m_productManager_s->addProduct(
+        payload["name"].toString(), payload["description"].toString(),
+        payload["price"].toDouble(), payload["stock"].toInt(),
+        payload["category"].toString(), m_loggedInUsername, // Use logged-in merchant's username
+        payload["imagePath"].toString(), id, &assignedId
+        );
+    response["status"] = success ? "success" : "error";
+    if (success) response["data"] = QJsonObject{{"id", qint64(assignedId)}};
+    if(!success) response["message"] = "Failed to add product (e.g., duplicate name, invalid data).";
+    return response;
+}
+
+QJsonObject ClientSession::handleUpdateProduct(const QJsonObject &payload) {
+    QJsonObject response;
+    // Product identified by its original name and the logged-in merchant
+    bool success = m_productManager_s->updateProduct(
+        payload["originalName"].toString(), m_loggedInUsername,
+        payload["name"].toString(), payload["description"].toString(),
+        payload["price"].toDouble(), payload["stock"].toInt(),
+        payload["imagePath"].toString()
+        );
+    response["status"] = success ? "success" : "error";
+    if(!success) response["message"] = "Failed to update product (e.g., product not found).";
+    return response;
+}
+
+QJsonObject ClientSession::handleSetCategoryDiscount(const QJsonObject &payload) {
+    QJsonObject response;
+    // Typically an admin/platform function, but requirements imply merchant might do it.
+    // Let's assume any merchant can for now, as per project scope (role checked by the registry).
+    m_productManager_s->setCategoryDiscount(
+        payload["category"].toString(),
+        payload["discount"].toDouble() // Expect 0.0 to 1.0
+        );
+    response["status"] = "success"; // This action usually succeeds unless input is invalid
+    return response;
+}
+
+QJsonObject ClientSession::handleGetCart(const QJsonObject &payload) {
+    QJsonObject response;
+    QVariantList cartItems = m_shoppingCartManager_s->getCartItems(m_loggedInUsername);
+    QJsonObject data;
+    data["items"] = QJsonArray::fromVariantList(cartItems);
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+quint64 ClientSession::productIdFrom(const QJsonObject& payload) const {
+    if (payload.contains("productId")) return quint64(payload["productId"].toInteger());
+    Product* product = m_productManager_s->findProductByNameAndMerchant(payload["productName"].toString(),
+                                                                      payload["merchantUsername"].toString());
+    return product ? product->getId() : 0;
+}
+
+QJsonObject ClientSession::handleAddToCart(const QJsonObject &payload) {
+    QJsonObject response;
+    bool success = m_shoppingCartManager_s->addItem(
+        m_loggedInUsername,
+        productIdFrom(payload),
+        payload["quantity"].toInt()
+        );
+    response["status"] = success ? "success" : "error";
+    if(!success) response["message"] = "Failed to add to cart (e.g. stock issue, product not found).";
+    return response;
+}
+
+QJsonObject ClientSession::handleRemoveFromCart(const QJsonObject &payload) {
+    QJsonObject response;
+    bool success = m_shoppingCartManager_s->removeItem(
+        m_loggedInUsername,
+        productIdFrom(payload)
+        );
+    response["status"] = success ? "success" : "error";
+    if(!success) response["message"] = "Failed to remove from cart.";
+    return response;
+}
+
+QJsonObject ClientSession::handleUpdateCartQuantity(const QJsonObject &payload) {
+    QJsonObject response;
+    bool success = m_shoppingCartManager_s->updateQuantity(
+        m_loggedInUsername,
+        productIdFrom(payload),
+        payload["newQuantity"].toInt()
+        );
+    response["status"] = success ? "success" : "error";
+    if(!success) response["message"] = "Failed to update cart quantity (e.g. stock issue).";
+    return response;
+}
+
+
+QJsonObject ClientSession::handlePrepareOrder(const QJsonObject &payload) {
+    QJsonObject response;
+    QJsonArray itemsDataJson = payload["itemsData"].toArray();
+    QVariantList itemsData;
+    for(const QJsonValue& val : itemsDataJson){
+        itemsData.append(val.toObject().toVariantMap());
+    }
+
+    QVariantMap orderResult = m_orderManager_s->prepareOrder(m_loggedInUsername, itemsData);
+
+    if (orderResult.value("success", false).toBool()) {
+        response["status"] = "success";
+        response["data"] = QJsonObject::fromVariantMap(orderResult["orderData"].toMap());
+    } else {
+        response["status"] = "error";
+        response["message"] = orderResult.value("message", "Failed to prepare order.").toString();
+    }
+    return response;
+}
+
+QJsonObject ClientSession::handlePayOrder(const QJsonObject &payload) {
+    QJsonObject response;
+    QString orderId = payload["orderId"].toString();
+    QVariantMap paymentResult = m_orderManager_s->payOrder(m_loggedInUsername, orderId);
+
+    if (paymentResult.value("success", false).toBool()) {
+        response["status"] = "success";
+        QJsonObject data;
+        data["newBalance"] = paymentResult.value("newBalance", m_authManager_s->getBalance(m_loggedInUsername)).toDouble();
+        response["data"] = data;
+        // Server-side OrderManager should also clear the cart after successful payment.
+    } else {
+        response["status"] = "error";
+        response["message"] = paymentResult.value("message", "Payment failed.").toString();
+    }
+    return response;
+}
+
+QJsonObject ClientSession::handleGetOrders(const QJsonObject &payload) {
+    const int limit = pageLimit(payload);
+    QJsonObject position;
+    if (!decodeCursor(payload, "orders", &position)) return invalidCursor();
+    ServerOrderManager::OrderCursor after;
+    after.createdMs = position["t"].toInteger();
+    after.orderId = position["id"].toString();
+    ServerOrderManager::OrderCursor next;
+    int total = 0;
+    QJsonObject response;
+    QVariantList orders = m_orderManager_s->getOrdersForUser(m_loggedInUsername, limit, after, &total, &next);
+    QJsonObject data;
+    data["orders"] = QJsonArray::fromVariantList(orders);
+    data["total"] = total;
+    if (!next.orderId.isEmpty()) data["nextCursor"] = encodeCursor("orders", QJsonObject{{"t", next.createdMs}, {"id", next.orderId}});
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+// 客户端主题名 -> 订阅表中的主题；"cart"、"orders" 绑定到当前登录的用户
+QString ClientSession::resolveTopic(const QString& topic, QString* error) const {
+    if (topic == "catalog" || topic == "discount") return topic;
+    if (topic.startsWith("discount:") && topic.size() > 9) return topic;
+    if (topic == "cart" || topic == "orders") {
+        if (m_loggedInUsername.isEmpty()) {
+            *error = "Not logged in, cannot subscribe to " + topic + ".";
+            return QString();
+        }
+        return topic + ":" + m_loggedInUsername;
+    }
+    *error = "Unknown topic: " + topic;
+    return QString();
+}
+
+QJsonObject ClientSession::handleSubscribe(const QJsonObject& payload) {
+    QJsonObject response;
+    QJsonArray topics = payload["topics"].toArray();
+    QStringList resolved;
+    for (const QJsonValue& value : topics) {
+        QString error;
+        QString topic = resolveTopic(value.toString(), &error);
+        if (topic.isEmpty()) { // 全部检查通过才订阅，不留下半成功的状态
+            response["status"] = "error";
+            response["message"] = error;
+            return response;
+        }
+        resolved.append(topic);
+    }
+    for (const QString& topic : std::as_const(resolved)) {
+        if (!m_eventHub->subscribe(topic, m_pushChannel)) break; // 连接已断开
+    }
+    QJsonObject data;
+    data["topics"] = topics;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
+
+QJsonObject ClientSession::handleUnsubscribe(const QJsonObject& payload) {
+    QJsonObject response;
+    QJsonArray topics = payload["topics"].toArray();
+    if (topics.isEmpty()) {
+        m_eventHub->unsubscribeAll(m_pushChannel.get());
+    }
+    for (const QJsonValue& value : topics) {
+        QString error;
+        QString topic = resolveTopic(value.toString(), &error);
+        if (!topic.isEmpty()) m_eventHub->unsubscribe(topic, m_pushChannel.get());
+    }
+    QJsonObject data;
+    data["topics"] = topics;
+    response["status"] = "success";
+    response["data"] = data;
+    return response;
+}
@@ -0,0 +1,197 @@
+#ifndef CLIENTSESSION_H
+#define CLIENTSESSION_H
+
+#include <QJsonObject>
+#include <QQueue>
+#include <functional>
+#include <memory>
+#include "wireprotocol.h"
+#include "actionregistry.h"
+#include "admissioncontrol.h"
+#include "sharding.h"
+
+class ServerAuthManager;
+class ServerProductManager;
+class ServerShoppingCartManager;
+class ServerOrderManager;
+class QThreadPool;
+class EventHub;
+class PushChannel;
+class SessionStore;
+class CatalogCache;
+
+// 响应压缩参数，连接通过 hello 协商后生效
+struct CompressionConfig {
+    int threshold = 1024; // 编码后达到这个字节数的帧才尝试压缩；<= 0 表示不提供压缩
+    int level = 6;        // zlib 压缩级别 1-9，越大越省带宽、越费 CPU
+};
+
+// 所有连接共享的服务器端对象
+struct ServerContext {
+    ServerAuthManager* authManager;
+    ServerProductManager* productManager;
+    ServerShoppingCartManager* shoppingCartManager;
+    ServerOrderManager* orderManager;
+    QThreadPool* requestPool; // 请求在这里执行，网络线程只负责收发
+    AdmissionControl* admission;
+    EventHub* eventHub; // 服务器推送的订阅表
+    SessionStore* sessions; // 登录令牌，断线重连后凭令牌恢复登录
+    CatalogCache* catalogCache; // getProducts 回复数据按目录版本缓存，连同各编码的序列化结果
+    CompressionConfig compression;
+    ShardConfig shard; // 本进程是分片之一时的编号与共享密钥
+    bool readOnlyReplica = false; // 目录只读副本：只回答只读请求和订阅
+};
+
+// 一个客户端连接的协议与会话状态：分帧、编解码、准入、请求分发和各 action 的处理。
+// 不依赖具体的网络实现，收发通过 Transport 完成（Qt 的 ClientHandler 和 epoll 后端各实现一份）。
+// 除 processMessage 及各 handle* 在请求线程池中执行外，其余方法都只在会话所属的网络线程调用。
+class ClientSession {
+public:
+    class Transport {
+    public:
+        virtual ~Transport() = default;
+        virtual void writeData(const QByteArray& data) = 0;   // 已分帧的数据
+        virtual void post(std::function<void()> task) = 0;   // 任意线程调用，task 在会话线程执行
+        virtual void abortConnection() = 0;                  // 协议错误，立即断开
+        virtual void sessionFinished() = 0;                  // close() 之后最后一个在途请求也已完成，可以销毁
+    };
+
+    ClientSession(Transport* transport, const ServerContext& context);
+
+    // 本进程内单调递增的连接编号，用于日志和按连接的统计项。
+    // 不用 socket 描述符：连接关闭后会话要等在途请求完成才销毁，描述符可能已被新连接复用
+    quint64 id() const { return m_id; }
+
+    void feed(const QByteArray& data);    // 收到的字节流
+    void setInputPaused(bool paused);     // 发送积压时暂停处理新请求；恢复时继续处理已缓冲的帧
+    bool isInputPaused() const { return m_inputPaused; }
+    void close();                         // 连接已断开
+
+    // 登记过的 action 返回其编号（哈希命中后还核对了名字），未知的返回 ActionId::Invalid。
+    // 路由器等其他按编号分发的地方用它，哈希碰撞的未知名字不会走某个 action 的分支
+    static quint32 actionId(const QString& action);
+
+private:
+    const quint64 m_id;
+    Transport* m_transport;
+    bool m_inputPaused = false;
+    QString m_loggedInUsername; // Track user for this connection (only touched by serial requests)
+    QString m_loggedInUserType; // 登录时缓存，权限检查不再每次读用户文件
+
+    // Pointers to server-wide manager instances
+    ServerAuthManager* m_authManager_s;
+    ServerProductManager* m_productManager_s;
+    ServerShoppingCartManager* m_shoppingCartManager_s;
+    ServerOrderManager* m_orderManager_s;
+    QThreadPool* m_requestPool;
+    AdmissionControl* m_admission;
+    TokenBucket m_connectionBucket;
+    QString m_sessionUser; // m_loggedInUsername 在本线程的副本，只在没有串行请求执行时同步，供限流使用
+    EventHub* m_eventHub;
+    std::shared_ptr<PushChannel> m_pushChannel; // 订阅的事件经它回到本线程发出
+    SessionStore* m_sessions;
+    CatalogCache* m_catalogCache;
+    ShardConfig m_shard;
+    bool m_readOnlyReplica;
+
+    // 异步处理函数完成时调用，参数与同步处理函数的返回值相同；可以在任意线程调用，只能调用一次
+    using Reply = std::function<void(const QJsonObject& responsePayload)>;
+
+    // 一个 action 的分发信息：哈希编号、身份要求、是否只读、优先级和处理函数
+    struct ActionSpec {
+        quint32 id;
+        const char* name;
+        ActionRole role;
+        bool readOnly;
+        ActionPriority priority;
+        QJsonObject (ClientSession::*handler)(const QJsonObject& payload); // hello 为空，由 processHello 处理
+        // 要等其他线程池（密码哈希）的 action：请求线程提交后立即返回，不占着线程等结果；此时 handler 为空
+        void (ClientSession::*asyncHandler)(const QJsonObject& payload, Reply reply) = nullptr;
+    };
+    static const ActionSpec s_actions[];
+    static const ActionSpec* findAction(const QString& action); // 未知 action 返回空
+
+    struct PendingRequest {
+        QJsonObject request;
+        const ActionSpec* spec; // 未知 action 时为空
+    };
+
+    // 流水线执行状态（只在会话线程访问）
+    QQueue<PendingRequest> m_serialQueue; // 等待执行的、依赖用户状态的请求
+    bool m_serialBusy = false;
+    int m_inFlight = 0;                // 已提交到线程池、尚未回复的请求数
+    bool m_closing = false;            // 连接已断开，等 m_inFlight 归零后销毁
+
+    FrameReader m_reader; // Buffer for incoming data, also tracks this connection's framing
+    WireProtocol::Encoding m_encoding = WireProtocol::Encoding::Json;
+    WireProtocol::Compression m_compression = WireProtocol::Compression::None;
+    CompressionConfig m_compressionConfig;
+
+    static bool isConcurrentAction(const ActionSpec* spec);
+    void dispatchRequest(const QJsonObject& request);
+    void startNextSerial();
+    void startRequest(const PendingRequest& pending, bool serial);
+    void onRequestFinished(const QJsonObject& response, bool serial);
+    void processHello(const QJsonObject& request);
+    AdmissionControl::Verdict admit(const QJsonObject& request, const ActionSpec* spec, bool serial);
+
+    // 执行一个请求并生成完整的响应：先按 spec 做身份检查，再调用处理函数。
+    // 异步 action 的 done 在完成它的线程中调用；同步版本会等它完成（batch 里的子请求）
+    void processMessage(const QJsonObject& request, const ActionSpec* spec, std::function<void(const QJsonObject&)> done);
+    QJsonObject processMessage(const QJsonObject& request, const ActionSpec* spec);
+    QJsonObject processMessage(const QJsonObject& request) { return processMessage(request, findAction(request["action"].toString())); }
+    bool checkAccess(const ActionSpec& spec, QJsonObject* errorPayload) const;
+    static QJsonObject buildResponse(const QJsonObject& request, const QJsonObject& responsePayload);
+    void sendResponse(const QJsonObject& response);
+    void processFrames();
+
+    // "hello": 协商本连接的分帧方式与消息编码，回复之后才切换
+    QJsonObject handleHello(const QJsonObject& payload, WireProtocol::Framing* framing, WireProtocol::Encoding* encoding,
+                            WireProtocol::Compression* compression);
+    QJsonObject handleServerStats(const QJsonObject& payload);
+    QJsonObject handleBatch(const QJsonObject& payload);
+    // "subscribe"/"unsubscribe": {"topics": ["catalog", "discount:图书", "cart", "orders", ...]}
+    QJsonObject handleSubscribe(const QJsonObject& payload);
+    // "catalogSnapshot": 全量目录与版本号（副本先订阅 "catalog" 再取快照）；"catalogVersion": 只取版本号，副本用来计算延迟
+    QJsonObject handleCatalogSnapshot(const QJsonObject& payload);
+    QJsonObject handleCatalogVersion(const QJsonObject& payload);
+    QJsonObject handleUnsubscribe(const QJsonObject& payload);
+    QString resolveTopic(const QString& topic, QString* error) const;
+
+    // 分片之间的内部请求，都要带上共享密钥：
+    // "shardAuth"   {secret, username, userType} 路由器把已在主分片登录的用户带到本分片（商品写操作、读目录）
+    // "shardCredit" {secret, username, cents, key} 其他分片的发件箱为本分片商家入账，按 key 去重
+    QJsonObject handleShardAuth(const QJsonObject& payload);
+    QJsonObject handleShardCredit(const QJsonObject& payload);
+    bool checkShardSecret(const QJsonObject& payload, QJsonObject* errorPayload) const;
+
+    // 登录、注册、改密码在 ServerAuthManager 的哈希线程池中完成，完成后仍在那个线程回复
+    void handleLogin(const QJsonObject& payload, Reply reply);
+    // "resume" {token}: 断线重连后凭登录时发放的令牌恢复登录状态；"logout" {token}: 作废令牌并退出
+    QJsonObject handleResume(const QJsonObject& payload);
+    QJsonObject handleLogout(const QJsonObject& payload);
+    void setLoggedInUser(const QString& username, const QString& userType); // 切换本连接的用户
+    void handleRegister(const QJsonObject& payload, Reply reply);
+    void handleChangePassword(const QJsonObject& payload, Reply reply);
+    QJsonObject handleRecharge(const QJsonObject& payload);
+    QJsonObject handleGetBalance(const QJsonObject& payload);
+
+    QJsonObject handleGetProducts(const QJsonObject& payload);
+    QJsonObject handleSearchProducts(const QJsonObject& payload);
+    QJsonObject handleAddProduct(const QJsonObject& payload);
+    QJsonObject handleUpdateProduct(const QJsonObject& payload);
+    QJsonObject handleSetCategoryDiscount(const QJsonObject& payload);
+
+    // 请求中的商品：优先用 productId；旧客户端只给 productName + merchantUsername 时查名称索引换成 ID（找不到为 0）
+    quint64 productIdFrom(const QJsonObject& payload) const;
+    QJsonObject handleGetCart(const QJsonObject& payload);
+    QJsonObject handleAddToCart(const QJsonObject& payload);
+    QJsonObject handleRemoveFromCart(const QJsonObject& payload);
+    QJsonObject handleUpdateCartQuantity(const QJsonObject& payload);
+
+    QJsonObject handlePrepareOrder(const QJsonObject& payload);
+    QJsonObject handlePayOrder(const QJsonObject& payload);
+    QJsonObject handleGetOrders(const QJsonObject& payload);
+};
+
+#endif // CLIENTSESSION_H
@@ -0,0 +1,82 @@
+#include "credentialhasher.h"
+#include "servermetrics.h"
+#include <QCryptographicHash>
+#include <QPasswordDigestor>
+#include <QRandomGenerator>
+#include <QStringList>
+
+static const char* const Scheme = "pbkdf2-sha256";
+static const int SaltBytes = 16;
+static const int KeyBytes = 32;
+
+static QByteArray deriveKey(const QString& password, const QByteArray& salt, int iterations) {
+    return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, password.toUtf8(), salt, iterations, KeyBytes);
+}
+
+// 比较时间与内容无关，不泄露前缀匹配了多少字节
+static bool constantTimeEquals(const QByteArray& a, const QByteArray& b) {
+    if (a.size() != b.size()) return false;
+    quint8 diff = 0;
+    for (qsizetype i = 0; i < a.size(); ++i) diff |= quint8(a[i]) ^ quint8(b[i]);
+    return diff == 0;
+}
+
+CredentialHasher::CredentialHasher() {
+    m_pool.setMaxThreadCount(DefaultThreads);
+}
+
+CredentialHasher::~CredentialHasher() {
+    m_pool.waitForDone();
+}
+
+void CredentialHasher::setThreads(int threads) {
+    m_pool.setMaxThreadCount(qMax(1, threads));
+}
+
+void CredentialHasher::setIterations(int iterations) {
+    m_iterations.store(qMax(1000, iterations));
+}
+
+bool CredentialHasher::submit(std::function<void()> task) {
+    const int limit = m_pool.maxThreadCount() * QueuedPerThread;
+    if (m_queued.fetch_add(1) >= limit) {
+        m_queued.fetch_sub(1);
+        ServerMetrics::instance().increment("hashRejected");
+        return false;
+    }
+    ServerMetrics::instance().setGauge("hashQueued", m_queued.load());
+    m_pool.start([this, task = std::move(task)]() {
+        task();
+        ServerMetrics::instance().setGauge("hashQueued", m_queued.fetch_sub(1) - 1);
+    });
+    return true;
+}
+
+QString CredentialHasher::hash(const QString& password) const {
+    QByteArray salt(SaltBytes, Qt::Uninitialized);
+    QRandomGenerator::system()->generate(reinterpret_cast<quint32*>(salt.data()),
+                                         reinterpret_cast<quint32*>(salt.data() + SaltBytes));
+    const int iterations = m_iterations.load();
+    return QStringList{QString::fromLatin1(Scheme), QString::number(iterations), QString::fromLatin1(salt.toBase64()),
+                       QString::fromLatin1(deriveKey(password, salt, iterations).toBase64())}.join('$');
+}
+
+bool CredentialHasher::verify(const QString& stored, const QString& password) const {
+    const QStringList parts = stored.split('$');
+    if (parts.size() != 4) {
+        // 旧格式：无盐 SHA-256 的十六进制
+        const QByteArray legacy = QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Sha256).toHex();
+        return constantTimeEquals(legacy, stored.toLatin1());
+    }
+    bool ok = false;
+    const int iterations = parts[1].toInt(&ok);
+    if (parts[0] != QLatin1String(Scheme) || !ok || iterations <= 0) return false;
+    const QByteArray salt = QByteArray::fromBase64(parts[2].toLatin1());
+    const QByteArray expected = QByteArray::fromBase64(parts[3].toLatin1());
+    return constantTimeEquals(deriveKey(password, salt, iterations), expected);
+}
+
+bool CredentialHasher::needsUpgrade(const QString& stored) const {
+    const QStringList parts = stored.split('$');
+    return parts.size() != 4 || parts[0] != QLatin1String(Scheme) || parts[1].toInt() < m_iterations.load();
+}
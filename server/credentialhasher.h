@@ -0,0 +1,42 @@
+#ifndef CREDENTIALHASHER_H
+#define CREDENTIALHASHER_H
+
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+
+// 密码哈希：PBKDF2-HMAC-SHA256，每个用户随机盐，迭代次数可调。
+// 慢哈希只在这里自己的有界线程池中计算，登录高峰不会占满请求线程池，浏览等请求照常执行。
+// 存储格式 "pbkdf2-sha256$<迭代次数>$<盐 base64>$<哈希 base64>"；
+// 旧的无盐 SHA-256 十六进制哈希仍能验证，验证通过后 needsUpgrade() 为真，由调用方按当前参数重新哈希并写回。
+class CredentialHasher {
+public:
+    static constexpr int DefaultIterations = 100000;
+    static constexpr int DefaultThreads = 2;
+
+    CredentialHasher();
+    ~CredentialHasher();
+
+    void setThreads(int threads);
+    void setIterations(int iterations);
+    int iterations() const { return m_iterations.load(); }
+
+    // 把任务放进哈希线程池；排队的任务太多（登录洪水）时返回 false，调用方应回复服务器忙
+    bool submit(std::function<void()> task);
+    void waitForDone() { m_pool.waitForDone(); }
+
+    // 以下在调用线程计算，只应在 submit 的任务里调用
+    QString hash(const QString& password) const;
+    bool verify(const QString& stored, const QString& password) const;
+    bool needsUpgrade(const QString& stored) const; // 旧格式或迭代次数低于当前设置
+
+private:
+    static constexpr int QueuedPerThread = 64;
+
+    QThreadPool m_pool;
+    std::atomic<int> m_iterations{DefaultIterations};
+    std::atomic<int> m_queued{0}; // 已提交、尚未完成的任务
+};
+
+#endif // CREDENTIALHASHER_H
@@ -0,0 +1,187 @@
+#include "creditoutbox.h"
+#include "filemanager.h"
+#include "servermetrics.h"
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QSet>
+#include <QDebug>
+
+// 文件每行一条 JSON：{"entries": [{key, user, cents}, ...]} 为一次支付写入的一组记录，{"done": key} 为已送达。
+// 一组记录写在同一行，只写了一半的行解析失败被跳过，不会出现只生效一部分的支付
+static QString outboxFile() {
+    return FileManager::dataDirectory() + QLatin1String("credit.outbox");
+}
+
+static QByteArray entriesLine(const QList<CreditOutbox::Entry>& entries) {
+    QJsonArray array;
+    for (const CreditOutbox::Entry& e : entries) {
+        QJsonObject obj;
+        obj["key"] = e.key;
+        obj["user"] = e.username;
+        obj["cents"] = e.cents;
+        array.append(obj);
+    }
+    return QJsonDocument(QJsonObject{{"entries", array}}).toJson(QJsonDocument::Compact) + '\n';
+}
+
+CreditOutbox::CreditOutbox() {
+    setObjectName("credit-outbox");
+}
+
+CreditOutbox::~CreditOutbox() {
+    stop();
+}
+
+void CreditOutbox::load() {
+    QMutexLocker locker(&m_mutex);
+    m_pending.clear();
+    QFile file(outboxFile());
+    if (file.open(QIODevice::ReadOnly)) {
+        while (!file.atEnd()) {
+            const QJsonObject record = QJsonDocument::fromJson(file.readLine()).object();
+            if (record.contains("done")) {
+                const QString key = record["done"].toString();
+                m_pending.removeIf([&key](const Entry& e) { return e.key == key; });
+                continue;
+            }
+            for (const QJsonValue& value : record["entries"].toArray()) {
+                const QJsonObject obj = value.toObject();
+                m_pending.append(Entry{obj["key"].toString(), obj["user"].toString(), obj["cents"].toInteger()});
+            }
+        }
+        file.close();
+    }
+    // 只保留未送达的记录（同时去掉可能写了一半的最后一行），之后在末尾追加
+    QSaveFile rewritten(outboxFile());
+    if (!rewritten.open(QIODevice::WriteOnly) || (!m_pending.isEmpty() && rewritten.write(entriesLine(m_pending)) < 0)
+        || !rewritten.commit()) {
+        qWarning() << "CreditOutbox: Cannot rewrite" << rewritten.fileName() << rewritten.errorString();
+    }
+    m_file.setFileName(outboxFile());
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "CreditOutbox: Cannot open" << m_file.fileName() << m_file.errorString();
+    }
+    ServerMetrics::instance().setGauge("creditOutboxPending", m_pending.size());
+    if (!m_pending.isEmpty()) qInfo() << "CreditOutbox:" << m_pending.size() << "cross-shard credits still to deliver.";
+}
+
+void CreditOutbox::start(const ShardConfig& config) {
+    m_shard = config;
+    if (!m_shard.enabled()) {
+        if (pendingCount() > 0) qWarning() << "CreditOutbox: Undelivered cross-shard credits, but sharding is not configured.";
+        return;
+    }
+    QThread::start(QThread::LowPriority);
+}
+
+void CreditOutbox::stop() {
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wakeup.wakeAll();
+    }
+    requestInterruption(); // 正在投递的一轮不再继续后面的记录
+    wait();
+}
+
+int CreditOutbox::pendingCount() {
+    QMutexLocker locker(&m_mutex);
+    return int(m_pending.size());
+}
+
+bool CreditOutbox::appendLines(const QByteArray& data) {
+    return m_file.isOpen() && m_file.write(data) == data.size() && m_file.flush();
+}
+
+bool CreditOutbox::enqueue(const QList<Entry>& entries) {
+    if (entries.isEmpty()) return true;
+    const QByteArray line = entriesLine(entries);
+    QMutexLocker locker(&m_mutex);
+    if (!appendLines(line)) {
+        qWarning() << "CreditOutbox: Cannot write" << m_file.fileName() << m_file.errorString();
+        // 文件末尾可能留下半行：按内存中的记录重写，后面追加的行才能正常解析
+        QSaveFile rewritten(outboxFile());
+        if (rewritten.open(QIODevice::WriteOnly) && (m_pending.isEmpty() || rewritten.write(entriesLine(m_pending)) >= 0)
+            && rewritten.commit()) {
+            m_file.close();
+            m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+        }
+        return false;
+    }
+    m_pending.append(entries);
+    ServerMetrics::instance().setGauge("creditOutboxPending", m_pending.size());
+    m_wakeup.wakeOne();
+    return true;
+}
+
+void CreditOutbox::markDelivered(const QString& key) {
+    // 完成记录写不进去也没关系：重启后重发一次，接收方按键去重
+    appendLines(QJsonDocument(QJsonObject{{"done", key}}).toJson(QJsonDocument::Compact) + '\n');
+    m_pending.removeIf([&key](const Entry& e) { return e.key == key; });
+    m_retryAtMs.remove(key);
+    m_retryDelayMs.remove(key);
+    if (m_pending.isEmpty()) { // 全部送达，文件从头开始
+        m_file.close();
+        m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+}
+
+void CreditOutbox::run() {
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping) {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        QList<Entry> due;
+        qint64 nextRetry = -1;
+        for (const Entry& e : std::as_const(m_pending)) {
+            const qint64 at = m_retryAtMs.value(e.key, 0);
+            if (at <= now) {
+                due.append(e);
+            } else if (nextRetry < 0 || at < nextRetry) {
+                nextRetry = at;
+            }
+        }
+        if (due.isEmpty()) {
+            m_wakeup.wait(&m_mutex, nextRetry < 0 ? QDeadlineTimer(QDeadlineTimer::Forever) : QDeadlineTimer(nextRetry - now));
+            continue;
+        }
+
+        // 投递时不持锁：每次投递是一次阻塞的网络往返，支付线程照常写入新记录。
+        // 同一轮中连不上的分片，发往它的其余记录直接推迟，不再逐条等超时
+        locker.unlock();
+        QStringList delivered;
+        QStringList failed;
+        QSet<int> unreachable;
+        for (const Entry& e : std::as_const(due)) {
+            const int home = Sharding::shardOf(e.username, m_shard.count);
+            bool ok = false;
+            if (home < m_shard.shards.size() && !unreachable.contains(home)) {
+                ok = Sharding::deliverCredit(m_shard.shards[home], m_shard.secret, e.username, e.cents, e.key);
+            } else if (home >= m_shard.shards.size()) {
+                qWarning() << "CreditOutbox: No address for shard" << home << "of user" << e.username;
+            }
+            if (ok) {
+                delivered.append(e.key);
+            } else {
+                unreachable.insert(home);
+                failed.append(e.key);
+            }
+            if (isInterruptionRequested()) break;
+        }
+        locker.relock();
+
+        for (const QString& key : std::as_const(delivered)) markDelivered(key);
+        const qint64 later = QDateTime::currentMSecsSinceEpoch();
+        for (const QString& key : std::as_const(failed)) {
+            const int delay = qMin(MaxRetryMs, qMax(MinRetryMs, m_retryDelayMs.value(key) * 2));
+            m_retryDelayMs.insert(key, delay);
+            m_retryAtMs.insert(key, later + delay);
+        }
+        if (!delivered.isEmpty()) ServerMetrics::instance().increment("creditOutboxDelivered", delivered.size());
+        if (!failed.isEmpty()) ServerMetrics::instance().increment("creditOutboxRetries", failed.size());
+        ServerMetrics::instance().setGauge("creditOutboxPending", m_pending.size());
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef CREDITOUTBOX_H
+#define CREDITOUTBOX_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QList>
+#include <QHash>
+#include "sharding.h"
+
+// 跨分片入账的发件箱：支付时其他分片上商家的入账先追加到本地 credit.outbox，写入成功支付才算完成；
+// 之后由后台线程逐条送到商家所在的分片，请求线程和订单锁都不等网络。
+// 每条记录带幂等键（订单号/商家），接收方账本按键去重，所以超时重发、进程重启后重发都不会重复入账。
+// 送达后追加一条完成记录；全部送达时清空文件（重新分片要求各分片的发件箱为空）。
+// 指标：creditOutboxPending（未送达条数）、creditOutboxDelivered、creditOutboxRetries。
+class CreditOutbox : public QThread {
+public:
+    struct Entry {
+        QString key;      // 幂等键，接收方据此去重
+        QString username; // 商家，属于另一个分片
+        qint64 cents;
+    };
+
+    CreditOutbox();
+    ~CreditOutbox() override;
+
+    void load();                          // 启动时调用一次，读回尚未送达的记录
+    void start(const ShardConfig& config); // 开始投递；不分片时不启动线程
+    void stop();                          // 停止投递线程（未送达的记录留在文件里，下次启动继续）
+
+    // 一次写入一组记录（全部落盘或全部不生效），线程安全
+    bool enqueue(const QList<Entry>& entries);
+    int pendingCount();
+
+protected:
+    void run() override;
+
+private:
+    static constexpr int MinRetryMs = 1000;
+    static constexpr int MaxRetryMs = 30 * 1000;
+
+    bool appendLines(const QByteArray& data); // 持有 m_mutex
+    void markDelivered(const QString& key);
+
+    ShardConfig m_shard;
+    QMutex m_mutex; // 保护以下成员
+    QWaitCondition m_wakeup;
+    QFile m_file;
+    QList<Entry> m_pending; // 按写入顺序
+    QHash<QString, qint64> m_retryAtMs; // 投递失败的记录下次重试的时间
+    QHash<QString, int> m_retryDelayMs;
+    bool m_stopping = false;
+};
+
+#endif // CREDITOUTBOX_H
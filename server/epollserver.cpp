@@ -0,0 +1,411 @@
+#include "epollserver.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QThread>
+#include <QMutex>
+#include <QDebug>
+#include <QHash>
+#include <QSet>
+#include "servermetrics.h"
+#include "outputqueue.h"
+#include "logcategories.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+// 与 Qt 后端一致的背压阈值
+static const qint64 HighWaterMark = OutputQueue::DefaultHighWaterMark;
+static const qint64 LowWaterMark = OutputQueue::DefaultLowWaterMark;
+static const int ReadChunkSize = 64 * 1024;
+static const int MaxReadsPerEvent = 4;   // 单个连接每次最多读这么多块，避免饿死同线程的其他连接
+static const int MaxEventsPerWait = 256;
+
+// epoll_event.data.ptr 用这两个地址区分监听 socket 和唤醒用的 eventfd
+static char ListenTag;
+static char WakeTag;
+
+class EpollConnection;
+
+class EpollLoop : public QThread {
+public:
+    EpollLoop(EpollServer* server, int index);
+    ~EpollLoop();
+
+    bool init(int listenFd, QString* errorString);
+    void post(std::function<void()> task); // 任意线程调用
+    void requestStop();
+
+    // 以下只在本循环线程调用
+    void markDirty(EpollConnection* conn);
+    void updateInterest(EpollConnection* conn);
+    void closeConnection(EpollConnection* conn);
+    void scheduleDelete(EpollConnection* conn);
+    EpollServer* server() const { return m_server; }
+
+protected:
+    void run() override;
+
+private:
+    void acceptAll();
+    void runTasks();
+    void handleRead(EpollConnection* conn);
+    void flush(EpollConnection* conn);
+
+    EpollServer* m_server;
+    int m_epollFd = -1;
+    int m_wakeFd = -1;
+    int m_listenFd = -1;
+    std::atomic<bool> m_stopping{false};
+
+    QMutex m_taskMutex;
+    std::vector<std::function<void()>> m_tasks;
+
+    QSet<EpollConnection*> m_connections;
+    std::vector<EpollConnection*> m_dirty;
+    std::vector<EpollConnection*> m_finished;
+};
+
+// 一个 epoll 连接：socket 描述符、发送缓冲和它的 ClientSession
+class EpollConnection : private ClientSession::Transport {
+public:
+    EpollConnection(int fd, EpollLoop* loop, const ServerContext& context)
+        : fd(fd), loop(loop), session(this, context) {}
+
+    qint64 pendingBytes() const { return out.size() - outPos; }
+
+    int fd;
+    EpollLoop* loop;
+    ClientSession session;
+    QByteArray out;          // 待发送数据，outPos 之前的部分已写出
+    qsizetype outPos = 0;
+    bool dirty = false;      // 本轮事件处理结束时需要 flush
+    bool wantWrite = false;  // 内核发送缓冲已满，在等 EPOLLOUT
+    bool readPaused = false; // 发送积压超过高水位
+    bool closed = false;
+
+private:
+    friend class EpollLoop;
+
+    void writeData(const QByteArray& data) override {
+        if (closed) return;
+        out.append(data);
+        loop->markDirty(this); // 同一轮产生的多条响应一次 send() 发出
+        if (!readPaused && pendingBytes() > HighWaterMark) {
+            readPaused = true;
+            session.setInputPaused(true);
+            loop->updateInterest(this);
+            ServerMetrics::instance().increment("readPauses");
+        }
+    }
+    void post(std::function<void()> task) override { loop->post(std::move(task)); }
+    void abortConnection() override { loop->closeConnection(this); }
+    void sessionFinished() override { loop->scheduleDelete(this); }
+};
+
+EpollLoop::EpollLoop(EpollServer* server, int index) : m_server(server) {
+    setObjectName(QStringLiteral("epoll-%1").arg(index));
+}
+
+EpollLoop::~EpollLoop() {
+    // 线程已退出；剩下的连接直接关闭，没有执行中的请求会再回调它们
+    for (EpollConnection* conn : std::as_const(m_connections)) {
+        if (!conn->closed) ::close(conn->fd);
+        delete conn;
+    }
+    if (m_wakeFd >= 0) ::close(m_wakeFd);
+    if (m_epollFd >= 0) ::close(m_epollFd);
+}
+
+bool EpollLoop::init(int listenFd, QString* errorString) {
+    m_listenFd = listenFd;
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_wakeFd < 0) {
+        *errorString = QString("epoll/eventfd: %1").arg(strerror(errno));
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &WakeTag;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev) < 0) {
+        *errorString = QString("epoll_ctl(eventfd): %1").arg(strerror(errno));
+        return false;
+    }
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = &ListenTag;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &ev) < 0) {
+        *errorString = QString("epoll_ctl(listen): %1").arg(strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void EpollLoop::post(std::function<void()> task) {
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&m_taskMutex);
+        wasEmpty = m_tasks.empty();
+        m_tasks.push_back(std::move(task));
+    }
+    // 队列本来非空时，之前的唤醒还没被处理，不必再写 eventfd
+    if (wasEmpty) {
+        quint64 one = 1;
+        ssize_t n = ::write(m_wakeFd, &one, sizeof(one));
+        Q_UNUSED(n);
+    }
+}
+
+void EpollLoop::requestStop() {
+    m_stopping.store(true);
+    quint64 one = 1;
+    ssize_t n = ::write(m_wakeFd, &one, sizeof(one));
+    Q_UNUSED(n);
+}
+
+void EpollLoop::run() {
+    epoll_event events[MaxEventsPerWait];
+    while (!m_stopping.load()) {
+        int n = epoll_wait(m_epollFd, events, MaxEventsPerWait, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            qCritical() << "EpollLoop: epoll_wait failed:" << strerror(errno);
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == &ListenTag) {
+                acceptAll();
+            } else if (tag == &WakeTag) {
+                quint64 value;
+                ssize_t r = ::read(m_wakeFd, &value, sizeof(value));
+                Q_UNUSED(r);
+            } else {
+                // 同一批事件里前面可能已经关闭了它；对象要等到本轮结束才会释放
+                EpollConnection* conn = static_cast<EpollConnection*>(tag);
+                if (conn->closed) continue;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) handleRead(conn);
+                if (!conn->closed && (events[i].events & EPOLLOUT)) flush(conn);
+            }
+        }
+        runTasks();
+
+        // 本轮所有响应都已进入发送缓冲，每个连接只 send 一次
+        std::vector<EpollConnection*> dirty;
+        dirty.swap(m_dirty);
+        for (EpollConnection* conn : dirty) {
+            conn->dirty = false;
+            if (!conn->closed) flush(conn);
+        }
+        for (EpollConnection* conn : m_finished) {
+            m_connections.remove(conn);
+            delete conn;
+        }
+        m_finished.clear();
+    }
+}
+
+void EpollLoop::acceptAll() {
+    while (true) {
+        int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                qWarning() << "EpollLoop: accept failed:" << strerror(errno);
+            }
+            return;
+        }
+        // 请求-响应模式，响应已经在应用层合并，不需要 Nagle 再攒包
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        EpollConnection* conn = new EpollConnection(fd, this, m_server->m_context);
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            qWarning() << "EpollLoop: epoll_ctl(add) failed:" << strerror(errno);
+            ::close(fd);
+            delete conn;
+            continue;
+        }
+        m_connections.insert(conn);
+        m_server->m_connections.fetch_add(1, std::memory_order_relaxed);
+        qCDebug(lcNet) << "EpollLoop:" << objectName() << "accepted connection" << conn->session.id() << "fd" << fd;
+    }
+}
+
+void EpollLoop::runTasks() {
+    std::vector<std::function<void()>> tasks;
+    {
+        QMutexLocker locker(&m_taskMutex);
+        tasks.swap(m_tasks);
+    }
+    for (auto& task : tasks) task();
+}
+
+void EpollLoop::handleRead(EpollConnection* conn) {
+    static thread_local char buffer[ReadChunkSize];
+    for (int i = 0; i < MaxReadsPerEvent && !conn->readPaused && !conn->closed; ++i) {
+        ssize_t n = ::read(conn->fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            // FrameReader::append 会复制一次，这里不再额外拷贝
+            conn->session.feed(QByteArray::fromRawData(buffer, n));
+            if (n < ssize_t(sizeof(buffer))) return; // 已读空，水平触发下次还会通知
+            continue;
+        }
+        if (n == 0) {
+            closeConnection(conn); // 对端关闭
+            return;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) closeConnection(conn);
+        return;
+    }
+}
+
+void EpollLoop::flush(EpollConnection* conn) {
+    while (conn->outPos < conn->out.size()) {
+        ssize_t n = ::send(conn->fd, conn->out.constData() + conn->outPos, size_t(conn->out.size() - conn->outPos), MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->outPos += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!conn->wantWrite) {
+                conn->wantWrite = true;
+                updateInterest(conn);
+            }
+            break;
+        }
+        closeConnection(conn);
+        return;
+    }
+
+    if (conn->outPos == conn->out.size()) {
+        conn->out.clear();
+        conn->outPos = 0;
+        if (conn->wantWrite) {
+            conn->wantWrite = false;
+            updateInterest(conn);
+        }
+    } else if (conn->outPos >= conn->out.size() / 2) {
+        conn->out.remove(0, conn->outPos);
+        conn->outPos = 0;
+    }
+
+    if (conn->readPaused && conn->pendingBytes() <= LowWaterMark) {
+        conn->readPaused = false;
+        updateInterest(conn);
+        conn->session.setInputPaused(false); // 继续处理暂停期间已缓冲的帧
+    }
+}
+
+void EpollLoop::markDirty(EpollConnection* conn) {
+    if (conn->dirty) return;
+    conn->dirty = true;
+    m_dirty.push_back(conn);
+}
+
+void EpollLoop::updateInterest(EpollConnection* conn) {
+    if (conn->closed) return;
+    epoll_event ev{};
+    ev.events = (conn->readPaused ? 0u : uint32_t(EPOLLIN | EPOLLRDHUP)) | (conn->wantWrite ? uint32_t(EPOLLOUT) : 0u);
+    ev.data.ptr = conn;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void EpollLoop::closeConnection(EpollConnection* conn) {
+    if (conn->closed) return;
+    conn->closed = true;
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    ::close(conn->fd);
+    conn->out.clear();
+    conn->outPos = 0;
+    m_server->m_connections.fetch_sub(1, std::memory_order_relaxed);
+    qCInfo(lcNet) << "EpollLoop: connection" << conn->session.id() << "fd" << conn->fd << "closed";
+    conn->session.close(); // 在途请求都完成后回调 sessionFinished()
+}
+
+void EpollLoop::scheduleDelete(EpollConnection* conn) {
+    m_finished.push_back(conn);
+}
+
+EpollServer::EpollServer(int threadCount, const ServerContext& context) : m_context(context) {
+    if (threadCount <= 0) threadCount = qMax(1, QThread::idealThreadCount());
+    for (int i = 0; i < threadCount; ++i) {
+        m_loops.emplace_back(new EpollLoop(this, i));
+    }
+}
+
+EpollServer::~EpollServer() {
+    stop();
+}
+
+bool EpollServer::listen(quint16 port, QString* errorString) {
+    // 优先使用双栈 IPv6 socket，与 QHostAddress::Any 的行为一致
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool v6 = fd >= 0;
+    if (!v6) fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        *errorString = QString("socket: %1").arg(strerror(errno));
+        return false;
+    }
+    int one = 1;
+    int zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int rc;
+    if (v6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(port);
+        rc = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        rc = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    if (rc < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        *errorString = QString("bind/listen: %1").arg(strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    m_listenFd = fd;
+
+    for (auto& loop : m_loops) {
+        if (!loop->init(m_listenFd, errorString)) {
+            stop();
+            return false;
+        }
+    }
+    for (auto& loop : m_loops) loop->start();
+    qInfo() << "EpollServer: Listening on port" << port << "with" << m_loops.size() << "epoll threads.";
+    return true;
+}
+
+void EpollServer::stop() {
+    for (auto& loop : m_loops) {
+        if (loop->isRunning()) loop->requestStop();
+    }
+    for (auto& loop : m_loops) loop->wait();
+    m_loops.clear();
+    if (m_listenFd >= 0) {
+        ::close(m_listenFd);
+        m_listenFd = -1;
+    }
+}
+
+#endif // Q_OS_LINUX
@@ -0,0 +1,43 @@
+#ifndef EPOLLSERVER_H
+#define EPOLLSERVER_H
+
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "clientsession.h"
+
+class EpollLoop;
+
+// 直接基于 epoll 的网络后端（仅 Linux），用于替代 QTcpServer/QTcpSocket。
+// 每个线程一个 epoll 循环，共享同一个监听 socket（EPOLLEXCLUSIVE，新连接只唤醒一个线程）；
+// 连接没有 QObject、信号槽和 QTcpSocket 的内部缓冲，收到的字节直接交给 ClientSession，
+// 后面的分帧、准入、请求线程池和各 manager 与 Qt 后端完全相同。
+class EpollServer {
+public:
+    // threadCount <= 0 表示使用 CPU 核数
+    EpollServer(int threadCount, const ServerContext& context);
+    ~EpollServer();
+
+    bool listen(quint16 port, QString* errorString);
+    void stop(); // 停止所有循环线程并关闭连接；线程池中的请求应已结束
+
+    int threadCount() const { return int(m_loops.size()); }
+    int connectionCount() const { return m_connections.load(std::memory_order_relaxed); }
+
+private:
+    friend class EpollLoop;
+
+    ServerContext m_context;
+    int m_listenFd = -1;
+    std::vector<std::unique_ptr<EpollLoop>> m_loops;
+    std::atomic<int> m_connections{0};
+};
+
+#endif // Q_OS_LINUX
+
+#endif // EPOLLSERVER_H
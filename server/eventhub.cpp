@@ -0,0 +1,201 @@
+#include "eventhub.h"
+#include "serverproductmanager.h"
+#include "servershoppingcartmanager.h"
+#include "serverordermanager.h"
+#include "product.h"
+#include "servermetrics.h"
+#include <QJsonArray>
+#include <QReadLocker>
+#include <QStringList>
+#include <QDateTime>
+
+// 目录和折扣事件可以用一次重新加载代替，积压时丢弃；购物车、订单事件量小且只与本用户有关，照常排队
+static bool isCatalogTopic(const QString& topic) {
+    return topic == QLatin1String("catalog") || topic.startsWith(QLatin1String("discount"));
+}
+
+void PushChannel::push(const std::shared_ptr<PushChannel>& channel, const QJsonObject& event) {
+    QMutexLocker locker(&channel->m_mutex);
+    if (channel->m_detached) return;
+    if (channel->m_congested && isCatalogTopic(event["topic"].toString())) {
+        channel->m_resyncPending = true;
+        locker.unlock();
+        ServerMetrics::instance().increment("eventsCoalesced");
+        return;
+    }
+    channel->m_pending.append(event);
+    if (channel->m_scheduled) return;
+    channel->m_scheduled = true;
+    // 未 detach 时会话及其传输层一定还在；task 持有通道本身，执行时再检查一次
+    channel->m_poster([channel]() {
+        QList<QJsonObject> events;
+        {
+            QMutexLocker locker(&channel->m_mutex);
+            channel->m_scheduled = false;
+            if (channel->m_detached) return;
+            events.swap(channel->m_pending);
+        }
+        // detach 只在会话线程调用，这里同样在会话线程，sink 执行期间会话不会被销毁
+        channel->m_sink(events);
+    });
+}
+
+void PushChannel::setCongested(const std::shared_ptr<PushChannel>& channel, bool congested) {
+    {
+        QMutexLocker locker(&channel->m_mutex);
+        channel->m_congested = congested;
+        if (congested || !channel->m_resyncPending) return;
+        channel->m_resyncPending = false;
+    }
+    QJsonObject data;
+    data["ts"] = QDateTime::currentMSecsSinceEpoch();
+    QJsonObject message;
+    message["response_to_action"] = "event";
+    message["event"] = "catalogResync";
+    message["topic"] = "catalog";
+    message["data"] = data;
+    push(channel, message);
+}
+
+void PushChannel::detach() {
+    QMutexLocker locker(&m_mutex);
+    m_detached = true;
+    m_pending.clear();
+}
+
+bool PushChannel::isDetached() {
+    QMutexLocker locker(&m_mutex);
+    return m_detached;
+}
+
+EventHub::EventHub(ServerProductManager* productMgr,
+                   ServerShoppingCartManager* cartMgr,
+                   ServerOrderManager* orderMgr,
+                   QObject* parent)
+    : QObject(parent), m_productManager(productMgr), m_cartManager(cartMgr) {
+    // 直接连接：在修改数据的线程（请求线程池或定时器所在线程）中同步生成事件
+    connect(productMgr, &ServerProductManager::productAdded, this,
+            [this](Product* product) { onProductChanged(product, QString(), true); }, Qt::DirectConnection);
+    connect(productMgr, &ServerProductManager::productChanged, this,
+            [this](Product* product, const QString& previousName) { onProductChanged(product, previousName, false); },
+            Qt::DirectConnection);
+    connect(productMgr, &ServerProductManager::categoryDiscountChanged, this,
+            &EventHub::onCategoryDiscountChanged, Qt::DirectConnection);
+    connect(cartMgr, &ServerShoppingCartManager::cartChanged, this, &EventHub::onCartChanged, Qt::DirectConnection);
+    connect(orderMgr, &ServerOrderManager::orderChanged, this, &EventHub::onOrderChanged, Qt::DirectConnection);
+}
+
+bool EventHub::subscribe(const QString& topic, const std::shared_ptr<PushChannel>& channel) {
+    QMutexLocker locker(&m_mutex);
+    // 与 ClientSession::close() 中的 detach -> unsubscribeAll 配合，断开后不会再被加回订阅表
+    if (channel->isDetached()) return false;
+    m_topics[topic].insert(channel.get(), channel);
+    m_channelTopics[channel.get()].insert(topic);
+    return true;
+}
+
+void EventHub::unsubscribe(const QString& topic, PushChannel* channel) {
+    QMutexLocker locker(&m_mutex);
+    auto it = m_topics.find(topic);
+    if (it != m_topics.end()) {
+        it->remove(channel);
+        if (it->isEmpty()) m_topics.erase(it);
+    }
+    auto ct = m_channelTopics.find(channel);
+    if (ct != m_channelTopics.end()) {
+        ct->remove(topic);
+        if (ct->isEmpty()) m_channelTopics.erase(ct);
+    }
+}
+
+void EventHub::unsubscribeAll(PushChannel* channel) {
+    QMutexLocker locker(&m_mutex);
+    const QSet<QString> topics = m_channelTopics.take(channel);
+    for (const QString& topic : topics) {
+        auto it = m_topics.find(topic);
+        if (it == m_topics.end()) continue;
+        it->remove(channel);
+        if (it->isEmpty()) m_topics.erase(it);
+    }
+}
+
+bool EventHub::hasSubscribers(const QStringList& topics) const {
+    QMutexLocker locker(&m_mutex);
+    for (const QString& topic : topics) {
+        if (m_topics.contains(topic)) return true;
+    }
+    return false;
+}
+
+void EventHub::publish(const QStringList& topics, const QString& event, const QJsonObject& data) {
+    QMutexLocker locker(&m_mutex);
+    // 同一连接订阅了多个匹配主题时只发一次
+    QSet<PushChannel*> delivered;
+    int count = 0;
+    QJsonObject message;
+    message["response_to_action"] = "event";
+    message["event"] = event;
+    message["seq"] = qint64(++m_sequence);
+    message["data"] = data;
+    for (const QString& topic : topics) {
+        auto it = m_topics.constFind(topic);
+        if (it == m_topics.constEnd()) continue;
+        message["topic"] = topic;
+        for (auto ch = it->constBegin(); ch != it->constEnd(); ++ch) {
+            if (delivered.contains(ch.key())) continue;
+            delivered.insert(ch.key());
+            PushChannel::push(ch.value(), message);
+            ++count;
+        }
+    }
+    locker.unlock();
+    if (count > 0) ServerMetrics::instance().increment("eventsPushed", count);
+}
+
+// 调用方（ServerProductManager）持有目录写锁，这里读取商品字段是安全的
+void EventHub::onProductChanged(Product* product, const QString& previousName, bool added) {
+    const QStringList topics{"catalog"};
+    if (!product || !hasSubscribers(topics)) return;
+    QJsonObject data;
+    data["id"] = qint64(product->getId());
+    data["name"] = product->getName();
+    if (!added && previousName != product->getName()) data["previousName"] = previousName;
+    data["description"] = product->getDescription();
+    data["basePrice"] = product->getBasePrice();
+    data["price"] = product->getPrice();
+    data["stock"] = product->getStock();
+    data["availableStock"] = product->getAvailableStock();
+    data["category"] = product->getCategory();
+    data["imagePath"] = product->getImagePath();
+    data["merchantUsername"] = product->getMerchantUsername();
+    data["discount"] = product->getDiscount();
+    data["version"] = qint64(m_productManager->version());
+    data["ts"] = QDateTime::currentMSecsSinceEpoch();
+    publish(topics, added ? "productAdded" : "productChanged", data);
+}
+
+void EventHub::onCategoryDiscountChanged(const QString& category, double discount) {
+    const QStringList topics{"catalog", "discount", "discount:" + category};
+    if (!hasSubscribers(topics)) return;
+    QJsonObject data;
+    data["category"] = category;
+    data["discount"] = discount;
+    data["version"] = qint64(m_productManager->version()); // 同样在目录写锁内
+    data["ts"] = QDateTime::currentMSecsSinceEpoch();
+    publish(topics, "discountChanged", data);
+}
+
+// 在购物车锁内调用（可重入），取到的就是这次修改之后的内容
+void EventHub::onCartChanged(const QString& username) {
+    const QStringList topics{"cart:" + username};
+    if (!hasSubscribers(topics)) return;
+    QJsonObject data;
+    data["items"] = QJsonArray::fromVariantList(m_cartManager->getCartItems(username));
+    publish(topics, "cartChanged", data);
+}
+
+void EventHub::onOrderChanged(const QString& username, const QVariantMap& order) {
+    const QStringList topics{"orders:" + username};
+    if (!hasSubscribers(topics)) return;
+    publish(topics, "orderChanged", QJsonObject::fromVariantMap(order));
+}
@@ -0,0 +1,84 @@
+#ifndef EVENTHUB_H
+#define EVENTHUB_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QJsonObject>
+#include <QVariantMap>
+#include <QList>
+#include <functional>
+#include <memory>
+
+class ServerProductManager;
+class ServerShoppingCartManager;
+class ServerOrderManager;
+class Product;
+
+// 一个连接的推送通道：事件先排在这里，再经 post 送到连接所在的网络线程统一发出。
+// ClientSession 关闭时调用 detach()，之后到达的事件直接丢弃。
+// 连接发送积压超过高水位期间（setCongested），目录类事件（catalog/discount）不再排队，
+// 回落后改发一条 catalogResync，订阅者据此重新 getProducts（副本重新取快照）。
+class PushChannel {
+public:
+    using Poster = std::function<void(std::function<void()>)>;
+    using Sink = std::function<void(const QList<QJsonObject>&)>;
+
+    PushChannel(Poster poster, Sink sink) : m_poster(std::move(poster)), m_sink(std::move(sink)) {}
+
+    static void push(const std::shared_ptr<PushChannel>& channel, const QJsonObject& event); // 任意线程
+    static void setCongested(const std::shared_ptr<PushChannel>& channel, bool congested); // 会话线程
+    void detach(); // 会话线程
+    bool isDetached();
+
+private:
+    QMutex m_mutex;
+    Poster m_poster;
+    Sink m_sink;
+    QList<QJsonObject> m_pending;
+    bool m_scheduled = false; // 已有一次 post 在路上，新事件直接追加
+    bool m_congested = false;
+    bool m_resyncPending = false; // 积压期间丢弃过目录事件
+    bool m_detached = false;
+};
+
+// 服务器推送的订阅表。各 manager 的变更信号（直接连接，在修改数据的线程中）汇总到这里，
+// 只有存在订阅者时才生成事件。主题：
+//   "catalog"                 商品新增/修改、库存变化，以及所有分类的折扣变化
+//   "discount" / "discount:X" 所有分类 / 分类 X 的折扣变化
+//   "cart:<user>"、"orders:<user>" 某个用户自己的购物车和订单
+// 慢订阅者的目录事件会被合并成一条 catalogResync（见 PushChannel），不会无限堆积在服务器内存里。
+// 目录相关的事件（catalog/discount）带有目录版本号 version 和生成时间 ts（毫秒），
+// 同时也是只读副本使用的变更流：版本号连续，副本发现跳号时重新取快照。
+class EventHub : public QObject {
+    Q_OBJECT
+public:
+    EventHub(ServerProductManager* productMgr,
+             ServerShoppingCartManager* cartMgr,
+             ServerOrderManager* orderMgr,
+             QObject* parent = nullptr);
+
+    // 通道已 detach 时返回 false（连接在订阅请求执行期间断开）
+    bool subscribe(const QString& topic, const std::shared_ptr<PushChannel>& channel);
+    void unsubscribe(const QString& topic, PushChannel* channel);
+    void unsubscribeAll(PushChannel* channel);
+
+private:
+    void onProductChanged(Product* product, const QString& previousName, bool added);
+    void onCategoryDiscountChanged(const QString& category, double discount);
+    void onCartChanged(const QString& username);
+    void onOrderChanged(const QString& username, const QVariantMap& order);
+
+    bool hasSubscribers(const QStringList& topics) const;
+    void publish(const QStringList& topics, const QString& event, const QJsonObject& data);
+
+    ServerProductManager* m_productManager;
+    ServerShoppingCartManager* m_cartManager;
+    mutable QMutex m_mutex; // 只保护订阅表；持有期间不会再获取任何 manager 的锁
+    QHash<QString, QHash<PushChannel*, std::shared_ptr<PushChannel>>> m_topics;
+    QHash<PushChannel*, QSet<QString>> m_channelTopics; // 反向索引，断开时一次清掉
+    quint64 m_sequence = 0; // 事件序号，客户端可据此发现丢失
+};
+
+#endif // EVENTHUB_H
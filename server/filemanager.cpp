@@ -1,13 +1,45 @@
 #include "filemanager.h"
+#include <QDir>
+#include <QHash>
 
 // 在类的实现文件中定义静态成员
-QMutex FileManager::fileMutex;
+QRecursiveMutex FileManager::fileMutex;
+QString FileManager::dataPathPrefix = "D:/Qt_projects/E-commerce/E-commerce-v2/data/";
+UsernameIndex FileManager::userIndex;
+bool FileManager::userIndexLoaded = false;
+bool FileManager::readOnly = false;
+
+void FileManager::setDataDirectory(const QString& dir) {
+    QMutexLocker locker(&fileMutex);
+    dataPathPrefix = dir.endsWith('/') ? dir : dir + '/';
+    userIndexLoaded = false;
+    QDir().mkpath(dataPathPrefix);
+}
+
+void FileManager::setReadOnly(bool value) {
+    QMutexLocker locker(&fileMutex);
+    readOnly = value;
+}
+
+bool FileManager::isReadOnly() {
+    QMutexLocker locker(&fileMutex);
+    return readOnly;
+}
+
+QString FileManager::dataDirectory() {
+    QMutexLocker locker(&fileMutex);
+    return dataPathPrefix;
+}
+
+QString FileManager::dataFile(const char* name) {
+    return dataPathPrefix + QLatin1String(name); // 调用方已持有 fileMutex
+}
 
 QMap<QString, User*> FileManager::loadAllUsers()
 {
     QMutexLocker locker(&fileMutex); // 加锁
     QMap<QString, User*> users;
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/users.json");
+    QFile file(dataFile("users.json"));
     //处理打开失败
     if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
     {
@@ -52,19 +84,34 @@ QMap<QString, User*> FileManager::loadAllUsers()
         }
         users[name] = user;
     }
+    userIndex.rebuild(users.keys());
+    userIndexLoaded = true;
     return users;
 }
 
 bool FileManager::userExist(const QString& username){
-    QMutexLocker locker(&fileMutex); // 加锁
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    return users[username]!=nullptr;
+    {
+        QMutexLocker locker(&fileMutex); // 加锁
+        if (!userIndexLoaded) {
+            // 只需要用户名，不构造 User 对象
+            QFile file(dataFile("users.json"));
+            QStringList names;
+            if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                for (const QJsonValue& value : QJsonDocument::fromJson(file.readAll()).array()) {
+                    names.append(value.toObject()["name"].toString());
+                }
+            }
+            userIndex.rebuild(names);
+            userIndexLoaded = true;
+        }
+    }
+    return userIndex.contains(username);
 }
 
-QList<Product*> FileManager::loadProducts(){
+QList<Product*> FileManager::loadProducts(quint64* nextId){
     QMutexLocker locker(&fileMutex); // 加锁
     QList<Product*> products;
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/products.json");
+    QFile file(dataFile("products.json"));
     if (!file.open(QIODevice::ReadOnly)) return products;
 
     QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
@@ -73,6 +120,7 @@ QList<Product*> FileManager::loadProducts(){
     Book::discount = categories["图书"].toDouble(1.0); // 加载失败将返回默认值1.0
     Clothing::discount = categories["服装"].toDouble(1.0);
     Food::discount = categories["食品"].toDouble(1.0);
+    if (nextId) *nextId = quint64(root["nextId"].toInteger());
 
     QJsonArray productArray = root["products"].toArray();
     for (const QJsonValue& value : productArray) {
@@ -91,6 +139,7 @@ QList<Product*> FileManager::loadProducts(){
         else if (category == "服装") product = new Clothing(name, desc, price, stock, merchantUsername, imagePath);
         else if (category == "食品") product = new Food(name, desc, price, stock, merchantUsername, imagePath);
         if (product) {
+            product->setId(quint64(obj["id"].toInteger())); // 旧文件没有 id，由 ServerProductManager 补上
             products.append(product);
         }
     }
@@ -100,6 +149,7 @@ QList<Product*> FileManager::loadProducts(){
 bool FileManager::saveUser(const User* user)
 {
     QMutexLocker locker(&fileMutex); // 加锁
+    if (readOnly) return false;
     QMap<QString, User*> existingUsers = loadAllUsers();
     // 删除同名用户
     QString username = user->getUsername();
@@ -130,28 +180,69 @@ bool FileManager::saveUser(const User* user)
     }
 
     // 写入文件
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/users.json");
+    QFile file(dataFile("users.json"));
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
         qDebug() << "无法写入 users.json" << file.errorString();
         return false;
     }
     file.write(QJsonDocument(jsonArray).toJson());
     file.close();
+    userIndex.insert(username);
     return true;
 }
 
-bool FileManager::saveProducts(const QList<Product*>& products){
+bool FileManager::saveUserRecords(const QList<QJsonObject>& records)
+{
     QMutexLocker locker(&fileMutex); // 加锁
+    if (readOnly) return false;
+    if (records.isEmpty()) return true;
+    QJsonArray jsonArray;
+    QFile in(dataFile("users.json"));
+    if (in.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        jsonArray = QJsonDocument::fromJson(in.readAll()).array();
+        in.close();
+    }
+
+    QHash<QString, qsizetype> positions; // 用户名 -> 在数组中的位置
+    for (qsizetype i = 0; i < jsonArray.size(); ++i) {
+        positions.insert(jsonArray[i].toObject()["name"].toString(), i);
+    }
+    for (const QJsonObject& record : records) {
+        auto it = positions.constFind(record["name"].toString());
+        if (it != positions.constEnd()) {
+            jsonArray[*it] = record;
+        } else {
+            positions.insert(record["name"].toString(), jsonArray.size());
+            jsonArray.append(record);
+            userIndex.insert(record["name"].toString());
+        }
+    }
+
+    QFile file(dataFile("users.json"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "无法写入 users.json" << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(jsonArray).toJson());
+    file.close();
+    return true;
+}
+
+bool FileManager::saveProducts(const QList<Product*>& products, quint64 nextId){
+    QMutexLocker locker(&fileMutex); // 加锁
+    if (readOnly) return false;
     QJsonObject root;
     QJsonObject categories;
     categories["图书"] = Book::discount;
     categories["服装"] = Clothing::discount;
     categories["食品"] = Food::discount;
     root["categories"] = categories;
+    if (nextId != 0) root["nextId"] = qint64(nextId);
 
     QJsonArray productArray;
     for(Product* product : products) {
         QJsonObject obj;
+        obj["id"] = qint64(product->getId());
         obj["name"] = product->getName();
         obj["description"] = product->getDescription();
         obj["price"] = product->getBasePrice();
@@ -164,7 +255,7 @@ bool FileManager::saveProducts(const QList<Product*>& products){
     }
     root["products"] = productArray;
 
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/products.json");
+    QFile file(dataFile("products.json"));
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
         qDebug() << "无法写入 products.json";
         return false;
@@ -176,7 +267,8 @@ bool FileManager::saveProducts(const QList<Product*>& products){
 
 bool FileManager::saveShoppingCarts(const QVariantMap& allCarts) {
     QMutexLocker locker(&fileMutex); // 加锁
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/shoppingCart.json");
+    if (readOnly) return false;
+    QFile file(dataFile("shoppingCart.json"));
     if (!file.open(QIODevice::WriteOnly)) return false;
 
     QJsonObject root;
@@ -197,7 +289,7 @@ bool FileManager::saveShoppingCarts(const QVariantMap& allCarts) {
 
 QVariantMap FileManager::loadAllShoppingCarts() {
     QMutexLocker locker(&fileMutex); // 加锁
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/shoppingCart.json");
+    QFile file(dataFile("shoppingCart.json"));
     QVariantMap allCarts;
     if (file.open(QIODevice::ReadOnly)) {
         QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
@@ -238,7 +330,8 @@ Order::Status stringToOrderStatus(const QString& statusStr) {
 // 保存订单数据
 bool FileManager::saveOrders(const QList<Order*>& orders) {
     QMutexLocker locker(&fileMutex); // 加锁
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/order.json");
+    if (readOnly) return false;
+    QFile file(dataFile("order.json"));
     if (!file.open(QIODevice::WriteOnly)) return false;
 
     QJsonArray orderArray;
@@ -255,7 +348,8 @@ bool FileManager::saveOrders(const QList<Order*>& orders) {
             Product* product = it.key();
             int quantity = it.value();
             QJsonObject itemObj;
-            itemObj["productName"] = product->getName();
+            itemObj["productId"] = qint64(product->getId());
+            itemObj["productName"] = product->getName(); // 只用于阅读和兼容旧版本，加载时以 productId 为准
             itemObj["merchantUsername"] = product->getMerchantUsername();
             itemObj["quantity"] = quantity;
             itemsArray.append(itemObj);
@@ -274,10 +368,19 @@ bool FileManager::saveOrders(const QList<Order*>& orders) {
 QList<Order*> FileManager::loadOrders(const QList<Product*>& allProducts) {
     QMutexLocker locker(&fileMutex); // 加锁
     QList<Order*> orders;
-    QFile file("D:/Qt_projects/E-commerce/E-commerce-v2/data/order.json");
+    QFile file(dataFile("order.json"));
     if (file.open(QIODevice::ReadOnly)) {
         QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
         QJsonArray orderArray = doc.array();
+        // 建一次索引，每个订单项直接查表：按商品 ID；旧订单没有 productId，按 (名称, 商家)
+        QHash<quint64, Product*> productById;
+        QHash<QString, Product*> productIndex;
+        productById.reserve(allProducts.size());
+        productIndex.reserve(allProducts.size());
+        for (Product* p : allProducts) {
+            productById.insert(p->getId(), p);
+            productIndex.insert(p->getName() + '\n' + p->getMerchantUsername(), p);
+        }
         for (const QJsonValue& orderVal : orderArray) {
             QJsonObject orderObj = orderVal.toObject();
             QString consumer = orderObj["consumer"].toString();
@@ -293,13 +396,9 @@ QList<Order*> FileManager::loadOrders(const QList<Product*>& allProducts) {
                 QString merchantUsername = itemObj["merchantUsername"].toString();
                 int quantity = itemObj["quantity"].toInt(1);
 
-                Product* foundProduct = nullptr;
-                for (Product* p : allProducts) {
-                    if (p->getName() == productName && p->getMerchantUsername() == merchantUsername) {
-                        foundProduct = p;
-                        break;
-                    }
-                }
+                Product* foundProduct = itemObj.contains("productId")
+                    ? productById.value(quint64(itemObj["productId"].toInteger()), nullptr)
+                    : productIndex.value(productName + '\n' + merchantUsername, nullptr);
                 if (foundProduct) {
                     loadedOrderItems.insert(foundProduct, quantity);
                 } else {
@@ -17,16 +17,20 @@
 #include "food.h"
 #include <QObject>
 #include <QMutex>
+#include <QRecursiveMutex>
+#include "usernameindex.h"
 
 class FileManager : public QObject
 {
     Q_OBJECT
 public:
     static QMap<QString, User*> loadAllUsers();
-    static QList<Product*> loadProducts();
-    static bool userExist(const QString& username);
+    static QList<Product*> loadProducts(quint64* nextId = nullptr); // *nextId 为文件中保存的下一个商品 ID
+    static bool userExist(const QString& username); // 查常驻的用户名索引，只在第一次调用时读文件
     static bool saveUser(const User* user);
-    static bool saveProducts(const QList<Product*>& products);
+    // 只更新（或追加）给出的几条用户记录，其余记录按原始 JSON 保留，不构造 User 对象
+    static bool saveUserRecords(const QList<QJsonObject>& records);
+    static bool saveProducts(const QList<Product*>& products, quint64 nextId = 0);
 
     static bool saveShoppingCarts(const QVariantMap& allCarts);
     static QVariantMap loadAllShoppingCarts();
@@ -35,12 +39,23 @@ public:
     static QList<Order*> loadOrders(const QList<Product*>& allProducts);
     static bool clearUserShoppingCart(const QString& username);
 
+    // 数据文件所在目录（默认是开发机上的路径）；多个分片进程各用一个目录，需在创建 manager 之前设置
+    static void setDataDirectory(const QString& dir);
+    static QString dataDirectory();
+    // 只读模式（目录副本）：所有 save* 直接返回 false，不碰数据文件；需在创建 manager 之前设置
+    static void setReadOnly(bool readOnly);
+    static bool isReadOnly();
+
     static QJsonDocument loadJson(const QString& filename);
     static bool saveJson(const QString& filename, const QJsonDocument& doc);
 
 private:
     static QString dataPathPrefix;
-    static QMutex fileMutex; // 静态互斥锁，保护所有文件访问
+    static QString dataFile(const char* name);
+    static UsernameIndex userIndex; // users.json 中的用户名，加载和保存用户时同步更新
+    static bool userIndexLoaded;
+    static bool readOnly;
+    static QRecursiveMutex fileMutex; // 静态互斥锁，保护所有文件访问；saveUser 等会在持锁时调用 loadAllUsers，必须可重入
 };
 
 #endif // FILEMANAGER_H
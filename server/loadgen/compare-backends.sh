@@ -0,0 +1,43 @@
+#!/bin/sh
+# 比较 Qt 与 epoll 两种网络后端：服务器绑在前 CORES 个核上，loadgen 绑在其余的核上，
+# 每种后端依次跑几档连接数，输出 loadgen 的结果行（rps、p99_us、server_cpu_s、rps_per_cpu、server_rss_kb）。
+#
+# 用法：compare-backends.sh <server 可执行文件> <数据目录> [CORES] [连接数...]
+# 例如：compare-backends.sh ../build/server /tmp/shop-data 2 100 1000 5000
+set -e
+
+SERVER=$1
+DATA_DIR=$2
+CORES=${3:-2}
+if [ $# -ge 3 ]; then shift 3; else shift $#; fi
+CONNECTIONS=${*:-"100 1000 5000"}
+PORT=${PORT:-18080}
+DURATION=${DURATION:-20}
+LOADGEN=${LOADGEN:-$(dirname "$0")/loadgen}
+LOADGEN_ARGS=${LOADGEN_ARGS:-}   # 例如 "--encoding cbor --action searchProducts"
+TOTAL_CORES=$(nproc)
+
+if [ -z "$SERVER" ] || [ -z "$DATA_DIR" ]; then
+    echo "usage: $0 <server> <data-dir> [cores] [connections...]" >&2
+    exit 1
+fi
+if [ "$CORES" -ge "$TOTAL_CORES" ]; then
+    echo "need more than $CORES cores so loadgen does not share them with the server" >&2
+    exit 1
+fi
+
+ulimit -n 65536 2>/dev/null || echo "warning: cannot raise the open file limit" >&2
+
+for BACKEND in qt epoll; do
+    taskset -c 0-$((CORES - 1)) "$SERVER" --port "$PORT" --backend "$BACKEND" --workers "$CORES" \
+        --request-threads "$CORES" --stats-interval 0 --data-dir "$DATA_DIR" >/dev/null 2>&1 &
+    SERVER_PID=$!
+    sleep 2
+    for N in $CONNECTIONS; do
+        echo "backend=$BACKEND cores=$CORES"
+        taskset -c "$CORES-$((TOTAL_CORES - 1))" "$LOADGEN" --port "$PORT" --connections "$N" \
+            --duration "$DURATION" --server-pid "$SERVER_PID" $LOADGEN_ARGS
+    done
+    kill "$SERVER_PID"
+    wait "$SERVER_PID" 2>/dev/null || true
+done
@@ -0,0 +1,16 @@
+QT += core \
+      network
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+# 与服务器共用同一份传输层实现
+INCLUDEPATH += ..
+
+HEADERS += \
+        ../wireprotocol.h
+
+SOURCES += \
+        main.cpp \
+        ../wireprotocol.cpp
@@ -0,0 +1,366 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+#include <QTextStream>
+#include <QList>
+#include <algorithm>
+#include "wireprotocol.h"
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+// 服务器压测工具：开 N 条连接，每条连接收到回复后立即发下一条请求（闭环），持续 duration 秒后输出吞吐和延迟。
+// --idle 只建立连接不发请求，配合 --server-pid 观察连接数与服务器常驻内存、线程数的关系。
+// 单个进程只用一个线程；要压满多核服务器时同时开几个进程，把各自的 requests 相加。
+// --encoding/--compress 经 hello 协商长度前缀分帧下的编码与压缩；--wire-stats 在压测前后各取一次 serverStats，
+// 按 action 输出这段时间内每条消息的平均字节数和服务器端编解码耗时。
+// 给出 --server-pid 时还输出服务器这段时间用掉的 CPU 秒数，rps_per_cpu 即每个核每秒处理的请求数，
+// 用来比较不同网络后端（--backend qt / epoll）的单核效率。
+
+struct LoadConfig {
+    QString host;
+    quint16 port = 8080;
+    int connections = 100;
+    int durationSeconds = 10;
+    bool idle = false;
+    WireProtocol::Encoding encoding = WireProtocol::Encoding::Json;
+    bool compress = false;
+    QString username; // 非空时每条连接先登录，用于需要登录的 action
+    QString password;
+    QJsonObject request; // 每次发送的请求（不含 requestId）
+    bool negotiate() const { return encoding != WireProtocol::Encoding::Json || compress; }
+};
+
+// 服务器进程 /proc/<pid>/status 中的常驻内存（KB）与线程数，/proc/<pid>/stat 中的用户态 + 内核态 CPU 时间；
+// 不是 Linux 或读不到时为 -1
+struct ProcessSample {
+    qint64 rssKb = -1;
+    int threads = -1;
+    double cpuSeconds = -1.0;
+};
+
+static ProcessSample sampleProcess(qint64 pid) {
+    ProcessSample sample;
+    if (pid <= 0) return sample;
+    QFile status(QString("/proc/%1/status").arg(pid));
+    if (!status.open(QIODevice::ReadOnly)) return sample;
+    for (const QByteArray& line : status.readAll().split('\n')) {
+        const QList<QByteArray> fields = line.simplified().split(' ');
+        if (fields.size() < 2) continue;
+        if (fields[0] == "VmRSS:") sample.rssKb = fields[1].toLongLong();
+        else if (fields[0] == "Threads:") sample.threads = fields[1].toInt();
+    }
+#ifdef Q_OS_LINUX
+    QFile stat(QString("/proc/%1/stat").arg(pid));
+    if (stat.open(QIODevice::ReadOnly)) {
+        // 进程名可能含空格，从最后一个 ')' 之后数：第 12、13 个字段是 utime、stime（单位为时钟滴答）
+        const QByteArray line = stat.readAll();
+        const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+        if (fields.size() > 12) sample.cpuSeconds = double(fields[11].toLongLong() + fields[12].toLongLong()) / sysconf(_SC_CLK_TCK);
+    }
+#endif
+    return sample;
+}
+
+class LoadConnection : public QObject {
+public:
+    LoadConnection(const LoadConfig& config, int index, QList<qint64>* latenciesUs, QObject* parent)
+        : QObject(parent), m_config(config), m_index(index), m_latenciesUs(latenciesUs) {
+        m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(&m_socket, &QTcpSocket::connected, this, [this]() {
+            if (m_config.negotiate()) {
+                sendHello(); // 协商（和登录）完成才算连上
+                return;
+            }
+            ready();
+        });
+        connect(&m_socket, &QTcpSocket::readyRead, this, &LoadConnection::onReadyRead);
+        connect(&m_socket, &QTcpSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+            if (!m_failed) ++m_errors;
+            m_failed = true;
+        });
+        m_socket.connectToHost(m_config.host, m_config.port);
+    }
+
+    void stop() { m_running = false; }
+    bool isConnected() const { return m_connected && !m_failed; }
+    qint64 completed() const { return m_completed; }
+    qint64 errors() const { return m_errors; }
+    qint64 decodeNs() const { return m_decodeNs; } // 本端解析回复（含解压）的累计耗时
+    void resetDecodeTime() { m_decodeNs = 0; }
+
+private:
+    void ready() {
+        if (!m_config.username.isEmpty() && !m_loggedIn) {
+            QJsonObject login;
+            login["action"] = "login";
+            login["requestId"] = QString("load-%1-login").arg(m_index);
+            login["payload"] = QJsonObject{{"username", m_config.username}, {"password", m_config.password}};
+            m_socket.write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(login, m_encoding), m_reader.framing()));
+            return;
+        }
+        m_connected = true;
+        if (!m_config.idle && m_running) sendNext();
+    }
+
+    void sendHello() {
+        QJsonObject payload;
+        payload["framing"] = WireProtocol::framingToString(WireProtocol::Framing::LengthPrefixed);
+        payload["encoding"] = WireProtocol::encodingToString(m_config.encoding);
+        if (m_config.compress) payload["compression"] = QJsonArray{WireProtocol::compressionToString(WireProtocol::Compression::Zlib)};
+        QJsonObject hello;
+        hello["action"] = "hello";
+        hello["requestId"] = QString("load-%1-hello").arg(m_index);
+        hello["payload"] = payload;
+        m_socket.write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(hello, WireProtocol::Encoding::Json),
+                                                 WireProtocol::Framing::Newline));
+    }
+
+    void sendNext() {
+        QJsonObject request = m_config.request;
+        request["requestId"] = QString("load-%1-%2").arg(m_index).arg(m_sent++);
+        m_sentTimer.start();
+        m_socket.write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(request, m_encoding), m_reader.framing()));
+    }
+
+    void onReadyRead() {
+        m_reader.append(m_socket.readAll());
+        QByteArray frame;
+        bool compressed = false;
+        while (m_reader.next(&frame, &compressed) == FrameReader::FrameReady) {
+            QJsonObject response;
+            QString errorString;
+            QElapsedTimer decodeTimer;
+            decodeTimer.start();
+            QByteArray inflated;
+            const bool ok = (!compressed || WireProtocol::decompressPayload(frame, &inflated))
+                && WireProtocol::decodeMessage(compressed ? inflated : frame, m_encoding, &response, &errorString);
+            if (!ok) {
+                ++m_errors;
+                continue;
+            }
+            if (response["response_to_action"].toString() == "hello") {
+                // 服务器在 hello 回复之后就改用新的分帧和编码
+                if (response["status"].toString() != "success") {
+                    ++m_errors;
+                    m_failed = true;
+                    m_socket.abort();
+                    return;
+                }
+                const QJsonObject data = response["data"].toObject();
+                WireProtocol::Framing framing = m_reader.framing();
+                WireProtocol::framingFromString(data["framing"].toString(), &framing);
+                WireProtocol::encodingFromString(data["encoding"].toString(), &m_encoding);
+                m_reader.setFraming(framing);
+                ready();
+                continue;
+            }
+            if (response["response_to_action"].toString() == "login" && !m_loggedIn) {
+                m_loggedIn = response["status"].toString() == "success";
+                if (!m_loggedIn) {
+                    ++m_errors;
+                    m_failed = true;
+                    m_socket.abort();
+                    return;
+                }
+                ready();
+                continue;
+            }
+            m_decodeNs += decodeTimer.nsecsElapsed();
+            if (response["response_to_action"].toString() == "event") continue;
+            if (response["status"].toString() == "success") {
+                ++m_completed;
+                m_latenciesUs->append(m_sentTimer.nsecsElapsed() / 1000);
+            } else {
+                ++m_errors;
+            }
+            if (m_running) sendNext();
+        }
+    }
+
+    const LoadConfig& m_config;
+    const int m_index;
+    QList<qint64>* m_latenciesUs; // 所有连接在同一线程，共用一个列表
+    QTcpSocket m_socket;
+    FrameReader m_reader;
+    WireProtocol::Encoding m_encoding = WireProtocol::Encoding::Json; // 协商前总是 JSON
+    QElapsedTimer m_sentTimer;
+    qint64 m_decodeNs = 0;
+    qint64 m_sent = 0;
+    qint64 m_completed = 0;
+    qint64 m_errors = 0;
+    bool m_connected = false;
+    bool m_loggedIn = false;
+    bool m_failed = false;
+    bool m_running = true;
+};
+
+// 单独连一次取 serverStats 的 "wire" 部分（换行 JSON，同步等待）；失败时返回空
+static QJsonObject fetchWireStats(const LoadConfig& config) {
+    QTcpSocket socket;
+    socket.connectToHost(config.host, config.port);
+    if (!socket.waitForConnected(3000)) return QJsonObject();
+    QJsonObject request;
+    request["action"] = "serverStats";
+    request["requestId"] = "load-stats";
+    socket.write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(request, WireProtocol::Encoding::Json),
+                                           WireProtocol::Framing::Newline));
+    FrameReader reader;
+    QByteArray frame;
+    while (socket.waitForReadyRead(3000)) {
+        reader.append(socket.readAll());
+        while (reader.next(&frame) == FrameReader::FrameReady) {
+            QJsonObject response;
+            QString errorString;
+            if (!WireProtocol::decodeMessage(frame, WireProtocol::Encoding::Json, &response, &errorString)) continue;
+            if (response["requestId"].toString() == "load-stats") return response["data"].toObject()["wire"].toObject();
+        }
+    }
+    return QJsonObject();
+}
+
+// 两次 serverStats 之差：每个 "action/编码" 这段时间内的消息数、平均字节数和平均编解码耗时
+static void printWireDelta(QTextStream& out, const QJsonObject& before, const QJsonObject& after) {
+    for (auto it = after.constBegin(); it != after.constEnd(); ++it) {
+        const QJsonObject a = it.value().toObject();
+        const QJsonObject b = before[it.key()].toObject();
+        const qint64 sent = a["sent"].toInteger() - b["sent"].toInteger();
+        const qint64 received = a["received"].toInteger() - b["received"].toInteger();
+        if (sent <= 0 && received <= 0) continue;
+        // 快照里只有平均值，乘回总量再相减
+        const double encodeUs = a["avgEncodeUs"].toDouble() * a["sent"].toDouble() - b["avgEncodeUs"].toDouble() * b["sent"].toDouble();
+        const double decodeUs = a["avgDecodeUs"].toDouble() * a["received"].toDouble()
+            - b["avgDecodeUs"].toDouble() * b["received"].toDouble();
+        out << "wire " << it.key() << " sent=" << sent
+            << " avg_bytes_out=" << (sent > 0 ? (a["bytesOut"].toInteger() - b["bytesOut"].toInteger()) / sent : 0)
+            << " avg_encode_us=" << QString::number(sent > 0 ? encodeUs / sent : 0.0, 'f', 2)
+            << " received=" << received
+            << " avg_bytes_in=" << (received > 0 ? (a["bytesIn"].toInteger() - b["bytesIn"].toInteger()) / received : 0)
+            << " avg_decode_us=" << QString::number(received > 0 ? decodeUs / received : 0.0, 'f', 2) << Qt::endl;
+    }
+}
+
+static qint64 percentile(const QList<qint64>& sorted, double p) {
+    if (sorted.isEmpty()) return 0;
+    return sorted[qMin(sorted.size() - 1, qsizetype(p * double(sorted.size())))];
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption hostOption("host", "Server host.", "host", "127.0.0.1");
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Server port.", "port", "8080");
+    QCommandLineOption connectionsOption(QStringList() << "c" << "connections", "Number of connections.", "count", "100");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", "Seconds to run after connecting.", "seconds", "10");
+    QCommandLineOption actionOption("action", "Action sent by every connection.", "name", "getProducts");
+    QCommandLineOption payloadOption("payload", "Request payload as a JSON object.", "json", "{\"limit\":50}");
+    QCommandLineOption idleOption("idle", "Only open the connections and keep them idle.");
+    QCommandLineOption pidOption("server-pid", "Server process id; its RSS and thread count are reported (Linux).", "pid");
+    QCommandLineOption encodingOption("encoding", "Message encoding: json or cbor (cbor negotiates length-prefixed framing).",
+                                      "name", "json");
+    QCommandLineOption compressOption("compress", "Negotiate zlib compression of large responses.");
+    QCommandLineOption loginOption("login", "Log every connection in first (for actions that need a user).", "user:password");
+    QCommandLineOption wireStatsOption("wire-stats", "Report per-action bytes and server encode/decode time for this run.");
+    parser.addOption(hostOption);
+    parser.addOption(portOption);
+    parser.addOption(connectionsOption);
+    parser.addOption(durationOption);
+    parser.addOption(actionOption);
+    parser.addOption(payloadOption);
+    parser.addOption(idleOption);
+    parser.addOption(pidOption);
+    parser.addOption(encodingOption);
+    parser.addOption(compressOption);
+    parser.addOption(loginOption);
+    parser.addOption(wireStatsOption);
+    parser.process(app);
+
+    LoadConfig config;
+    config.host = parser.value(hostOption);
+    config.port = parser.value(portOption).toUShort();
+    config.connections = qMax(1, parser.value(connectionsOption).toInt());
+    config.durationSeconds = qMax(1, parser.value(durationOption).toInt());
+    config.idle = parser.isSet(idleOption);
+    if (!WireProtocol::encodingFromString(parser.value(encodingOption), &config.encoding)) {
+        QTextStream(stderr) << "Unknown encoding " << parser.value(encodingOption) << " (expected json or cbor)" << Qt::endl;
+        return 1;
+    }
+    config.compress = parser.isSet(compressOption);
+    const bool wireStats = parser.isSet(wireStatsOption);
+    if (parser.isSet(loginOption)) {
+        const QString login = parser.value(loginOption);
+        config.username = login.section(':', 0, 0);
+        config.password = login.section(':', 1);
+    }
+    config.request["action"] = parser.value(actionOption);
+    config.request["payload"] = QJsonDocument::fromJson(parser.value(payloadOption).toUtf8()).object();
+    const qint64 serverPid = parser.value(pidOption).toLongLong();
+
+    QTextStream out(stdout);
+    const ProcessSample before = sampleProcess(serverPid);
+    QJsonObject wireBefore;
+    ProcessSample runBefore;
+    QList<qint64> latenciesUs;
+    QList<LoadConnection*> connections;
+    for (int i = 0; i < config.connections; ++i) connections.append(new LoadConnection(config, i, &latenciesUs, &app));
+
+    // 先等连接建立（最多 10 秒），之后才开始计时，握手的代价不算进吞吐
+    QElapsedTimer runTimer;
+    QTimer connectWait;
+    QObject::connect(&connectWait, &QTimer::timeout, &app, [&]() {
+        static int waited = 0;
+        const int connected = int(std::count_if(connections.begin(), connections.end(),
+                                                [](const LoadConnection* c) { return c->isConnected(); }));
+        if (connected < config.connections && ++waited < 100) return;
+        connectWait.stop();
+        out << "connected=" << connected << "/" << config.connections << Qt::endl;
+        latenciesUs.clear(); // 连接建立期间已完成的请求不计入
+        for (LoadConnection* c : std::as_const(connections)) c->resetDecodeTime();
+        if (wireStats) wireBefore = fetchWireStats(config);
+        runBefore = sampleProcess(serverPid); // CPU 时间只算计时期间的
+        runTimer.start();
+        QTimer::singleShot(config.durationSeconds * 1000, &app, [&, connected]() {
+            for (LoadConnection* c : std::as_const(connections)) c->stop();
+            const double seconds = runTimer.nsecsElapsed() / 1e9;
+            const ProcessSample after = sampleProcess(serverPid);
+            qint64 errors = 0;
+            qint64 decodeNs = 0;
+            for (const LoadConnection* c : std::as_const(connections)) {
+                errors += c->errors();
+                decodeNs += c->decodeNs();
+            }
+            std::sort(latenciesUs.begin(), latenciesUs.end());
+            out << "connections=" << connected << " seconds=" << QString::number(seconds, 'f', 2)
+                << " requests=" << latenciesUs.size() << " errors=" << errors
+                << " rps=" << QString::number(latenciesUs.size() / seconds, 'f', 0)
+                << " p50_us=" << percentile(latenciesUs, 0.50) << " p99_us=" << percentile(latenciesUs, 0.99);
+            if (after.rssKb >= 0) {
+                out << " server_rss_kb=" << after.rssKb << " (+" << (after.rssKb - before.rssKb) << ")"
+                    << " server_threads=" << after.threads << " (+" << (after.threads - before.threads) << ")";
+            }
+            if (after.cpuSeconds >= 0 && runBefore.cpuSeconds >= 0) {
+                const double cpu = after.cpuSeconds - runBefore.cpuSeconds;
+                out << " server_cpu_s=" << QString::number(cpu, 'f', 2)
+                    << " rps_per_cpu=" << QString::number(cpu > 0 ? latenciesUs.size() / cpu : 0.0, 'f', 0);
+            }
+            if (!latenciesUs.isEmpty()) {
+                out << " encoding=" << WireProtocol::encodingToString(config.encoding)
+                    << " client_avg_decode_us=" << QString::number(decodeNs / 1000.0 / latenciesUs.size(), 'f', 2);
+            }
+            out << Qt::endl;
+            if (wireStats) printWireDelta(out, wireBefore, fetchWireStats(config));
+            app.quit();
+        });
+    });
+    connectWait.start(100);
+
+    return app.exec();
+}
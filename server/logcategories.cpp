@@ -0,0 +1,5 @@
+#include "logcategories.h"
+
+Q_LOGGING_CATEGORY(lcServer, "server", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcNet, "server.net", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcRequest, "server.request", QtInfoMsg)
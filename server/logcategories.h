@@ -0,0 +1,15 @@
+#ifndef LOGCATEGORIES_H
+#define LOGCATEGORIES_H
+
+#include <QLoggingCategory>
+
+// 服务器的日志分类。级别可以在运行时通过规则调整（--log-rules / --log-rules-file），例如：
+//   server.request.debug=true   打开每条请求/响应的完整内容
+//   server.net.debug=false
+// qCDebug(lcRequest) << ... 在该级别关闭时不会对 << 右边的表达式求值，
+// 所以请求路径上的 JSON 序列化只在需要时才发生。
+Q_DECLARE_LOGGING_CATEGORY(lcServer)  // "server"：启动、统计等
+Q_DECLARE_LOGGING_CATEGORY(lcNet)     // "server.net"：连接建立/断开、线程分配
+Q_DECLARE_LOGGING_CATEGORY(lcRequest) // "server.request"：收发的每条消息，debug 默认关闭
+
+#endif // LOGCATEGORIES_H
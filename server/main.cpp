@@ -1,14 +1,209 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include "server.h" // To be created
+#include "asynclogger.h"
+#include "filemanager.h"
+#include "sharding.h"
+#include "shardrouter.h"
+#include "credentialhasher.h"
 
 int main(int argc, char *argv[]) {
     QCoreApplication a(argc, argv);
-    Server server;
-    quint16 port = 8080;
-    if (!server.startServer(port)) {
-        qCritical() << "Server could not start on port" << port;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Listening port.", "port", "8080");
+    QCommandLineOption workersOption(QStringList() << "w" << "workers",
+                                     "Number of connection worker threads (0 = CPU core count).", "count", "0");
+    QCommandLineOption requestThreadsOption("request-threads",
+                                            "Number of request execution threads (0 = CPU core count).", "count", "0");
+    QCommandLineOption backendOption("backend", "Network backend: qt or epoll (Linux only).", "name", "qt");
+    QCommandLineOption statsOption("stats-interval", "Seconds between metrics log dumps (0 = off).", "seconds", "60");
+    AdmissionConfig admission;
+    QCommandLineOption connRateOption("conn-rate", "Requests per second allowed per connection (0 = unlimited).",
+                                      "rate", QString::number(admission.connectionRate));
+    QCommandLineOption connBurstOption("conn-burst", "Burst size per connection.", "count", QString::number(admission.connectionBurst));
+    QCommandLineOption userRateOption("user-rate", "Requests per second allowed per logged-in user (0 = unlimited).",
+                                      "rate", QString::number(admission.userRate));
+    QCommandLineOption userBurstOption("user-burst", "Burst size per user.", "count", QString::number(admission.userBurst));
+    QCommandLineOption maxInFlightOption("max-in-flight", "Global cap on accepted but unanswered requests (0 = unlimited).",
+                                         "count", QString::number(admission.maxInFlight));
+    QCommandLineOption maxQueuedOption("max-queued", "Per-connection cap on queued ordered requests (0 = unlimited).",
+                                       "count", QString::number(admission.maxQueuedPerConnection));
+    CompressionConfig compression;
+    QCommandLineOption compressThresholdOption("compress-threshold",
+                                               "Compress responses of at least this many bytes for clients that negotiate it (0 = never).",
+                                               "bytes", QString::number(compression.threshold));
+    QCommandLineOption compressLevelOption("compress-level", "zlib compression level (1-9).", "level",
+                                           QString::number(compression.level));
+    QCommandLineOption dataDirOption("data-dir", "Directory holding users/products/cart/order JSON files (required for shards and replicas).", "path");
+    QCommandLineOption shardsOption("shards", "Comma-separated host:port list of all shards, in shard order.", "list");
+    QCommandLineOption shardIndexOption("shard-index", "Run as this shard (requires --shards and --shard-secret).", "index");
+    QCommandLineOption shardSecretOption("shard-secret", "Shared secret for router/shard internal requests.", "secret");
+    QCommandLineOption routerOption("router", "Run as the routing front end for --shards instead of serving data.");
+    QCommandLineOption rebalanceFromOption("rebalance-from",
+                                           "Offline rebalance: comma-separated data directories of the current shards.", "dirs");
+    QCommandLineOption rebalanceToOption("rebalance-to",
+                                         "Offline rebalance: comma-separated data directories of the new shards.", "dirs");
+    QCommandLineOption replicaOfOption("replica-of",
+                                       "Run as a read-only catalog replica of the primary at host:port (never writes to --data-dir).", "address");
+    QCommandLineOption sessionTtlOption("session-ttl", "Seconds a login session token stays valid after its last use.",
+                                        "seconds", "3600");
+    QCommandLineOption sessionMaxLifetimeOption("session-max-lifetime",
+                                                "Seconds a login session token stays valid after login, however often it is used.",
+                                                "seconds", "86400");
+    QCommandLineOption hashThreadsOption("hash-threads", "Threads dedicated to password hashing.", "count",
+                                         QString::number(CredentialHasher::DefaultThreads));
+    QCommandLineOption hashIterationsOption("hash-iterations",
+                                            "PBKDF2 iterations for password hashes; weaker stored hashes are upgraded at login.",
+                                            "count", QString::number(CredentialHasher::DefaultIterations));
+    QCommandLineOption logFileOption("log-file", "Write logs to this file instead of stderr.", "path");
+    QCommandLineOption logRulesOption("log-rules",
+                                      "Logging filter rules, e.g. \"server.request.debug=true;server.net.debug=false\".", "rules");
+    QCommandLineOption logRulesFileOption("log-rules-file", "File with logging filter rules, re-applied whenever it changes.", "path");
+    parser.addOption(portOption);
+    parser.addOption(workersOption);
+    parser.addOption(requestThreadsOption);
+    parser.addOption(backendOption);
+    parser.addOption(statsOption);
+    parser.addOption(connRateOption);
+    parser.addOption(connBurstOption);
+    parser.addOption(userRateOption);
+    parser.addOption(userBurstOption);
+    parser.addOption(maxInFlightOption);
+    parser.addOption(maxQueuedOption);
+    parser.addOption(compressThresholdOption);
+    parser.addOption(compressLevelOption);
+    parser.addOption(dataDirOption);
+    parser.addOption(shardsOption);
+    parser.addOption(shardIndexOption);
+    parser.addOption(shardSecretOption);
+    parser.addOption(routerOption);
+    parser.addOption(rebalanceFromOption);
+    parser.addOption(rebalanceToOption);
+    parser.addOption(replicaOfOption);
+    parser.addOption(sessionTtlOption);
+    parser.addOption(sessionMaxLifetimeOption);
+    parser.addOption(hashThreadsOption);
+    parser.addOption(hashIterationsOption);
+    parser.addOption(logFileOption);
+    parser.addOption(logRulesOption);
+    parser.addOption(logRulesFileOption);
+    parser.process(a);
+
+    AsyncLogger::install(parser.value(logFileOption));
+    if (parser.isSet(logRulesOption)) AsyncLogger::setRules(parser.value(logRulesOption));
+    if (parser.isSet(logRulesFileOption)) AsyncLogger::watchRulesFile(parser.value(logRulesFileOption), &a);
+
+    Server::Backend backend = Server::Backend::Qt;
+    const QString backendName = parser.value(backendOption).toLower();
+    if (backendName == "epoll") {
+        backend = Server::Backend::Epoll;
+    } else if (backendName != "qt") {
+        qCritical() << "Unknown backend" << backendName << "(expected qt or epoll)";
+        AsyncLogger::shutdown();
         return -1;
     }
-    qInfo() << "Server started on port" << port;
-    return a.exec();
+
+    admission.connectionRate = parser.value(connRateOption).toDouble();
+    admission.connectionBurst = parser.value(connBurstOption).toDouble();
+    admission.userRate = parser.value(userRateOption).toDouble();
+    admission.userBurst = parser.value(userBurstOption).toDouble();
+    admission.maxInFlight = parser.value(maxInFlightOption).toInt();
+    admission.maxQueuedPerConnection = parser.value(maxQueuedOption).toInt();
+    compression.threshold = parser.value(compressThresholdOption).toInt();
+    compression.level = qBound(1, parser.value(compressLevelOption).toInt(), 9);
+
+    if (parser.isSet(rebalanceFromOption) || parser.isSet(rebalanceToOption)) {
+        QString error;
+        bool ok = Sharding::rebalance(parser.value(rebalanceFromOption).split(',', Qt::SkipEmptyParts),
+                                      parser.value(rebalanceToOption).split(',', Qt::SkipEmptyParts), &error);
+        if (!ok) qCritical() << "Rebalance failed:" << error;
+        AsyncLogger::shutdown();
+        return ok ? 0 : -1;
+    }
+
+    ShardConfig shard;
+    if (parser.isSet(shardsOption)) {
+        QString error;
+        if (!Sharding::parseShardList(parser.value(shardsOption), &shard.shards, &error)) {
+            qCritical() << error;
+            AsyncLogger::shutdown();
+            return -1;
+        }
+        shard.count = int(shard.shards.size());
+        shard.secret = parser.value(shardSecretOption);
+        shard.index = parser.value(shardIndexOption).toInt();
+        if (shard.secret.isEmpty() || shard.index < 0 || shard.index >= shard.count
+            || (!parser.isSet(routerOption) && !parser.isSet(shardIndexOption))) {
+            qCritical() << "--shards requires --shard-secret and either --router or a valid --shard-index";
+            AsyncLogger::shutdown();
+            return -1;
+        }
+    }
+
+    int exitCode = 0;
+    if (parser.isSet(routerOption)) {
+        if (!shard.enabled()) {
+            qCritical() << "--router requires --shards with at least two shards";
+            AsyncLogger::shutdown();
+            return -1;
+        }
+        ShardRouter router(shard, compression);
+        quint16 port = parser.value(portOption).toUShort();
+        if (!router.listen(QHostAddress::Any, port)) {
+            qCritical() << "Router could not start on port" << port << ":" << router.errorString();
+            exitCode = -1;
+        } else {
+            qInfo() << "Router started on port" << port << "for" << shard.count << "shards";
+            exitCode = a.exec();
+        }
+        AsyncLogger::shutdown();
+        return exitCode;
+    }
+
+    Sharding::ShardAddress primary;
+    if (parser.isSet(replicaOfOption)) {
+        QList<Sharding::ShardAddress> addresses;
+        QString error;
+        if (!Sharding::parseShardList(parser.value(replicaOfOption), &addresses, &error) || addresses.size() != 1
+            || shard.enabled()) {
+            qCritical() << "--replica-of expects a single host:port and cannot be combined with --shards";
+            AsyncLogger::shutdown();
+            return -1;
+        }
+        primary = addresses.first();
+    }
+
+    // 默认目录是开发机上的路径；分片和副本必须各自指定，以免多个进程读写同一份数据
+    if ((parser.isSet(shardsOption) || parser.isSet(replicaOfOption)) && !parser.isSet(dataDirOption)) {
+        qCritical() << "--shards and --replica-of require --data-dir";
+        AsyncLogger::shutdown();
+        return -1;
+    }
+    // 必须在各 manager 加载数据之前设置
+    if (parser.isSet(dataDirOption)) FileManager::setDataDirectory(parser.value(dataDirOption));
+    if (primary.port != 0) FileManager::setReadOnly(true); // 副本只读不写，也不打开账本和发件箱
+
+    {
+        Server server(parser.value(workersOption).toInt(), parser.value(requestThreadsOption).toInt(), admission);
+        server.setStatsInterval(parser.value(statsOption).toInt());
+        server.setCompression(compression);
+        server.setSessionTtl(qMax(60, parser.value(sessionTtlOption).toInt()));
+        server.setSessionMaxLifetime(qMax(60, parser.value(sessionMaxLifetimeOption).toInt()));
+        server.setHashing(qMax(1, parser.value(hashThreadsOption).toInt()), parser.value(hashIterationsOption).toInt());
+        if (shard.enabled()) server.setShardConfig(shard);
+        if (primary.port != 0) server.setReplicaOf(primary.host, primary.port);
+        quint16 port = parser.value(portOption).toUShort();
+        if (!server.startServer(port, backend)) {
+            qCritical() << "Server could not start on port" << port;
+            exitCode = -1;
+        } else {
+            qInfo() << "Server started on port" << port;
+            exitCode = a.exec();
+        }
+    }
+    // Server 析构时已等所有请求线程结束，此后不会再有线程写日志
+    AsyncLogger::shutdown();
+    return exitCode;
 }
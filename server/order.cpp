@@ -91,6 +91,7 @@ QList<QVariant> Order::getQmlItems() const {
         Product* product = it.key();
         int quantity = it.value();
         QVariantMap map;
+        map["productId"] = qint64(product->getId());
         map["name"] = product->getName();
         map["description"] = product->getDescription();
         map["price"] = product->getPrice();
@@ -0,0 +1,75 @@
+#include "outputqueue.h"
+#include <QTcpSocket>
+#include <QDebug>
+
+OutputQueue::OutputQueue(QTcpSocket* socket, QObject* parent)
+    : QObject(parent), m_socket(socket) {
+    connect(m_socket, &QTcpSocket::bytesWritten, this, &OutputQueue::drain);
+}
+
+void OutputQueue::setWaterMarks(qint64 low, qint64 high) {
+    m_lowWaterMark = low;
+    m_highWaterMark = qMax(low, high);
+    updateWaterMark();
+}
+
+qint64 OutputQueue::pendingBytes() const {
+    return m_queuedBytes + m_socket->bytesToWrite();
+}
+
+void OutputQueue::enqueue(const QByteArray& frame) {
+    if (frame.isEmpty()) return;
+    m_frames.enqueue(frame);
+    m_queuedBytes += frame.size();
+    scheduleDrain();
+    updateWaterMark();
+}
+
+void OutputQueue::scheduleDrain() {
+    // 推迟到本轮事件处理结束，期间入队的帧一起写出
+    if (m_drainScheduled) return;
+    m_drainScheduled = true;
+    QMetaObject::invokeMethod(this, &OutputQueue::drain, Qt::QueuedConnection);
+}
+
+void OutputQueue::drain() {
+    m_drainScheduled = false;
+    if (!m_socket->isOpen() || !m_socket->isWritable()) {
+        m_frames.clear();
+        m_queuedBytes = 0;
+        updateWaterMark();
+        return;
+    }
+
+    // socket 写缓冲还有较多数据时不再追加，等下一次 bytesWritten
+    while (!m_frames.isEmpty() && m_socket->bytesToWrite() < WriteChunk) {
+        QByteArray batch = m_frames.dequeue();
+        if (batch.size() < WriteChunk && !m_frames.isEmpty()) {
+            batch.reserve(WriteChunk);
+            while (!m_frames.isEmpty() && batch.size() + m_frames.head().size() <= WriteChunk) {
+                batch.append(m_frames.dequeue());
+            }
+        }
+        m_queuedBytes -= batch.size();
+
+        // QTcpSocket 总是把整批收进自己的写缓冲（不会部分写入），积压由上面的 bytesToWrite() 控制
+        if (m_socket->write(batch) < 0) {
+            qWarning() << "OutputQueue: write failed:" << m_socket->errorString();
+            m_frames.clear();
+            m_queuedBytes = 0;
+            break;
+        }
+    }
+    updateWaterMark();
+}
+
+void OutputQueue::updateWaterMark() {
+    const qint64 pending = pendingBytes();
+    if (!m_aboveHighWater && pending > m_highWaterMark) {
+        m_aboveHighWater = true;
+        emit highWaterReached();
+    } else if (m_aboveHighWater && pending <= m_lowWaterMark) {
+        m_aboveHighWater = false;
+        emit drained();
+    }
+}
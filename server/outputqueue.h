@@ -0,0 +1,51 @@
+#ifndef OUTPUTQUEUE_H
+#define OUTPUTQUEUE_H
+
+#include <QObject>
+#include <QQueue>
+#include <QByteArray>
+
+class QTcpSocket;
+
+// 每个连接一个的发送队列（server 与 server-v2 各保留一份相同的拷贝）。
+// 同一轮事件循环内入队的多条帧合并成一次 write()，之后由 bytesWritten 驱动继续写出；
+// 交给 socket 的数据不超过 WriteChunk，其余留在队列里，这样积压量可见、可控。
+// 积压（队列 + socket 写缓冲）超过高水位时发出 highWaterReached()，调用方应暂停读取；
+// 回落到低水位以下时发出 drained()。
+class OutputQueue : public QObject {
+    Q_OBJECT
+public:
+    static constexpr qint64 DefaultLowWaterMark = 1 * 1024 * 1024;
+    static constexpr qint64 DefaultHighWaterMark = 4 * 1024 * 1024;
+    static constexpr qint64 WriteChunk = 256 * 1024;
+
+    explicit OutputQueue(QTcpSocket* socket, QObject* parent = nullptr);
+
+    void enqueue(const QByteArray& frame);
+    void setWaterMarks(qint64 low, qint64 high);
+
+    qint64 pendingBytes() const; // 尚未发出的字节数：队列 + socket 写缓冲
+    int pendingFrames() const { return m_frames.size(); }
+    bool isAboveHighWater() const { return m_aboveHighWater; }
+
+signals:
+    void highWaterReached();
+    void drained();
+
+private slots:
+    void drain();
+
+private:
+    void scheduleDrain();
+    void updateWaterMark();
+
+    QTcpSocket* m_socket;
+    QQueue<QByteArray> m_frames;
+    qint64 m_queuedBytes = 0;
+    qint64 m_lowWaterMark = DefaultLowWaterMark;
+    qint64 m_highWaterMark = DefaultHighWaterMark;
+    bool m_drainScheduled = false;
+    bool m_aboveHighWater = false;
+};
+
+#endif // OUTPUTQUEUE_H
@@ -5,6 +5,7 @@
 
 class Product {
 protected:
+    quint64 id = 0; // 创建时分配，之后不变；改名不影响购物车和订单中的引用
     QString name;
     QString description;
     double basePrice;
@@ -30,6 +31,7 @@ public:
 
     virtual ~Product() = default;
 
+    quint64 getId() const { return id; }
     double getBasePrice() const { return basePrice; }
     virtual double getPrice() const = 0;
     QString getName() const { return name; }
@@ -41,6 +43,7 @@ public:
     QString getMerchantUsername() const { return merchantUsername; }
     int getFrozenStock() const { return frozenStock; }
 
+    void setId(quint64 i) { id = i; }
     void setPrice(double p) { basePrice = p; }
     void setDescription(const QString &d) { description = d; }
     void setName(const QString &n) { name = n; }
@@ -0,0 +1,181 @@
+#include "searchindex.h"
+#include "product.h"
+#include <QPair>
+#include <algorithm>
+#include <cmath>
+
+static bool isCjk(char32_t ucs4) {
+    switch (QChar::script(ucs4)) {
+    case QChar::Script_Han:
+    case QChar::Script_Hiragana:
+    case QChar::Script_Katakana:
+    case QChar::Script_Hangul:
+    case QChar::Script_Bopomofo:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 把文本切成连续的段：中日韩文字一段，其他字母数字一段，其余字符作为分隔。
+// 每段以码点列表给出（扩展区汉字是代理对，不能按 QChar 切）
+template <typename Fn>
+static void forEachRun(const QString& text, Fn fn) {
+    QStringList run;
+    bool runCjk = false;
+    auto flush = [&]() {
+        if (!run.isEmpty()) fn(run, runCjk);
+        run.clear();
+    };
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        char32_t ucs4 = text[i].unicode();
+        qsizetype width = 1;
+        if (text[i].isHighSurrogate() && i + 1 < text.size() && text[i + 1].isLowSurrogate()) {
+            ucs4 = QChar::surrogateToUcs4(text[i], text[i + 1]);
+            width = 2;
+        }
+        const QString ch = text.mid(i, width);
+        i += width - 1;
+        if (isCjk(ucs4)) {
+            if (!runCjk) flush();
+            runCjk = true;
+            run.append(ch);
+        } else if (QChar::isLetterOrNumber(ucs4)) {
+            if (runCjk) flush();
+            runCjk = false;
+            run.append(ch);
+        } else {
+            flush();
+        }
+    }
+    flush();
+}
+
+QStringList SearchIndex::indexTokens(const QString& normalized) {
+    QStringList tokens;
+    forEachRun(normalized, [&tokens](const QStringList& run, bool cjk) {
+        // 每个位置起长度 1..n 的片段：短片段供短查询直接命中，最长的片段供更长的查询取交集
+        const qsizetype n = cjk ? CjkGram : LatinGram;
+        for (qsizetype i = 0; i < run.size(); ++i) {
+            QString gram;
+            for (qsizetype k = 0; k < n && i + k < run.size(); ++k) {
+                gram += run[i + k];
+                tokens.append(gram);
+            }
+        }
+    });
+    return tokens;
+}
+
+QList<SearchIndex::Term> SearchIndex::queryTerms(const QString& normalized) {
+    QList<Term> terms;
+    forEachRun(normalized, [&terms](const QStringList& run, bool cjk) {
+        // 不长于 n 的一段本身就是索引过的片段；更长的取其中所有长度为 n 的片段
+        const qsizetype n = cjk ? CjkGram : LatinGram;
+        Term term;
+        if (run.size() <= n) term.keys.append(run.join(QString()));
+        for (qsizetype i = 0; run.size() > n && i + n <= run.size(); ++i) term.keys.append(run.mid(i, n).join(QString()));
+        terms.append(term);
+    });
+    return terms;
+}
+
+void SearchIndex::clear() {
+    m_docs.clear();
+    for (auto& postings : m_postings) postings.clear();
+}
+
+void SearchIndex::addTokens(Product* product, Field field, const QString& normalized) {
+    for (const QString& token : indexTokens(normalized)) ++m_postings[field][token][product];
+}
+
+void SearchIndex::add(Product* product) {
+    if (!product || m_docs.contains(product)) return;
+    Document doc;
+    doc.text[Name] = normalize(product->getName());
+    doc.text[Description] = normalize(product->getDescription());
+    for (int field = 0; field < FieldCount; ++field) addTokens(product, Field(field), doc.text[field]);
+    m_docs.insert(product, doc);
+}
+
+void SearchIndex::remove(Product* product) {
+    auto docIt = m_docs.constFind(product);
+    if (docIt == m_docs.constEnd()) return;
+    for (int field = 0; field < FieldCount; ++field) {
+        auto& postings = m_postings[field];
+        for (const QString& token : indexTokens(docIt->text[field])) {
+            auto it = postings.find(token);
+            if (it == postings.end()) continue;
+            it->remove(product);
+            if (it->isEmpty()) postings.erase(it);
+        }
+    }
+    m_docs.erase(docIt);
+}
+
+QList<Product*> SearchIndex::search(const QString& keyword, Field field, QList<double>* scores) const {
+    const QString query = normalize(keyword.trimmed());
+    if (query.isEmpty()) return {};
+    const auto& postings = m_postings[field];
+    QList<QPair<double, Product*>> scored;
+
+    const QList<Term> terms = queryTerms(query);
+    if (terms.isEmpty()) {
+        // 只有标点等不参与分词的字符，只能逐个比对（很少见）
+        for (auto it = m_docs.constBegin(); it != m_docs.constEnd(); ++it) {
+            if (it->text[field].contains(query)) scored.append({0.0, it.key()});
+        }
+    } else {
+        // 每段文字取其中最少见的词条计算权重（idf），所有词条的倒排表用于取交集
+        struct TermLists {
+            QList<const QHash<Product*, int>*> lists;
+            double idf = 0.0;
+        };
+        QList<TermLists> termLists;
+        QList<const QHash<Product*, int>*> all;
+        for (const Term& term : terms) {
+            TermLists tl;
+            qsizetype df = 0;
+            for (const QString& key : term.keys) {
+                auto it = postings.constFind(key);
+                if (it == postings.constEnd()) return {}; // 有一个词条不存在就没有结果
+                tl.lists.append(&*it);
+                all.append(&*it);
+                df = df == 0 ? it->size() : qMin(df, it->size());
+            }
+            tl.idf = std::log(1.0 + double(m_docs.size()) / double(df));
+            termLists.append(tl);
+        }
+        // 从最短的倒排表出发，在其余表中逐个确认；各片段都出现不代表它们连在一起，最后用原文核对整个关键词
+        std::sort(all.begin(), all.end(), [](auto a, auto b) { return a->size() < b->size(); });
+        for (auto it = all.first()->constBegin(); it != all.first()->constEnd(); ++it) {
+            Product* product = it.key();
+            if (!std::all_of(all.begin() + 1, all.end(), [product](auto list) { return list->contains(product); })) continue;
+            const QString& text = m_docs.constFind(product)->text[field];
+            if (!text.contains(query)) continue;
+            double score = 0.0;
+            for (qsizetype i = 0; i < terms.size(); ++i) {
+                int tf = 0;
+                for (auto list : termLists[i].lists) tf = tf == 0 ? list->value(product) : qMin(tf, list->value(product));
+                score += tf * termLists[i].idf;
+            }
+            if (text.startsWith(query)) score += 1.0; // 整个关键词出现在开头（通常就是要找的那个商品）
+            if (text == query) score += 1.0;
+            scored.append({score, product});
+        }
+    }
+
+    std::sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) {
+        if (a.first != b.first) return a.first > b.first;
+        return a.second->getId() < b.second->getId(); // 分数相同时顺序固定
+    });
+    QList<Product*> result;
+    result.reserve(scored.size());
+    for (const auto& entry : std::as_const(scored)) result.append(entry.second);
+    if (scores) {
+        scores->clear();
+        scores->reserve(scored.size());
+        for (const auto& entry : std::as_const(scored)) scores->append(entry.first);
+    }
+    return result;
+}
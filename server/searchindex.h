@@ -0,0 +1,51 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+
+class Product;
+
+// 商品名称和描述的倒排索引，供 searchProducts 使用，查询代价取决于命中数量而不是商品总数。
+// 分词：中日韩文字索引单字和相邻两字（bigram），拉丁字母和数字索引一到三个字符的片段（n-gram），不依赖空格，
+// 词中间的子串（"pho" 之于 "smartphone"）也能查到。查询时各片段的倒排表取交集，候选再用原文核对整个关键词，
+// 结果与子串匹配一致。
+// 本类不加锁：由 ServerProductManager 在目录写锁下修改，在读锁下查询。
+class SearchIndex {
+public:
+    enum Field { Name = 0, Description = 1, FieldCount };
+
+    void clear();
+    void add(Product* product);    // 读取商品当前的名称和描述
+    void remove(Product* product); // 按加入时的文本删除，不读取商品字段（商品可能已被删除）
+    void update(Product* product) { remove(product); add(product); }
+
+    // 按相关度从高到低返回，相关度相同时按 ID 升序；*scores 为对应的相关度。
+    // keyword 为空时返回空列表，由调用方决定是否返回全部
+    QList<Product*> search(const QString& keyword, Field field, QList<double>* scores = nullptr) const;
+
+private:
+    static constexpr int CjkGram = 2;   // 中日韩文字索引的最长片段
+    static constexpr int LatinGram = 3; // 拉丁字母和数字索引的最长片段
+
+    struct Document {
+        QString text[FieldCount]; // 规范化（大小写折叠）后的文本
+    };
+    // 查询中的一段连续文字：keys 为要取交集的词条
+    struct Term {
+        QStringList keys;
+    };
+
+    static QString normalize(const QString& text) { return text.toCaseFolded(); }
+    static QStringList indexTokens(const QString& normalized);
+    static QList<Term> queryTerms(const QString& normalized);
+
+    void addTokens(Product* product, Field field, const QString& normalized);
+
+    QHash<Product*, Document> m_docs;
+    QHash<QString, QHash<Product*, int>> m_postings[FieldCount]; // 词条 -> (商品 -> 出现次数)
+};
+
+#endif // SEARCHINDEX_H
@@ -6,72 +6,146 @@
 #include "servershoppingcartmanager.h"
 #include "serverordermanager.h"
 #include "filemanager.h" // Ensure FileManager paths are correct for server environment
+#include "workerpool.h"
+#include "epollserver.h"
+#include "eventhub.h"
+#include "catalogreplica.h"
+#include "servermetrics.h"
+#include "logcategories.h"
 #include <QThread>
-#include <cstdio>
-#include <stdio.h>
+#include <QThreadPool>
 #include <QTimer>
 
-Server::Server(QObject *parent) : QTcpServer(parent) {
+Server::Server(int workerThreads, int requestThreads, const AdmissionConfig& admission, QObject *parent)
+    : QTcpServer(parent), m_workerThreads(workerThreads), m_admission(admission) {
     // Initialize server-side managers
     // These will use FileManager to interact with data files.
     m_authManager = new ServerAuthManager(this);
     m_productManager = new ServerProductManager(this);
     m_shoppingCartManager = new ServerShoppingCartManager(m_productManager, this);
     m_orderManager = new ServerOrderManager(m_productManager, m_authManager, m_shoppingCartManager, this);
-    qInfo() << "Server initialized with managers.";
+    m_eventHub = new EventHub(m_productManager, m_shoppingCartManager, m_orderManager, this);
+    // 请求在独立的线程池中执行，慢请求（写文件、支付）不会卡住同一工作线程上其他连接的收发
+    m_requestPool = new QThreadPool(this);
+    if (requestThreads > 0) m_requestPool->setMaxThreadCount(requestThreads);
+    m_context = ServerContext{m_authManager, m_productManager, m_shoppingCartManager, m_orderManager,
+                              m_requestPool, &m_admission, m_eventHub, &m_sessions, &m_catalogCache};
+    m_statsTimer = new QTimer(this);
+    connect(m_statsTimer, &QTimer::timeout, this, &Server::logStats);
+    qInfo() << "Server initialized with managers and" << m_requestPool->maxThreadCount() << "request threads.";
 }
 
 Server::~Server() {
-    // m_clients list items are QObjects with parent, auto-deleted (or handle manually if moved to threads without parent)
+    // 先等正在执行的请求结束，再停掉网络线程，避免会话在 manager 析构后仍访问它们
+    m_requestPool->waitForDone();
+    m_authManager->waitForHashing(); // 哈希完成后还要经网络线程回复
+#ifdef Q_OS_LINUX
+    delete m_epollServer;
+    m_epollServer = nullptr;
+#endif
+    delete m_workerPool;
+    m_workerPool = nullptr;
     // Managers are parented to Server, auto-deleted.
 }
 
-bool Server::startServer(quint16 port) {
+void Server::setHashing(int threads, int iterations) {
+    m_authManager->setHashing(threads, iterations);
+}
+
+void Server::setShardConfig(const ShardConfig& config) {
+    m_context.shard = config;
+    m_authManager->setShardConfig(config);
+    m_sessions.setTokenPrefix(QString::number(config.index)); // 路由器按前缀把 resume 转给签发令牌的分片
+    qInfo() << "Server: Running as shard" << config.index << "of" << config.count;
+}
+
+void Server::setReplicaOf(const QString& primaryHost, quint16 primaryPort) {
+    if (!FileManager::isReadOnly()) {
+        qWarning() << "Server: Replica mode set after the managers loaded with write access; disabling writes now.";
+        FileManager::setReadOnly(true);
+    }
+    m_context.readOnlyReplica = true;
+    m_replica = new CatalogReplica(m_productManager, primaryHost, primaryPort, this);
+    m_replica->start();
+    qInfo() << "Server: Running as read-only catalog replica of" << primaryHost << primaryPort;
+}
+
+bool Server::startServer(quint16 port, Backend backend) {
+    if (backend == Backend::Epoll) {
+#ifdef Q_OS_LINUX
+        m_epollServer = new EpollServer(m_workerThreads, m_context);
+        QString error;
+        if (!m_epollServer->listen(port, &error)) {
+            qCritical() << "Server: Unable to start epoll backend -" << error;
+            delete m_epollServer;
+            m_epollServer = nullptr;
+            return false;
+        }
+        qInfo() << "Server: Listening on port" << port << "(epoll backend," << m_epollServer->threadCount() << "threads)";
+        return true;
+#else
+        qCritical() << "Server: The epoll backend is only available on Linux.";
+        return false;
+#endif
+    }
+
+    // 线程在这里一次性创建，之后的连接只做分配，不再有线程启动/销毁开销
+    m_workerPool = new WorkerPool(m_workerThreads, this);
     if (!listen(QHostAddress::Any, port)) {
         qCritical() << "Server: Unable to start -" << errorString();
         return false;
     }
-    qInfo() << "Server: Listening on port" << port;
+    qInfo() << "Server: Listening on port" << port << "(Qt backend," << m_workerPool->threadCount() << "worker threads)";
     return true;
 }
 
+void Server::setStatsInterval(int seconds) {
+    if (seconds > 0) {
+        m_statsTimer->start(seconds * 1000);
+    } else {
+        m_statsTimer->stop();
+    }
+}
+
+void Server::logStats() {
+    int connections = int(m_clients.count());
+#ifdef Q_OS_LINUX
+    if (m_epollServer) connections = m_epollServer->connectionCount();
+#endif
+    ServerMetrics::instance().setGauge("connections", connections);
+    ServerMetrics::instance().setGauge("requestThreadsActive", m_requestPool->activeThreadCount());
+    ServerMetrics::instance().setGauge("inFlight", m_admission.inFlight());
+    qCInfo(lcServer).noquote() << "Server stats:\n" + ServerMetrics::instance().report();
+}
+
 void Server::incomingConnection(qintptr socketDescriptor) {
-    fprintf(stderr, "SERVER DEBUG: incomingConnection ENTERED with descriptor: %lld\n", static_cast<long long>(socketDescriptor));
-    fflush(stderr);
-    qDebug() << "\n=== 新连接到达 ===";
-    qDebug() << "服务器：收到新连接，描述符：" << socketDescriptor;
-    
+    qCDebug(lcNet) << "服务器：收到新连接，描述符：" << socketDescriptor;
+
     // Create a new ClientHandler for each connection
     // Pass manager instances to the handler
-    ClientHandler *handler = new ClientHandler(socketDescriptor,
-                                               m_authManager,
-                                               m_productManager,
-                                               m_shoppingCartManager,
-                                               m_orderManager,
-                                               this); // Parent to server initially
+    // 不设 parent：带 parent 的 QObject 无法 moveToThread
+    ClientHandler *handler = new ClientHandler(socketDescriptor, m_context);
 
-    // For multi-threading, move handler to a new QThread:
-    QThread *thread = new QThread(this);
-    handler->moveToThread(thread); // Move handler to the new thread
+    // 分配到当前连接数最少的工作线程
+    QThread *thread = m_workerPool->acquireThread();
+    handler->moveToThread(thread);
 
-    connect(thread, &QThread::started, handler, &ClientHandler::process); // Call process when thread starts
-    connect(handler, &ClientHandler::finished, thread, &QThread::quit); // When handler is done, quit thread
     connect(handler, &ClientHandler::finished, handler, &ClientHandler::deleteLater); // Schedule handler for deletion
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater); // Schedule thread for deletion
     connect(handler, &ClientHandler::disconnectedFromClient, this, &Server::onClientDisconnected);
 
-    m_clients.append(handler); // Keep track of active handlers
-    QTimer::singleShot(100, handler, [handler]() {
-        handler->process(); // 延迟启动处理逻辑
-    });
-    thread->start();
-    qDebug() << "服务器：客户端处理器已在新线程中启动。当前活动连接数：" << m_clients.count() << "\n";
+    m_clients.insert(handler, thread); // Keep track of active handlers
+    QMetaObject::invokeMethod(handler, &ClientHandler::process, Qt::QueuedConnection); // 在工作线程中初始化 socket
+    qCDebug(lcNet) << "服务器：客户端处理器已分配到" << thread->objectName()
+                   << "（该线程连接数：" << m_workerPool->connectionCount(thread) << "）。当前活动连接数：" << m_clients.count();
 }
 
 void Server::onClientDisconnected(ClientHandler* client) {
     removeClient(client);
-    qInfo() << "连接断开，目前总连接数：" << m_clients.count();
+    qCInfo(lcNet) << "连接断开，目前总连接数：" << m_clients.count();
 }
 void Server::removeClient(ClientHandler* client) {
-    m_clients.removeAll(client);
+    auto it = m_clients.find(client);
+    if (it == m_clients.end()) return;
+    m_workerPool->releaseThread(it.value());
+    m_clients.erase(it);
 }
@@ -2,34 +2,77 @@
 #define SERVER_H
 
 #include <QTcpServer>
-#include <QList>
+#include <QHash>
+#include "admissioncontrol.h"
+#include "clientsession.h"
+#include "sessionstore.h"
+#include "catalogcache.h"
 // Forward declare managers that will live on the server
 class ServerAuthManager;
 class ServerProductManager;
 class ServerShoppingCartManager;
 class ServerOrderManager;
+class EventHub;
 class ClientHandler; // Handles individual client connections
+class WorkerPool;
+class EpollServer;
+class CatalogReplica;
+class QThread;
+class QThreadPool;
+class QTimer;
 
 class Server : public QTcpServer {
     Q_OBJECT
 public:
-    explicit Server(QObject *parent = nullptr);
+    // workerThreads 负责 socket 收发，requestThreads 负责执行请求；<= 0 表示使用 CPU 核数
+    explicit Server(int workerThreads = 0, int requestThreads = 0,
+                    const AdmissionConfig& admission = AdmissionConfig(), QObject *parent = nullptr);
     ~Server();
-    bool startServer(quint16 port);
+
+    // 网络后端：Qt 为 QTcpServer + 工作线程，Epoll 为直接使用 epoll 的循环线程（仅 Linux）
+    enum class Backend { Qt, Epoll };
+    bool startServer(quint16 port, Backend backend = Backend::Qt);
+    // 每隔 seconds 秒把 ServerMetrics 输出到日志，0 表示关闭
+    void setStatsInterval(int seconds);
+    // 之后建立的连接按此参数压缩响应（需在 startServer 之前调用才能对 epoll 后端生效）
+    void setCompression(const CompressionConfig& config) { m_context.compression = config; }
+    // 作为分片之一运行（同样需在 startServer 之前调用）
+    void setShardConfig(const ShardConfig& config);
+    // 作为目录只读副本运行：从主服务器同步商品目录，只回答只读请求（需在 startServer 之前调用）。
+    // 构造 Server 之前要先 FileManager::setReadOnly(true)，否则 manager 加载时就会写数据目录
+    void setReplicaOf(const QString& primaryHost, quint16 primaryPort);
+    // 登录令牌的有效期（秒），每次凭令牌恢复登录都会重新计时
+    void setSessionTtl(int seconds) { m_sessions.setTtl(seconds); }
+    // 登录令牌从发放起的最长寿命（秒），到期后必须重新输入密码
+    void setSessionMaxLifetime(int seconds) { m_sessions.setMaxLifetime(seconds); }
+    // 密码哈希线程数与 PBKDF2 迭代次数
+    void setHashing(int threads, int iterations);
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
 private slots:
     void onClientDisconnected(ClientHandler* client);
+    void logStats();
 
 private:
-    QList<ClientHandler*> m_clients;
+    QHash<ClientHandler*, QThread*> m_clients; // handler -> 所在的工作线程
+    int m_workerThreads;
+    WorkerPool* m_workerPool = nullptr;   // Qt 后端
+    EpollServer* m_epollServer = nullptr; // epoll 后端
+    QThreadPool* m_requestPool; // 所有连接共享的请求执行线程池
+    AdmissionControl m_admission; // 限流与全局在途请求上限，所有连接共享
+    SessionStore m_sessions; // 所有连接共享的登录令牌
+    CatalogCache m_catalogCache; // 所有连接共享的 getProducts 回复缓存
+    QTimer* m_statsTimer;
     // Server-side instances of your managers
     ServerAuthManager* m_authManager;
     ServerProductManager* m_productManager;
     ServerShoppingCartManager* m_shoppingCartManager;
     ServerOrderManager* m_orderManager;
+    EventHub* m_eventHub; // 把 manager 的变化推送给订阅的连接
+    CatalogReplica* m_replica = nullptr; // 只读副本模式下的同步连接
+    ServerContext m_context; // 交给每个连接的 ClientSession
 
     void removeClient(ClientHandler* client);
 };
@@ -1,45 +1,87 @@
 QT += quick \
       core  \
-      network
+      network \
+      concurrent
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 HEADERS += server.h \
+    actionregistry.h \
+    admissioncontrol.h \
+    asynclogger.h \
+    balanceledger.h \
     book.h \
+    catalogcache.h \
+    catalogreplica.h \
     clienthandler.h \
+    clientsession.h \
     clothing.h \
     consumer.h \
+    credentialhasher.h \
+    creditoutbox.h \
+    epollserver.h \
+    eventhub.h \
     filemanager.h \
     food.h \
+    logcategories.h \
     merchant.h \
     order.h \
+    outputqueue.h \
     product.h \
+    searchindex.h \
     server.h \
     serverauthmanager.h \
+    servermetrics.h \
     serverordermanager.h \
     serverproductmanager.h \
     servershoppingcartmanager.h \
-    user.h
+    sessionstore.h \
+    sharding.h \
+    shardrouter.h \
+    user.h \
+    usernameindex.h \
+    wireprotocol.h \
+    workerpool.h
 
 SOURCES += \
+        admissioncontrol.cpp \
+        asynclogger.cpp \
+        balanceledger.cpp \
         book.cpp \
+        catalogcache.cpp \
+        catalogreplica.cpp \
         clienthandler.cpp \
+        clientsession.cpp \
         clothing.cpp \
         consumer.cpp \
+        credentialhasher.cpp \
+        creditoutbox.cpp \
+        epollserver.cpp \
+        eventhub.cpp \
         filemanager.cpp \
         food.cpp \
+        logcategories.cpp \
         main.cpp \
         merchant.cpp \
         order.cpp \
+        outputqueue.cpp \
         product.cpp \
+        searchindex.cpp \
         server.cpp \
         serverauthmanager.cpp \
+        servermetrics.cpp \
         serverordermanager.cpp \
         serverproductmanager.cpp \
         servershoppingcartmanager.cpp \
-        user.cpp
+        sessionstore.cpp \
+        sharding.cpp \
+        shardrouter.cpp \
+        user.cpp \
+        usernameindex.cpp \
+        wireprotocol.cpp \
+        workerpool.cpp
 
 RESOURCES += qml.qrc
 
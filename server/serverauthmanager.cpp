@@ -3,126 +3,220 @@
 #include "user.h"
 #include "consumer.h"
 #include "merchant.h"
+#include "servermetrics.h"
 #include <QDebug>
+#include <QTimer>
+#include <QJsonObject>
 
 ServerAuthManager::ServerAuthManager(QObject *parent) : QObject(parent) {
     QMap<QString, User*> users = FileManager::loadAllUsers();
-    qInfo() << "ServerAuthManager: Loaded " << users.count() << "users.";
-    qDeleteAll(users); // Clean up if only for test
+    m_users.reserve(users.size());
+    QHash<QString, qint64> balances;
+    for (auto it = users.constBegin(); it != users.constEnd(); ++it) {
+        m_users.insert(it.key(), it.value());
+        balances.insert(it.key(), BalanceLedger::toCents(it.value()->getBalance()));
+    }
+    m_usernames.rebuild(users.keys());
+    qInfo() << "ServerAuthManager: Loaded " << m_users.count() << "users.";
+    if (FileManager::isReadOnly()) {
+        // 目录副本与主服务器可能共用数据目录：不打开账本和发件箱（加载会压缩、截断日志），余额只放在内存中
+        for (auto it = balances.constBegin(); it != balances.constEnd(); ++it) m_ledger.addAccount(it.key(), it.value());
+        return;
+    }
+    m_ledger.load(balances); // 之后余额只以账本为准，User 对象里的 balance 不再使用
+    m_outbox.load();
+    // 修改先在内存中生效，之后批量写回，只写有变化的记录
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setInterval(FlushIntervalMs);
+    connect(m_flushTimer, &QTimer::timeout, this, &ServerAuthManager::flush);
+    m_flushTimer->start();
+}
+
+ServerAuthManager::~ServerAuthManager() {
+    // Server 析构时已等请求线程结束；再等哈希线程，这里写回的就是最终状态
+    m_hasher.waitForDone();
+    if (!FileManager::isReadOnly()) {
+        m_outbox.stop(); // 没送到的入账留在 credit.outbox，下次启动继续
+        markChangedBalances(m_ledger.flush(true));
+        flush();
+    }
+    qDeleteAll(m_users);
 }
 
-QVariantMap ServerAuthManager::verifyLogin(const QString &username, const QString &password) {
-    QMap<QString, User*> users = FileManager::loadAllUsers(); // 每次都从文件加载，保证最新
-    QVariantMap result;
+void ServerAuthManager::markChangedBalances(const QSet<QString>& usernames) {
+    if (usernames.isEmpty()) return;
+    QMutexLocker locker(&m_mutex);
+    for (const QString& username : usernames) markDirty(username);
+}
 
-    if (!users.contains(username)) {
-        result["success"] = false;
-        result["error"] = "User not found.";
-        qDeleteAll(users); // 清理内存
-        return result;
+void ServerAuthManager::flush() {
+    QMutexLocker flushLocker(&m_flushMutex);
+    // 余额变动只追加到账本日志；账本压缩时才把变过的余额写回 users.json
+    markChangedBalances(m_ledger.flush());
+    QList<QJsonObject> records;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_dirty.isEmpty()) return;
+        records.reserve(m_dirty.size());
+        for (const QString& username : std::as_const(m_dirty)) {
+            const User* user = m_users.value(username);
+            if (!user) continue;
+            QJsonObject obj;
+            obj["name"] = user->getUsername();
+            obj["password"] = user->getPassword();
+            obj["balance"] = BalanceLedger::fromCents(m_ledger.balance(username));
+            obj["type"] = user->getUserType();
+            records.append(obj);
+        }
+        m_dirty.clear();
+    }
+    // 写文件时不持有 m_mutex，请求线程不受磁盘速度影响
+    if (!FileManager::saveUserRecords(records)) {
+        qWarning() << "ServerAuthManager: Failed to write" << records.size() << "user records, will retry.";
+        QMutexLocker locker(&m_mutex);
+        for (const QJsonObject& obj : std::as_const(records)) markDirty(obj["name"].toString());
     }
+}
 
-    User* user = users[username];
-    if (user->verifyPassword(password)) { // User::verifyPassword 内部会哈希输入密码
+void ServerAuthManager::setHashing(int threads, int iterations) {
+    m_hasher.setThreads(threads);
+    m_hasher.setIterations(iterations);
+    qInfo() << "ServerAuthManager: Password hashing on" << threads << "threads," << m_hasher.iterations() << "PBKDF2 iterations.";
+}
+
+void ServerAuthManager::verifyLogin(const QString &username, const QString &password, Callback done) {
+    if (!m_usernames.contains(username)) {
+        done(failure("User not found."));
+        return;
+    }
+    QString stored;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (const User* user = m_users.value(username)) stored = user->getPassword();
+    }
+    if (stored.isEmpty()) { // done 可能再调用本类，不能在持锁时调用
+        done(failure("User not found."));
+        return;
+    }
+
+    bool queued = m_hasher.submit([this, username, password, stored, done]() {
+        if (!m_hasher.verify(stored, password)) {
+            qInfo() << "ServerAuthManager: User" << username << "login failed: incorrect password.";
+            done(failure("Incorrect password."));
+            return;
+        }
+        // 旧的无盐哈希或较低的迭代次数：趁有明文密码时按当前参数重算
+        const QString upgraded = m_hasher.needsUpgrade(stored) ? m_hasher.hash(password) : QString();
+        QVariantMap result;
+        QMutexLocker locker(&m_mutex);
+        User* user = m_users.value(username);
+        if (!user) {
+            locker.unlock();
+            done(failure("User not found."));
+            return;
+        }
+        if (!upgraded.isEmpty() && user->getPassword() == stored) { // 期间密码没有被修改
+            user->changePassword(upgraded);
+            markDirty(username);
+            ServerMetrics::instance().increment("passwordHashUpgrades");
+        }
         result["success"] = true;
         QVariantMap userData;
         userData["username"] = user->getUsername();
         userData["type"] = user->getUserType();
-        userData["balance"] = user->getBalance(); // 发送余额给客户端
+        userData["balance"] = BalanceLedger::fromCents(m_ledger.balance(username)); // 发送余额给客户端
         result["userData"] = userData;
+        locker.unlock();
         qInfo() << "ServerAuthManager: User" << username << "logged in successfully.";
-    } else {
-        result["success"] = false;
-        result["error"] = "Incorrect password.";
-        qInfo() << "ServerAuthManager: User" << username << "login failed: incorrect password.";
-    }
-
-    qDeleteAll(users); // 清理从 loadAllUsers 获取的 User 对象
-    return result;
+        done(result);
+    });
+    if (!queued) done(failure("Server busy, please try again."));
 }
 
-QVariantMap ServerAuthManager::registerUser(const QString &username, const QString &pwd, const QString &type, double balance) {
-    // balance 参数通常由服务器设定为0，客户端传来的会被忽略，除非有特殊业务逻辑
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    QVariantMap result;
-
+void ServerAuthManager::registerUser(const QString &username, const QString &pwd, const QString &type, double balance,
+                                     Callback done) {
+    Q_UNUSED(balance); // balance 参数通常由服务器设定为0，客户端传来的会被忽略，除非有特殊业务逻辑
     if (username.isEmpty() || pwd.isEmpty() || type.isEmpty()) {
-        result["success"] = false;
-        result["error"] = "Username, password, and type cannot be empty.";
-        qDeleteAll(users);
-        return result;
+        done(failure("Username, password, and type cannot be empty."));
+        return;
     }
     if (pwd.length() < 6) { // 与客户端一致的密码长度校验
-        result["success"] = false;
-        result["error"] = "Password must be at least 6 characters long.";
-        qDeleteAll(users);
-        return result;
+        done(failure("Password must be at least 6 characters long."));
+        return;
+    }
+    if (type != "Consumer" && type != "Merchant") {
+        done(failure("Invalid user type specified."));
+        return;
+    }
+    // 先查一次，已存在的用户名不必再算哈希；哈希完成后插入前还会在 m_mutex 下再查
+    if (m_usernames.contains(username)) {
+        done(failure("Username already exists."));
+        return;
     }
 
-
-    if (users.contains(username)) {
-        result["success"] = false;
-        result["error"] = "Username already exists.";
-    } else {
-        User* newUser = nullptr;
-        QString hashedPwd = User::hashPassword(pwd); // 使用 User 类的静态哈希方法
-        double initialBalance = 0.0; // 新用户默认余额为0
-
-        if (type == "Consumer") {
-            newUser = new Consumer(username, hashedPwd, initialBalance);
-        } else if (type == "Merchant") {
-            newUser = new Merchant(username, hashedPwd, initialBalance);
-        } else {
-            result["success"] = false;
-            result["error"] = "Invalid user type specified.";
-            qDeleteAll(users); // 清理已加载的用户
-            return result;
-        }
-
-        if (FileManager::saveUser(newUser)) { // FileManager::saveUser 会处理替换和写入
-            result["success"] = true;
-            qInfo() << "ServerAuthManager: User" << username << "registered successfully as" << type;
-            delete newUser;
-        } else {
-            result["success"] = false;
-            result["error"] = "Failed to save new user data.";
-            delete newUser; // 保存失败，删除创建的对象
+    bool queued = m_hasher.submit([this, username, pwd, type, done]() {
+        const QString hashedPwd = m_hasher.hash(pwd);
+        const double initialBalance = 0.0; // 新用户默认余额为0
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_users.contains(username)) {
+                locker.unlock();
+                done(failure("Username already exists."));
+                return;
+            }
+            User* newUser = type == "Consumer" ? static_cast<User*>(new Consumer(username, hashedPwd, initialBalance))
+                                               : static_cast<User*>(new Merchant(username, hashedPwd, initialBalance));
+            m_users.insert(username, newUser);
+            m_usernames.insert(username);
+            m_ledger.addAccount(username, BalanceLedger::toCents(initialBalance));
+            markDirty(username);
         }
-    }
-    qDeleteAll(users); // 清理从 loadAllUsers 获取的 User 对象
-    return result;
+        qInfo() << "ServerAuthManager: User" << username << "registered successfully as" << type;
+        done(QVariantMap{{"success", true}});
+    });
+    if (!queued) done(failure("Server busy, please try again."));
 }
 
-bool ServerAuthManager::changePassword(const QString &username, const QString &oldPwd, const QString &newPwd) {
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    if (!users.contains(username)) {
-        qWarning() << "ServerAuthManager: Attempt to change password for non-existent user" << username;
-        qDeleteAll(users);
-        return false;
-    }
+void ServerAuthManager::changePassword(const QString &username, const QString &oldPwd, const QString &newPwd, Callback done) {
     if (newPwd.length() < 6) {
         qWarning() << "ServerAuthManager: New password too short for user" << username;
-        qDeleteAll(users);
-        return false;
+        done(failure("New password too short."));
+        return;
     }
-
-    User* user = users[username];
-    if (!user->verifyPassword(oldPwd)) {
-        qWarning() << "ServerAuthManager: Old password incorrect for user" << username;
-        qDeleteAll(users);
-        return false;
+    QString stored;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (const User* user = m_users.value(username)) stored = user->getPassword();
+    }
+    if (stored.isEmpty()) {
+        qWarning() << "ServerAuthManager: Attempt to change password for non-existent user" << username;
+        done(failure("User not found."));
+        return;
     }
 
-    user->changePassword(User::hashPassword(newPwd)); // User::changePassword 应该只更新内存中的密码
-        // User::hashPassword 在这里再次哈希
-    bool success = FileManager::saveUser(user); // FileManager::saveUser 会保存这个修改后的 user
-    if (success) {
+    bool queued = m_hasher.submit([this, username, oldPwd, newPwd, stored, done]() {
+        if (!m_hasher.verify(stored, oldPwd)) {
+            qWarning() << "ServerAuthManager: Old password incorrect for user" << username;
+            done(failure("Old password incorrect."));
+            return;
+        }
+        const QString hashedPwd = m_hasher.hash(newPwd);
+        {
+            QMutexLocker locker(&m_mutex);
+            User* user = m_users.value(username);
+            if (!user || user->getPassword() != stored) {
+                // 两次改密码同时进行，后完成的一次以旧密码为准已经不成立
+                locker.unlock();
+                done(failure("Password changed concurrently, please retry."));
+                return;
+            }
+            user->changePassword(hashedPwd); // User::changePassword 只更新内存中的密码
+            markDirty(username);
+        }
         qInfo() << "ServerAuthManager: Password changed successfully for user" << username;
-    } else {
-        qWarning() << "ServerAuthManager: Failed to save password change for user" << username;
-    }
-    qDeleteAll(users);
-    return success;
+        done(QVariantMap{{"success", true}});
+    });
+    if (!queued) done(failure("Server busy, please try again."));
 }
 
 bool ServerAuthManager::recharge(const QString& username, double amount) {
@@ -130,37 +224,21 @@ bool ServerAuthManager::recharge(const QString& username, double amount) {
         qWarning() << "ServerAuthManager: Recharge amount must be positive for user" << username;
         return false;
     }
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    if (!users.contains(username)) {
+    qint64 newBalance = 0;
+    if (!m_ledger.credit(username, BalanceLedger::toCents(amount), &newBalance)) {
         qWarning() << "ServerAuthManager: Cannot recharge, user" << username << "not found.";
-        qDeleteAll(users);
         return false;
     }
-
-    User* user = users[username];
-    user->updateBalance(amount);
-    bool success = FileManager::saveUser(user);
-    if (success) {
-        qInfo() << "ServerAuthManager: User" << username << "recharged by" << amount << ". New balance:" << user->getBalance();
-    } else {
-        qWarning() << "ServerAuthManager: Failed to save recharge for user" << username;
-        // Potentially roll back in-memory balance update if save failed, though less critical here
-        user->updateBalance(-amount); // Rollback in-memory change
-    }
-    qDeleteAll(users);
-    return success;
+    qInfo() << "ServerAuthManager: User" << username << "recharged by" << amount << ". New balance:" << BalanceLedger::fromCents(newBalance);
+    return true;
 }
 
 double ServerAuthManager::getBalance(const QString& username) {
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    double balance = 0.0;
-    if (users.contains(username)) {
-        balance = users[username]->getBalance();
-    } else {
+    if (!m_ledger.contains(username)) {
         qWarning() << "ServerAuthManager: Requested balance for non-existent user" << username;
+        return 0.0;
     }
-    qDeleteAll(users);
-    return balance;
+    return BalanceLedger::fromCents(m_ledger.balance(username));
 }
 
 bool ServerAuthManager::deductBalance(const QString& username, double amount) {
@@ -168,29 +246,17 @@ bool ServerAuthManager::deductBalance(const QString& username, double amount) {
         qWarning() << "ServerAuthManager: Deduct amount must be positive for user" << username;
         return false; // Or handle amount == 0 as success no-op
     }
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    if (!users.contains(username)) {
-        qWarning() << "ServerAuthManager: Cannot deduct balance, user" << username << "not found.";
-        qDeleteAll(users);
+    if (m_shard.enabled() && !m_shard.owns(username)) {
+        qWarning() << "ServerAuthManager: User" << username << "belongs to shard" << Sharding::shardOf(username, m_shard.count);
         return false;
     }
-
-    User* user = users[username];
-    if (user->getBalance() < amount) {
-        qWarning() << "ServerAuthManager: Insufficient balance for user" << username << "to deduct" << amount;
-        qDeleteAll(users);
+    qint64 newBalance = 0;
+    if (!m_ledger.debit(username, BalanceLedger::toCents(amount), &newBalance)) {
+        qWarning() << "ServerAuthManager: Cannot deduct" << amount << "from user" << username << "(not found or insufficient balance).";
         return false;
     }
-    user->updateBalance(-amount); // User::updateBalance handles +/-
-    bool success = FileManager::saveUser(user);
-    if (success) {
-        qInfo() << "ServerAuthManager: Deducted" << amount << "from user" << username << ". New balance:" << user->getBalance();
-    } else {
-        qWarning() << "ServerAuthManager: Failed to save balance deduction for user" << username;
-        user->updateBalance(amount); // Rollback in-memory change
-    }
-    qDeleteAll(users);
-    return success;
+    qInfo() << "ServerAuthManager: Deducted" << amount << "from user" << username << ". New balance:" << BalanceLedger::fromCents(newBalance);
+    return true;
 }
 
 bool ServerAuthManager::addBalance(const QString& username, double amount) {
@@ -198,34 +264,79 @@ bool ServerAuthManager::addBalance(const QString& username, double amount) {
         qWarning() << "ServerAuthManager: Add amount must be positive for user" << username;
         return false;
     }
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    if (!users.contains(username)) {
+    if (m_shard.enabled() && !m_shard.owns(username)) {
+        qWarning() << "ServerAuthManager: User" << username << "belongs to shard" << Sharding::shardOf(username, m_shard.count);
+        return false;
+    }
+    qint64 newBalance = 0;
+    if (!m_ledger.credit(username, BalanceLedger::toCents(amount), &newBalance)) {
         qWarning() << "ServerAuthManager: Cannot add balance, user" << username << "not found.";
-        qDeleteAll(users);
         return false;
     }
+    qInfo() << "ServerAuthManager: Added" << amount << "to user" << username << ". New balance:" << BalanceLedger::fromCents(newBalance);
+    return true;
+}
+
+void ServerAuthManager::setShardConfig(const ShardConfig& config) {
+    m_shard = config;
+    m_outbox.start(config);
+}
+
+bool ServerAuthManager::creditPayees(const QString& paymentKey, const QMap<QString, double>& payouts) {
+    QList<CreditOutbox::Entry> remote;
+    QMap<QString, double> creditedLocally;
+    bool ok = true;
+    for (auto it = payouts.constBegin(); it != payouts.constEnd() && ok; ++it) {
+        if (it.value() <= 0) continue;
+        if (m_shard.enabled() && !m_shard.owns(it.key())) {
+            remote.append(CreditOutbox::Entry{paymentKey + '/' + it.key(), it.key(), BalanceLedger::toCents(it.value())});
+        } else if (addBalance(it.key(), it.value())) {
+            creditedLocally.insert(it.key(), it.value());
+        } else {
+            ok = false;
+        }
+    }
+    // 本地磁盘写入，不等其他分片；写入成功后这些入账一定会送达
+    if (ok && !m_outbox.enqueue(remote)) ok = false;
+    if (ok) {
+        if (!remote.isEmpty()) qInfo() << "ServerAuthManager: Queued" << remote.size() << "cross-shard credits for payment" << paymentKey;
+        return true;
+    }
+    for (auto it = creditedLocally.constBegin(); it != creditedLocally.constEnd(); ++it) {
+        if (!deductBalance(it.key(), it.value())) {
+            qCritical() << "ServerAuthManager: Cannot roll back credit of" << it.value() << "to" << it.key() << "for payment" << paymentKey;
+        }
+    }
+    return false;
+}
 
-    User* user = users[username];
-    user->updateBalance(amount);
-    bool success = FileManager::saveUser(user);
-    if (success) {
-        qInfo() << "ServerAuthManager: Added" << amount << "to user" << username << ". New balance:" << user->getBalance();
+bool ServerAuthManager::applyShardCredit(const QString& key, const QString& username, qint64 cents) {
+    bool duplicate = false;
+    if (!m_ledger.creditOnce(key, username, cents, &duplicate)) {
+        qWarning() << "ServerAuthManager: Cannot apply cross-shard credit" << key << "to user" << username;
+        return false;
+    }
+    // 写进账本日志后才回复：发送方收到成功就不再重发。重复的一笔也等上一笔落盘
+    flush();
+    if (duplicate) {
+        ServerMetrics::instance().increment("shardCreditDuplicates");
+        qInfo() << "ServerAuthManager: Cross-shard credit" << key << "already applied, acknowledging again.";
     } else {
-        qWarning() << "ServerAuthManager: Failed to save balance addition for user" << username;
-        user->updateBalance(-amount); // Rollback in-memory change
+        qInfo() << "ServerAuthManager: Applied cross-shard credit" << key << "of" << BalanceLedger::fromCents(cents) << "to" << username;
     }
-    qDeleteAll(users);
-    return success;
+    return true;
 }
 
 QString ServerAuthManager::getUserType(const QString& username) {
-    QMap<QString, User*> users = FileManager::loadAllUsers();
-    QString type = "";
-    if (users.contains(username)) {
-        type = users[username]->getUserType();
-    } else {
+    if (!m_usernames.contains(username)) {
+        qWarning() << "ServerAuthManager: Requested type for non-existent user" << username;
+        return QString();
+    }
+    QMutexLocker locker(&m_mutex);
+    const User* user = m_users.value(username);
+    if (!user) {
         qWarning() << "ServerAuthManager: Requested type for non-existent user" << username;
+        return QString();
     }
-    qDeleteAll(users);
-    return type;
+    return user->getUserType();
 }
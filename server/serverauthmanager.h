@@ -2,20 +2,70 @@
 #define SERVERAUTHMANAGER_H
 #include <QObject>
 #include <QVariantMap>
-// No User.h needed here if all logic is self-contained or passed in
+#include <QMutex>
+#include <QHash>
+#include <QSet>
+#include <functional>
+#include "sharding.h"
+#include "credentialhasher.h"
+#include "balanceledger.h"
+#include "usernameindex.h"
+#include "creditoutbox.h"
+
+class User;
+class QTimer;
 
 class ServerAuthManager : public QObject {
     Q_OBJECT
 public:
     explicit ServerAuthManager(QObject *parent = nullptr);
-    QVariantMap verifyLogin(const QString &username, const QString &password);
-    QVariantMap registerUser(const QString &username, const QString &pwd, const QString &type, double balance);
-    bool changePassword(const QString &username, const QString &oldPwd, const QString &newPwd);
+    ~ServerAuthManager(); // 写出尚未落盘的修改
+    // 登录、注册、改密码要计算慢哈希，在 CredentialHasher 自己的线程池中完成，调用线程立即返回。
+    // done 在哈希线程中调用；哈希队列已满时在调用线程立即以错误调用
+    using Callback = std::function<void(const QVariantMap& result)>;
+    void verifyLogin(const QString &username, const QString &password, Callback done);
+    void registerUser(const QString &username, const QString &pwd, const QString &type, double balance, Callback done);
+    void changePassword(const QString &username, const QString &oldPwd, const QString &newPwd, Callback done);
+    // 哈希线程数与 PBKDF2 迭代次数；旧哈希和迭代次数较低的哈希在下次登录成功时按新参数重算
+    void setHashing(int threads, int iterations);
+    void waitForHashing() { m_hasher.waitForDone(); }
     // ... other methods from your AuthManager ...
     bool recharge(const QString& username, double amount);
     double getBalance(const QString& username);
     bool deductBalance(const QString& username, double amount);
     bool addBalance(const QString& username, double amount);
     QString getUserType(const QString& username);
+
+    // 分片模式：addBalance/deductBalance 只处理本分片的用户；支付给其他分片商家的钱经 creditPayees 走发件箱
+    void setShardConfig(const ShardConfig& config);
+
+    // 一笔支付给各商家入账（paymentKey 通常是订单号）：本分片的商家直接记账，其他分片的写进 CreditOutbox，
+    // 由后台线程送达。全部生效或全部不生效；不做网络调用，可以在持有订单锁时调用
+    bool creditPayees(const QString& paymentKey, const QMap<QString, double>& payouts);
+    // 其他分片经 shardCredit 送来的入账：按幂等键去重，写进账本日志后才返回
+    bool applyShardCredit(const QString& key, const QString& username, qint64 cents);
+
+    // 把账本排队的余额变动追加到日志，再把修改过的用户写回 users.json（定时器每 FlushIntervalMs 调用一次，析构时再调用一次）
+    void flush();
+
+private:
+    static constexpr int FlushIntervalMs = 200;
+
+    void markDirty(const QString& username) { m_dirty.insert(username); } // 持有 m_mutex
+    void markChangedBalances(const QSet<QString>& usernames);
+
+    static QVariantMap failure(const QString& error) { return QVariantMap{{"success", false}, {"error", error}}; }
+
+    ShardConfig m_shard;
+    CredentialHasher m_hasher;
+    BalanceLedger m_ledger; // 余额（分）；扣款、入账不经过 m_mutex
+    CreditOutbox m_outbox;  // 待送到其他分片的商家入账
+    UsernameIndex m_usernames; // 不存在的用户名在这里就被挡掉，不用等 m_mutex
+    // 启动时加载一次，之后所有查询和修改都在内存中完成；m_mutex 保护 m_users 和 m_dirty
+    QMutex m_mutex;
+    QHash<QString, User*> m_users;
+    QSet<QString> m_dirty; // 内存中已修改、尚未写回文件的用户
+    QMutex m_flushMutex;   // 保证两次写回不会交错
+    QTimer* m_flushTimer = nullptr;
 };
 #endif
@@ -0,0 +1,113 @@
+#include "servermetrics.h"
+#include <QStringList>
+#include <algorithm>
+
+ServerMetrics& ServerMetrics::instance() {
+    static ServerMetrics metrics;
+    return metrics;
+}
+
+void ServerMetrics::recordReceived(const QString& action, const QString& encoding, qint64 bytes, qint64 decodeNs) {
+    QMutexLocker locker(&m_mutex);
+    WireStats& s = m_wire[action + "/" + encoding];
+    s.received++;
+    s.bytesIn += bytes;
+    s.decodeNs += decodeNs;
+}
+
+void ServerMetrics::recordSent(const QString& action, const QString& encoding, qint64 bytes, qint64 encodeNs) {
+    QMutexLocker locker(&m_mutex);
+    WireStats& s = m_wire[action + "/" + encoding];
+    s.sent++;
+    s.bytesOut += bytes;
+    s.encodeNs += encodeNs;
+}
+
+void ServerMetrics::recordCompression(const QString& action, const QString& encoding, qint64 rawBytes, qint64 compressedBytes,
+                                      qint64 compressNs, bool used) {
+    QMutexLocker locker(&m_mutex);
+    WireStats& s = m_wire[action + "/" + encoding];
+    s.compressTries++;
+    s.compressNs += compressNs;
+    if (used) {
+        s.compressedSent++;
+        s.compressRawBytes += rawBytes;
+        s.compressWireBytes += compressedBytes;
+    }
+}
+
+void ServerMetrics::increment(const QString& name, qint64 delta) {
+    QMutexLocker locker(&m_mutex);
+    m_counters[name] += delta;
+}
+
+void ServerMetrics::setGauge(const QString& name, qint64 value) {
+    QMutexLocker locker(&m_mutex);
+    m_gauges[name] = value;
+}
+
+void ServerMetrics::removeGauge(const QString& name) {
+    QMutexLocker locker(&m_mutex);
+    m_gauges.remove(name);
+}
+
+QJsonObject ServerMetrics::snapshot() const {
+    QMutexLocker locker(&m_mutex);
+    QJsonObject wire;
+    for (auto it = m_wire.constBegin(); it != m_wire.constEnd(); ++it) {
+        const WireStats& s = it.value();
+        QJsonObject entry;
+        entry["received"] = s.received;
+        entry["bytesIn"] = s.bytesIn;
+        entry["avgDecodeUs"] = s.received ? double(s.decodeNs) / s.received / 1000.0 : 0.0;
+        entry["sent"] = s.sent;
+        entry["bytesOut"] = s.bytesOut;
+        entry["avgBytesOut"] = s.sent ? double(s.bytesOut) / s.sent : 0.0;
+        entry["avgEncodeUs"] = s.sent ? double(s.encodeNs) / s.sent / 1000.0 : 0.0;
+        if (s.compressTries) {
+            entry["compressed"] = s.compressedSent;
+            entry["compressionRatio"] = s.compressWireBytes ? double(s.compressRawBytes) / s.compressWireBytes : 0.0;
+            entry["avgCompressUs"] = double(s.compressNs) / s.compressTries / 1000.0;
+        }
+        wire[it.key()] = entry;
+    }
+    QJsonObject counters;
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) counters[it.key()] = it.value();
+    QJsonObject gauges;
+    for (auto it = m_gauges.constBegin(); it != m_gauges.constEnd(); ++it) gauges[it.key()] = it.value();
+
+    QJsonObject root;
+    root["wire"] = wire;
+    root["counters"] = counters;
+    root["gauges"] = gauges;
+    return root;
+}
+
+QString ServerMetrics::report() const {
+    QMutexLocker locker(&m_mutex);
+    QStringList lines;
+    QStringList keys = m_wire.keys();
+    std::sort(keys.begin(), keys.end());
+    for (const QString& key : keys) {
+        const WireStats& s = m_wire[key];
+        lines << QString("  %1: rx %2 msg / %3 B (decode avg %4 us), tx %5 msg / %6 B (encode avg %7 us)")
+                     .arg(key)
+                     .arg(s.received).arg(s.bytesIn)
+                     .arg(s.received ? double(s.decodeNs) / s.received / 1000.0 : 0.0, 0, 'f', 1)
+                     .arg(s.sent).arg(s.bytesOut)
+                     .arg(s.sent ? double(s.encodeNs) / s.sent / 1000.0 : 0.0, 0, 'f', 1);
+        if (s.compressTries) {
+            lines.last() += QString(", compressed %1/%2 (ratio %3, avg %4 us)")
+                                .arg(s.compressedSent).arg(s.compressTries)
+                                .arg(s.compressWireBytes ? double(s.compressRawBytes) / s.compressWireBytes : 0.0, 0, 'f', 2)
+                                .arg(double(s.compressNs) / s.compressTries / 1000.0, 0, 'f', 1);
+        }
+    }
+    keys = m_counters.keys();
+    std::sort(keys.begin(), keys.end());
+    for (const QString& key : keys) lines << QString("  %1 = %2").arg(key).arg(m_counters[key]);
+    keys = m_gauges.keys();
+    std::sort(keys.begin(), keys.end());
+    for (const QString& key : keys) lines << QString("  %1 = %2 (gauge)").arg(key).arg(m_gauges[key]);
+    return lines.join('\n');
+}
@@ -0,0 +1,52 @@
+#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QJsonObject>
+
+// 进程内的运行指标（线程安全），由 Server 定时输出到日志，也可以通过 "serverStats" 请求查询。
+class ServerMetrics {
+public:
+    static ServerMetrics& instance();
+
+    // 收发一条消息：按 "action/encoding" 统计条数、字节数和编解码耗时
+    void recordReceived(const QString& action, const QString& encoding, qint64 bytes, qint64 decodeNs);
+    void recordSent(const QString& action, const QString& encoding, qint64 bytes, qint64 encodeNs);
+    // 一次压缩尝试：压缩前后的字节数与耗时；压缩后没有变小时按原样发送（used = false）
+    void recordCompression(const QString& action, const QString& encoding, qint64 rawBytes, qint64 compressedBytes,
+                           qint64 compressNs, bool used);
+
+    // 通用计数器与瞬时值
+    void increment(const QString& name, qint64 delta = 1);
+    void setGauge(const QString& name, qint64 value);
+    void removeGauge(const QString& name); // 连接关闭时清掉它的瞬时值
+
+    QJsonObject snapshot() const;
+    QString report() const;
+
+private:
+    ServerMetrics() = default;
+
+    struct WireStats {
+        qint64 received = 0;
+        qint64 bytesIn = 0;
+        qint64 decodeNs = 0;
+        qint64 sent = 0;
+        qint64 bytesOut = 0;
+        qint64 encodeNs = 0;
+        qint64 compressTries = 0;
+        qint64 compressedSent = 0;
+        qint64 compressRawBytes = 0;  // 实际压缩发送的帧在压缩前的字节数
+        qint64 compressWireBytes = 0; // 以及压缩后的字节数
+        qint64 compressNs = 0;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<QString, WireStats> m_wire;
+    QHash<QString, qint64> m_counters;
+    QHash<QString, qint64> m_gauges;
+};
+
+#endif // SERVERMETRICS_H
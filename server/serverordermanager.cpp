@@ -7,7 +7,9 @@
 #include "product.h"     // For Product class
 #include <QTimer>
 #include <QDebug>
+#include <QReadLocker>
 #include <QUuid> // For generating order IDs
+#include <algorithm>
 
 ServerOrderManager::ServerOrderManager(ServerProductManager* productMgr,
                                        ServerAuthManager* authMgr,
@@ -23,7 +25,7 @@ ServerOrderManager::ServerOrderManager(ServerProductManager* productMgr,
 }
 
 ServerOrderManager::~ServerOrderManager() {
-    saveOrdersToFile(); // Save any final changes
+    if (!FileManager::isReadOnly()) saveOrdersToFile(); // Save any final changes
     qDeleteAll(m_allOrders);
     m_allOrders.clear();
 }
@@ -42,6 +44,7 @@ void ServerOrderManager::loadOrdersFromFile() {
 }
 
 bool ServerOrderManager::saveOrdersToFile() {
+    QReadLocker catalogLocker(m_productManager->lock()); // 序列化时要读取商品名称
     bool success = FileManager::saveOrders(m_allOrders);
     if (success) {
         qInfo() << "ServerOrderManager: Orders saved to file.";
@@ -54,6 +57,7 @@ bool ServerOrderManager::saveOrdersToFile() {
 
 QVariantMap ServerOrderManager::orderToVariantMap(Order* order, bool includeItemsDetails) {
     if (!order) return QVariantMap();
+    QReadLocker catalogLocker(m_productManager->lock());
     QVariantMap map;
     map["orderId"] = order->getOrderId(); // Order class needs getOrderId()
     map["consumerUsername"] = order->getConsumerUsername();
@@ -77,6 +81,7 @@ QVariantList ServerOrderManager::ordersToVariantList(const QList<Order*>& orders
 }
 
 QVariantMap ServerOrderManager::prepareOrder(const QString& consumerUsername, const QVariantList& itemsData) {
+    QMutexLocker locker(&m_mutex);
     QVariantMap result;
     QMap<Product*, int> orderItemsMap;
     QList<Product*> productsToRollbackFreeze; // For rollback
@@ -101,7 +106,10 @@ QVariantMap ServerOrderManager::prepareOrder(const QString& consumerUsername, co
             return result;
         }
 
-        Product* product = m_productManager->findProductByNameAndMerchant(productName, merchantUsername);
+        // 订单项优先按商品 ID 定位；旧客户端只给名称和商家
+        Product* product = itemMap.contains("productId")
+            ? m_productManager->findProductById(itemMap["productId"].toULongLong())
+            : m_productManager->findProductByNameAndMerchant(productName, merchantUsername);
         if (!product) {
             result["success"] = false;
             result["message"] = "Product not found: " + productName + " by " + merchantUsername;
@@ -111,7 +119,7 @@ QVariantMap ServerOrderManager::prepareOrder(const QString& consumerUsername, co
 
         if (!m_productManager->freezeStock(product, quantity)) { // Try to freeze stock
             result["success"] = false;
-            result["message"] = "Insufficient stock or failed to freeze for " + productName;
+            result["message"] = "Insufficient stock or failed to freeze for " + product->getName();
             for(Product* p : productsToRollbackFreeze) m_productManager->releaseFrozenStock(p, orderItemsMap.value(p));
             return result;
         }
@@ -139,11 +147,13 @@ QVariantMap ServerOrderManager::prepareOrder(const QString& consumerUsername, co
 
     result["success"] = true;
     result["orderData"] = orderToVariantMap(newOrder);
+    emit orderChanged(consumerUsername, orderToVariantMap(newOrder, false));
     qInfo() << "ServerOrderManager: Order" << orderId << "prepared for" << consumerUsername;
     return result;
 }
 
 QVariantMap ServerOrderManager::payOrder(const QString& consumerUsername, const QString& orderId) {
+    QMutexLocker locker(&m_mutex);
     QVariantMap result;
     Order* orderToPay = nullptr;
     for (Order* o : m_allOrders) {
@@ -172,12 +182,17 @@ QVariantMap ServerOrderManager::payOrder(const QString& consumerUsername, const
             m_productManager->releaseFrozenStock(it.key(), it.value());
         }
         saveOrdersToFile();
+        emit orderChanged(consumerUsername, orderToVariantMap(orderToPay, false));
         result["success"] = false;
         result["message"] = "Order has timed out.";
         return result;
     }
 
-    double total = orderToPay->calculateTotal();
+    double total;
+    {
+        QReadLocker catalogLocker(m_productManager->lock());
+        total = orderToPay->calculateTotal();
+    }
     if (!m_authManager->deductBalance(consumerUsername, total)) {
         result["success"] = false;
         result["message"] = "Payment failed: Insufficient balance.";
@@ -185,38 +200,22 @@ QVariantMap ServerOrderManager::payOrder(const QString& consumerUsername, const
         return result;
     }
 
-    // Attempt to credit merchants
+    // 按商家汇总应付金额，再一次性入账。其他分片上的商家只写进发件箱（本地磁盘），
+    // 由后台线程送达，持有 m_mutex 期间不做任何网络调用
     QMap<Product*, int> items = orderToPay->getItems();
-    QMap<QString, double> merchantPayoutsAttempted; // Track who we tried to pay
-
-    bool allMerchantPaymentsSucceeded = true;
-    for (auto it = items.constBegin(); it != items.constEnd(); ++it) {
-        Product* product = it.key();
-        int quantity = it.value();
-        double amountForMerchant = product->getPrice() * quantity; // Use current price
-        QString merchant = product->getMerchantUsername();
-        merchantPayoutsAttempted[merchant] += amountForMerchant; // Accumulate per merchant
-
-        if (!m_authManager->addBalance(merchant, amountForMerchant)) {
-            qWarning() << "ServerOrderManager: Critical! Failed to credit merchant" << merchant << "for order" << orderId;
-            allMerchantPaymentsSucceeded = false;
-            break; // Stop processing further merchant payments
+    QMap<QString, double> merchantPayouts;
+    {
+        QReadLocker catalogLocker(m_productManager->lock());
+        for (auto it = items.constBegin(); it != items.constEnd(); ++it) {
+            merchantPayouts[it.key()->getMerchantUsername()] += it.key()->getPrice() * it.value(); // Use current price
         }
     }
 
-    if (!allMerchantPaymentsSucceeded) {
-        // Rollback: Refund consumer, and debit any merchants already paid
+    if (!m_authManager->creditPayees(orderId, merchantPayouts)) {
+        // creditPayees 已撤销本分片内已入账的部分；退还消费者
+        qWarning() << "ServerOrderManager: Critical! Failed to credit merchants for order" << orderId;
         m_authManager->addBalance(consumerUsername, total); // Refund consumer
-        for(auto const& [merchant, amount] : merchantPayoutsAttempted.toStdMap()) {
-            // Check if this merchant was actually paid before failure.
-            // This part is tricky without knowing exactly which addBalance failed.
-            // A more robust system would have a transaction log or 2-phase commit.
-            // Simplification: Try to deduct what was attempted.
-            m_authManager->deductBalance(merchant, amount);
-            qWarning() << "ServerOrderManager: Rolled back payment to merchant" << merchant << "for order" << orderId;
-        }
-        // Order remains Pending (or could be moved to a FailedPayment state)
-        // Stock remains frozen.
+        // Order remains Pending. Stock remains frozen.
         result["success"] = false;
         result["message"] = "Payment failed: Could not complete fund transfer to merchant(s). Your balance has been restored.";
         return result;
@@ -232,6 +231,7 @@ QVariantMap ServerOrderManager::payOrder(const QString& consumerUsername, const
             // At this point, money is transferred. Try to mark order as problematic.
             orderToPay->setStatus(Order::Paid); // Mark as paid, but log the stock issue
             saveOrdersToFile();
+            emit orderChanged(consumerUsername, orderToVariantMap(orderToPay, false));
             result["success"] = true; // Money part was ok
             result["message"] = "Payment successful, but a stock confirmation issue occurred. Please contact support.";
             result["newBalance"] = m_authManager->getBalance(consumerUsername);
@@ -242,6 +242,7 @@ QVariantMap ServerOrderManager::payOrder(const QString& consumerUsername, const
 
     orderToPay->setStatus(Order::Paid);
     saveOrdersToFile();
+    emit orderChanged(consumerUsername, orderToVariantMap(orderToPay, false));
     m_shoppingCartManager->clearCart(consumerUsername); // Clear cart after successful payment
 
     result["success"] = true;
@@ -250,21 +251,42 @@ QVariantMap ServerOrderManager::payOrder(const QString& consumerUsername, const
     return result;
 }
 
-QVariantList ServerOrderManager::getOrdersForUser(const QString& consumerUsername) {
+QVariantList ServerOrderManager::getOrdersForUser(const QString& consumerUsername, int limit, const OrderCursor& after,
+                                                  int* total, OrderCursor* next) {
+    QMutexLocker locker(&m_mutex);
     QList<Order*> userOrders;
     for (Order* o : m_allOrders) {
         if (o->getConsumerUsername() == consumerUsername) {
             userOrders.append(o);
         }
     }
-    // Sort by creation time, newest first
-    std::sort(userOrders.begin(), userOrders.end(), [](Order* a, Order* b){
-        return a->getCreateTimer() > b->getCreateTimer();
-    });
-    return ordersToVariantList(userOrders);
+    // Sort by creation time, newest first；同一时刻按订单号，顺序固定
+    auto newerFirst = [](const Order* a, const Order* b) {
+        if (a->getCreateTimer() != b->getCreateTimer()) return a->getCreateTimer() > b->getCreateTimer();
+        return a->getOrderId() > b->getOrderId();
+    };
+    std::sort(userOrders.begin(), userOrders.end(), newerFirst);
+    if (total) *total = int(userOrders.size());
+    if (next) *next = OrderCursor();
+    if (limit <= 0) return ordersToVariantList(userOrders);
+
+    auto begin = userOrders.begin();
+    if (!after.orderId.isEmpty()) {
+        begin = std::find_if(userOrders.begin(), userOrders.end(), [&after](const Order* o) {
+            const qint64 ms = o->getCreateTimer().toMSecsSinceEpoch();
+            return ms < after.createdMs || (ms == after.createdMs && o->getOrderId() < after.orderId);
+        });
+    }
+    const QList<Order*> page(begin, begin + qMin(qsizetype(limit), qsizetype(userOrders.end() - begin)));
+    if (next && !page.isEmpty() && begin + page.size() != userOrders.end()) {
+        next->createdMs = page.last()->getCreateTimer().toMSecsSinceEpoch();
+        next->orderId = page.last()->getOrderId();
+    }
+    return ordersToVariantList(page);
 }
 
 void ServerOrderManager::checkTimeoutOrders() {
+    QMutexLocker locker(&m_mutex);
     bool changed = false;
     QDateTime currentTime = QDateTime::currentDateTime();
     //qDebug() << "ServerOrderManager: Checking for timed out orders at" << currentTime.toString();
@@ -279,6 +301,7 @@ void ServerOrderManager::checkTimeoutOrders() {
             for(auto it = order->getItems().constBegin(); it != order->getItems().constEnd(); ++it) {
                 m_productManager->releaseFrozenStock(it.key(), it.value());
             }
+            emit orderChanged(order->getConsumerUsername(), orderToVariantMap(order, false));
             changed = true;
         }
     }
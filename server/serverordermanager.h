@@ -5,6 +5,7 @@
 #include <QList>
 #include <QVariantMap>
 #include <QDateTime>
+#include <QRecursiveMutex>
 #include "order.h"
 
 class Order; // Forward declaration
@@ -33,7 +34,18 @@ public:
     QVariantMap payOrder(const QString& consumerUsername, const QString& orderId);
 
     // Client requests their order history
-    QVariantList getOrdersForUser(const QString& consumerUsername);
+    // 按 (创建时间, 订单号) 从新到旧。limit > 0 时分页：只返回排在 after 之后的前 limit 个订单，
+    // next 为本页最后一个订单（没有更多时 orderId 为空）。以订单本身为游标，翻页期间新下的订单不会使后面的页错位
+    struct OrderCursor {
+        qint64 createdMs = 0;
+        QString orderId; // 为空表示从最新的订单开始
+    };
+    QVariantList getOrdersForUser(const QString& consumerUsername, int limit = 0, const OrderCursor& after = OrderCursor(),
+                                  int* total = nullptr, OrderCursor* next = nullptr);
+
+signals:
+    // 订单创建或状态变化；order 为不含商品明细的摘要。在持有订单锁时发出
+    void orderChanged(const QString& consumerUsername, const QVariantMap& order);
 
 
 private slots:
@@ -45,6 +57,8 @@ private:
     ServerAuthManager* m_authManager;
     ServerShoppingCartManager* m_shoppingCartManager;
     QTimer* m_timeoutTimer;
+    // 保护 m_allOrders 及订单状态；加锁顺序：本锁 -> 购物车锁 -> 商品锁 -> 用户锁
+    QRecursiveMutex m_mutex;
 
     void loadOrdersFromFile();
     bool saveOrdersToFile();
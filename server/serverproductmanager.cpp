@@ -5,9 +5,14 @@
 #include "clothing.h"
 #include "food.h"
 #include <QDebug>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QSet>
+#include <algorithm>
 #include <limits> // For std::numeric_limits
 
-ServerProductManager::ServerProductManager(QObject *parent) : QObject(parent) {
+ServerProductManager::ServerProductManager(QObject *parent)
+    : QObject(parent), m_epoch(QString::number(QDateTime::currentMSecsSinceEpoch(), 36)) {
     loadProductsFromFile();
 }
 
@@ -19,12 +24,30 @@ ServerProductManager::~ServerProductManager() {
 void ServerProductManager::loadProductsFromFile() {
     qDeleteAll(m_allProducts);
     m_allProducts.clear();
-    m_allProducts = FileManager::loadProducts();
+    quint64 savedNextId = 0;
+    m_allProducts = FileManager::loadProducts(&savedNextId);
+    rebuildIndex();
+    // 计数器不能落在已有 ID 之后（旧文件没有保存计数器，或其中的 ID 还是按名称算出的）
+    m_nextId = qMax<quint64>(1, savedNextId);
+    if (!m_byId.isEmpty()) m_nextId = qMax(m_nextId, m_byId.lastKey() + 1);
+    // 旧的 products.json 没有商品 ID，这里补上并立即写回，之后的购物车和订单迁移都依赖它
+    int assigned = 0;
+    for (Product* p : std::as_const(m_allProducts)) {
+        if (p->getId() != 0 && m_byId.value(p->getId()) == p) continue;
+        p->setId(allocateId());
+        m_byId.insert(p->getId(), p);
+        ++assigned;
+    }
+    if (assigned > 0) {
+        qInfo() << "ServerProductManager: Assigned ids to" << assigned << "products.";
+        rebuildIndex(); // 价格索引以 ID 区分同价商品
+    }
+    if ((assigned > 0 || savedNextId != m_nextId) && !FileManager::isReadOnly()) saveProductsToFile();
     qInfo() << "ServerProductManager: Loaded" << m_allProducts.count() << "products from file.";
 }
 
 bool ServerProductManager::saveProductsToFile() {
-    bool success = FileManager::saveProducts(m_allProducts);
+    bool success = FileManager::saveProducts(m_allProducts, m_nextId);
     if (success) {
         qInfo() << "ServerProductManager: Products saved to file.";
     } else {
@@ -34,74 +57,162 @@ bool ServerProductManager::saveProductsToFile() {
 }
 
 QList<Product*> ServerProductManager::getAllProducts() {
+    QReadLocker locker(&m_lock);
     return m_allProducts;
 }
 
-Product* ServerProductManager::findProductByNameAndMerchant(const QString& name, const QString& merchantUsername) {
-    for (Product* p : m_allProducts) {
-        if (p->getName() == name && p->getMerchantUsername() == merchantUsername) {
-            return p;
+// 价格索引中的顺序：原价升序，原价相同按 ID，保证每个商品的位置唯一
+static bool priceOrder(const Product* a, const Product* b) {
+    if (a->getBasePrice() != b->getBasePrice()) return a->getBasePrice() < b->getBasePrice();
+    return a->getId() < b->getId();
+}
+
+void ServerProductManager::rebuildIndex() {
+    m_index.clear();
+    m_byId.clear();
+    m_search.clear();
+    m_byPrice.clear();
+    m_index.reserve(m_allProducts.size());
+    for (Product* p : std::as_const(m_allProducts)) {
+        m_index.insert(productKey(p->getName(), p->getMerchantUsername()), p);
+        if (p->getId() != 0 && !m_byId.contains(p->getId())) m_byId.insert(p->getId(), p);
+        m_search.add(p);
+        m_byPrice[p->getCategory()].append(p);
+    }
+    for (QList<Product*>& list : m_byPrice) std::sort(list.begin(), list.end(), priceOrder);
+}
+
+void ServerProductManager::priceIndexInsert(Product* product) {
+    QList<Product*>& list = m_byPrice[product->getCategory()];
+    list.insert(std::upper_bound(list.begin(), list.end(), product, priceOrder), product);
+}
+
+void ServerProductManager::priceIndexRemove(Product* product) {
+    auto listIt = m_byPrice.find(product->getCategory());
+    if (listIt == m_byPrice.end()) return;
+    auto it = std::lower_bound(listIt->begin(), listIt->end(), product, priceOrder);
+    if (it != listIt->end() && *it == product) listIt->erase(it);
+}
+
+QList<Product*> ServerProductManager::productsInPriceRange(double minPrice, double maxPrice) const {
+    QList<Product*> result;
+    for (const QList<Product*>& list : m_byPrice) {
+        if (list.isEmpty()) continue;
+        auto begin = list.constBegin();
+        auto end = list.constEnd();
+        const double discount = list.first()->getDiscount(); // 同一分类共用一个折扣
+        if (discount > 0.0) {
+            // 售价 = basePrice * discount，区间按折扣换算；边界放宽一点，浮点误差由下面逐个核对售价处理
+            const double lo = minPrice / discount * (1.0 - 1e-9);
+            const double hi = maxPrice / discount * (1.0 + 1e-9);
+            begin = std::lower_bound(begin, end, lo, [](const Product* p, double v) { return p->getBasePrice() < v; });
+            end = std::upper_bound(begin, end, hi, [](double v, const Product* p) { return v < p->getBasePrice(); });
         }
+        const qsizetype merged = result.size();
+        for (auto it = begin; it != end; ++it) {
+            const double price = (*it)->getPrice();
+            if (price >= minPrice && price <= maxPrice) result.append(*it);
+        }
+        // 各分类内部已按售价升序，逐个归并；售价相同按 ID，顺序与分类的遍历顺序无关
+        std::inplace_merge(result.begin(), result.begin() + merged, result.end(), [](const Product* a, const Product* b) {
+            if (a->getPrice() != b->getPrice()) return a->getPrice() < b->getPrice();
+            return a->getId() < b->getId();
+        });
     }
-    return nullptr;
+    return result;
 }
 
-QList<Product*> ServerProductManager::searchProducts(const QString &keyword, int searchType, double minPrice, double maxPrice) {
-    QList<Product*> filtered;
+Product* ServerProductManager::findProductByNameAndMerchant(const QString& name, const QString& merchantUsername) {
+    QReadLocker locker(&m_lock);
+    return m_index.value(productKey(name, merchantUsername), nullptr);
+}
+
+Product* ServerProductManager::findProductById(quint64 id) {
+    QReadLocker locker(&m_lock);
+    return m_byId.value(id, nullptr);
+}
+
+QList<Product*> ServerProductManager::productsAfter(quint64 afterId, int limit) const {
+    QList<Product*> page;
+    page.reserve(qMin(qsizetype(limit), m_byId.size()));
+    for (auto it = m_byId.upperBound(afterId); it != m_byId.constEnd() && page.size() < limit; ++it) page.append(it.value());
+    return page;
+}
+
+QList<Product*> ServerProductManager::searchProducts(const QString &keyword, int searchType, double minPrice, double maxPrice,
+                                                     QList<double>* rankKeys) {
+    QReadLocker locker(&m_lock);
+    const bool priceFilter = minPrice >= 0 || maxPrice >= 0;
     double mi = (minPrice < 0) ? 0 : minPrice;
     double ma = (maxPrice < 0) ? std::numeric_limits<double>::max() : maxPrice;
 
-    for (Product *product : m_allProducts) {
-        double currentPrice = product->getPrice(); // 获取打折后的价格
-        if (currentPrice < mi || currentPrice > ma) continue;
-
-        bool match = false;
-        if (keyword.isEmpty()) { // 如果关键词为空，则只按价格筛选
-            match = true;
-        } else {
-            switch (searchType) {
-            case 0: // 名称
-                match = product->getName().contains(keyword, Qt::CaseInsensitive);
-                break;
-            case 1: // 描述
-                match = product->getDescription().contains(keyword, Qt::CaseInsensitive);
-                break;
-            // 可以添加按分类、按商家等搜索类型
-            default:
-                match = product->getName().contains(keyword, Qt::CaseInsensitive); // 默认按名称
-                break;
-            }
-        }
-        if (match) {
-            filtered.append(product);
+    if (keyword.trimmed().isEmpty()) {
+        // 只按价格筛选：各分类的价格索引中二分查找，结果按售价升序
+        const QList<Product*> result = priceFilter ? productsInPriceRange(mi, ma) : m_byId.values();
+        if (rankKeys) {
+            rankKeys->clear();
+            rankKeys->reserve(result.size());
+            for (const Product* p : result) rankKeys->append(priceFilter ? -p->getPrice() : 0.0);
         }
+        return result;
+    }
+    // 有关键词时只检查倒排索引命中的商品（已按相关度排序）
+    // searchType: 0 名称，1 描述，其他按名称
+    QList<double> scores;
+    const QList<Product*> candidates = m_search.search(keyword, searchType == 1 ? SearchIndex::Description : SearchIndex::Name,
+                                                       &scores);
+    if (rankKeys) rankKeys->clear();
+    if (!priceFilter) {
+        if (rankKeys) *rankKeys = scores;
+        return candidates;
+    }
+    QList<Product*> filtered;
+    for (qsizetype i = 0; i < candidates.size(); ++i) {
+        double currentPrice = candidates[i]->getPrice(); // 获取打折后的价格
+        if (currentPrice < mi || currentPrice > ma) continue;
+        filtered.append(candidates[i]);
+        if (rankKeys) rankKeys->append(scores[i]);
     }
     return filtered;
 }
 
 bool ServerProductManager::addProduct(const QString& name, const QString& desc, double price, int stock,
-                                      const QString& category, const QString& merchantUsername, const QString& imagePath) {
+                                      const QString& category, const QString& merchantUsername, const QString& imagePath,
+                                      quint64 id, quint64* assignedId) {
+    QWriteLocker locker(&m_lock);
     // 检查商品是否已存在（同名同商家）
     if (findProductByNameAndMerchant(name, merchantUsername)) {
         qWarning() << "ServerProductManager: Product" << name << "by" << merchantUsername << "already exists.";
         return false;
     }
+    if (id != 0 && m_byId.contains(id)) {
+        qWarning() << "ServerProductManager: Product id" << id << "for" << name << "is already in use.";
+        return false;
+    }
 
-    Product *product = nullptr;
-    if (category == "图书") {
-        product = new Book(name, desc, price, stock, merchantUsername, imagePath);
-    } else if (category == "服装") {
-        product = new Clothing(name, desc, price, stock, merchantUsername, imagePath);
-    } else if (category == "食品") {
-        product = new Food(name, desc, price, stock, merchantUsername, imagePath);
-    } else {
+    Product *product = createProduct(category, name, desc, price, stock, merchantUsername, imagePath);
+    if (!product) {
         qWarning() << "ServerProductManager: Unknown product category" << category;
         return false;
     }
 
     if (product) {
+        if (id != 0) {
+            product->setId(id);
+            m_nextId = qMax(m_nextId, id + 1); // 本分片以后成为分配方时也不会重复
+        } else {
+            product->setId(allocateId());
+        }
+        if (assignedId) *assignedId = product->getId();
         m_allProducts.append(product);
-        return saveProductsToFile();
+        m_index.insert(productKey(name, merchantUsername), product);
+        m_byId.insert(product->getId(), product);
+        m_search.add(product);
+        priceIndexInsert(product);
+        bool saved = saveProductsToFile();
+        ++m_version;
+        emit productAdded(product);
+        return saved;
     }
     return false;
 }
@@ -109,6 +220,7 @@ bool ServerProductManager::addProduct(const QString& name, const QString& desc,
 bool ServerProductManager::updateProduct(const QString& originalProductName, const QString& merchantUsername,
                                          const QString& newName, const QString& newDescription,
                                          double newBasePrice, int newStock, const QString& newImagePath) {
+    QWriteLocker locker(&m_lock);
     Product* product = findProductByNameAndMerchant(originalProductName, merchantUsername);
     if (!product) {
         qWarning() << "ServerProductManager: Product to update" << originalProductName << "by" << merchantUsername << "not found.";
@@ -121,61 +233,76 @@ bool ServerProductManager::updateProduct(const QString& originalProductName, con
         return false;
     }
 
-    if (!newName.isEmpty()) product->setName(newName);
+    if (!newName.isEmpty() && newName != originalProductName) {
+        product->setName(newName);
+        m_index.remove(productKey(originalProductName, merchantUsername));
+        m_index.insert(productKey(newName, merchantUsername), product);
+    }
     if (!newDescription.isEmpty()) product->setDescription(newDescription);
-    if (newBasePrice >= 0) product->setPrice(newBasePrice); // setPrice 设置的是 basePrice
+    if (newBasePrice >= 0) { // setPrice 设置的是 basePrice
+        priceIndexRemove(product);
+        product->setPrice(newBasePrice);
+        priceIndexInsert(product);
+    }
     if (newStock >= 0) product->setStock(newStock);
     if (!newImagePath.isEmpty()) product->setImagePath(newImagePath);
     // merchantUsername 和 category 通常不在这里修改，或者需要更复杂的逻辑
+    m_search.update(product);
 
-    return saveProductsToFile();
+    bool saved = saveProductsToFile();
+    ++m_version;
+    emit productChanged(product, originalProductName);
+    return saved;
 }
 
 void ServerProductManager::setCategoryDiscount(const QString& category, double discount) {
+    QWriteLocker locker(&m_lock);
     if (discount < 0.0 || discount > 1.0) {
         qWarning() << "ServerProductManager: Invalid discount value" << discount << ". Must be between 0.0 and 1.0.";
         return;
     }
 
-    bool changed = false;
-    if (category == "图书") {
-        if (qAbs(Book::discount - discount) > 0.001) { Book::discount = discount; changed = true; }
-    } else if (category == "服装") {
-        if (qAbs(Clothing::discount - discount) > 0.001) { Clothing::discount = discount; changed = true; }
-    } else if (category == "食品") {
-        if (qAbs(Food::discount - discount) > 0.001) { Food::discount = discount; changed = true; }
-    } else {
+    if (category != "图书" && category != "服装" && category != "食品") {
         qWarning() << "ServerProductManager: Cannot set discount for unknown category" << category;
         return;
     }
 
-    if (changed) {
+    if (setDiscountFor(category, discount)) {
         qInfo() << "ServerProductManager: Discount for category" << category << "set to" << discount;
         saveProductsToFile(); // FileManager::saveProducts 会保存 category discounts
+        ++m_version;
+        emit categoryDiscountChanged(category, discount);
     }
 }
 
 bool ServerProductManager::freezeStock(Product* product, int quantity) {
+    QWriteLocker locker(&m_lock);
     if (!product || quantity <= 0) return false;
     if (product->getAvailableStock() < quantity) {
         qWarning() << "ServerProductManager: Not enough available stock to freeze for" << product->getName() << ". Available:" << product->getAvailableStock() << "Requested:" << quantity;
         return false;
     }
     product->freezeStock(quantity);
+    ++m_version;
+    emit productChanged(product, product->getName()); // 可用库存变化
     qInfo() << "ServerProductManager: Froze" << quantity << "of" << product->getName() << ". Current stock:" << product->getStock() << "Frozen:" << product->getFrozenStock(); // Assuming product has frozenStock member
     // No need to save to file yet, only on confirm/release
     return true;
 }
 
 bool ServerProductManager::releaseFrozenStock(Product* product, int quantity) {
+    QWriteLocker locker(&m_lock);
     if (!product || quantity <= 0) return false;
     product->releaseStock(quantity);
+    ++m_version;
+    emit productChanged(product, product->getName());
     qInfo() << "ServerProductManager: Released" << quantity << "of" << product->getName() << ". Current stock:" << product->getStock() << "Frozen:" << product->getFrozenStock();
     // No need to save to file, as stock didn't change, only frozen count
     return true;
 }
 
 bool ServerProductManager::confirmStockDeduction(Product* product, int quantity) {
+    QWriteLocker locker(&m_lock);
     if (!product || quantity <= 0) return false;
     if (product->getStock() < quantity) { // 再次检查总库存，理论上冻结时已保证
         qWarning() << "ServerProductManager: Stock became insufficient before confirmation for" << product->getName();
@@ -184,5 +311,147 @@ bool ServerProductManager::confirmStockDeduction(Product* product, int quantity)
     product->deductStock(quantity);   // 实际减少库存
     product->releaseStock(quantity);  // 从冻结中移除这部分（因为已经扣减了）
     qInfo() << "ServerProductManager: Confirmed stock deduction for" << product->getName() << "by" << quantity << ". New stock:" << product->getStock();
-    return saveProductsToFile(); // 持久化库存变化
+    bool saved = saveProductsToFile(); // 持久化库存变化
+    ++m_version;
+    emit productChanged(product, product->getName());
+    return saved;
+}
+
+Product* ServerProductManager::createProduct(const QString& category, const QString& name, const QString& desc, double price,
+                                             int stock, const QString& merchantUsername, const QString& imagePath) {
+    if (category == "图书") return new Book(name, desc, price, stock, merchantUsername, imagePath);
+    if (category == "服装") return new Clothing(name, desc, price, stock, merchantUsername, imagePath);
+    if (category == "食品") return new Food(name, desc, price, stock, merchantUsername, imagePath);
+    return nullptr;
+}
+
+bool ServerProductManager::setDiscountFor(const QString& category, double discount) {
+    double* current = nullptr;
+    if (category == "图书") current = &Book::discount;
+    else if (category == "服装") current = &Clothing::discount;
+    else if (category == "食品") current = &Food::discount;
+    if (!current || qAbs(*current - discount) <= 0.001) return false;
+    *current = discount;
+    return true;
+}
+
+QJsonObject ServerProductManager::snapshot() const {
+    QReadLocker locker(&m_lock);
+    QJsonArray products;
+    for (Product* p : m_allProducts) {
+        QJsonObject obj;
+        obj["id"] = qint64(p->getId());
+        obj["name"] = p->getName();
+        obj["description"] = p->getDescription();
+        obj["basePrice"] = p->getBasePrice();
+        obj["stock"] = p->getStock();
+        obj["frozenStock"] = p->getFrozenStock();
+        obj["category"] = p->getCategory();
+        obj["imagePath"] = p->getImagePath();
+        obj["merchantUsername"] = p->getMerchantUsername();
+        products.append(obj);
+    }
+    QJsonObject categories;
+    categories["图书"] = Book::discount;
+    categories["服装"] = Clothing::discount;
+    categories["食品"] = Food::discount;
+    QJsonObject result;
+    result["version"] = qint64(m_version);
+    result["epoch"] = m_epoch;
+    result["categories"] = categories;
+    result["products"] = products;
+    return result;
+}
+
+// 副本上的商品以 ID 对应主服务器上的商品（ID 也取主服务器的值）；库存与冻结量直接取主服务器的值
+static void applyStock(Product* product, int stock, int frozenStock) {
+    product->setStock(stock);
+    product->releaseStock(product->getFrozenStock());
+    product->freezeStock(frozenStock);
+}
+
+void ServerProductManager::applySnapshot(const QJsonObject& snapshot) {
+    QWriteLocker locker(&m_lock);
+    m_version = quint64(snapshot["version"].toInteger()); // 下面的变更信号带上快照的版本号
+    // 主服务器重启后版本号可能与之前相同而内容不同：换成它的新纪元，旧纪元下缓存的回复不再命中
+    m_epoch = snapshot.contains("epoch") ? snapshot["epoch"].toString()
+                                         : QString::number(QDateTime::currentMSecsSinceEpoch(), 36);
+    const QJsonObject categories = snapshot["categories"].toObject();
+    for (auto it = categories.constBegin(); it != categories.constEnd(); ++it) {
+        if (setDiscountFor(it.key(), it.value().toDouble(1.0))) emit categoryDiscountChanged(it.key(), it.value().toDouble());
+    }
+
+    // 就地更新已有商品，其他地方持有的 Product* 仍然有效；主服务器上已不存在的商品才删除
+    QMap<quint64, Product*> existing = m_byId;
+    QList<Product*> products;
+    QSet<Product*> added;
+    for (const QJsonValue& value : snapshot["products"].toArray()) {
+        const QJsonObject obj = value.toObject();
+        const quint64 id = quint64(obj["id"].toInteger());
+        Product* product = existing.take(id);
+        if (!product) {
+            product = createProduct(obj["category"].toString(), obj["name"].toString(), obj["description"].toString(),
+                                    obj["basePrice"].toDouble(), 0, obj["merchantUsername"].toString(), obj["imagePath"].toString());
+            if (!product) continue;
+            product->setId(id);
+            added.insert(product);
+        } else {
+            product->setName(obj["name"].toString());
+            product->setDescription(obj["description"].toString());
+            product->setPrice(obj["basePrice"].toDouble());
+            product->setImagePath(obj["imagePath"].toString());
+        }
+        applyStock(product, obj["stock"].toInt(), obj["frozenStock"].toInt());
+        products.append(product);
+    }
+    qDeleteAll(existing);
+    m_allProducts = products;
+    rebuildIndex();
+    for (Product* p : std::as_const(m_allProducts)) {
+        if (added.contains(p)) emit productAdded(p); else emit productChanged(p, p->getName());
+    }
+    qInfo() << "ServerProductManager: Applied catalog snapshot version" << m_version << "with" << m_allProducts.count()
+            << "products," << existing.count() << "removed.";
+}
+
+void ServerProductManager::applyProductChange(const QJsonObject& data, quint64 version) {
+    QWriteLocker locker(&m_lock);
+    const QString merchant = data["merchantUsername"].toString();
+    const quint64 id = quint64(data["id"].toInteger());
+    Product* product = findProductById(id);
+    const bool added = !product;
+    const QString previousName = added ? data["name"].toString() : product->getName();
+    if (added) {
+        product = createProduct(data["category"].toString(), data["name"].toString(), data["description"].toString(),
+                                data["basePrice"].toDouble(), 0, merchant, data["imagePath"].toString());
+        if (!product) return;
+        product->setId(id);
+        m_allProducts.append(product);
+        m_index.insert(productKey(product->getName(), merchant), product);
+        m_byId.insert(id, product);
+        m_search.add(product);
+        priceIndexInsert(product);
+    } else {
+        if (product->getName() != data["name"].toString()) {
+            m_index.remove(productKey(previousName, merchant));
+            m_index.insert(productKey(data["name"].toString(), merchant), product);
+        }
+        product->setName(data["name"].toString());
+        product->setDescription(data["description"].toString());
+        priceIndexRemove(product);
+        product->setPrice(data["basePrice"].toDouble());
+        priceIndexInsert(product);
+        product->setImagePath(data["imagePath"].toString());
+        m_search.update(product);
+    }
+    const int stock = data["stock"].toInt();
+    applyStock(product, stock, stock - data["availableStock"].toInt(stock));
+    m_version = version;
+    if (added) emit productAdded(product); else emit productChanged(product, previousName);
+}
+
+void ServerProductManager::applyDiscountChange(const QString& category, double discount, quint64 version) {
+    QWriteLocker locker(&m_lock);
+    m_version = version;
+    if (setDiscountFor(category, discount)) emit categoryDiscountChanged(category, discount);
 }
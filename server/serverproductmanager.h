@@ -5,6 +5,11 @@
 #include <QList>
 #include <QString>
 #include <QVariantMap> // 虽然主要在内部使用，但有时返回复杂结构可能用QVariantMap
+#include <QReadWriteLock>
+#include <QJsonObject>
+#include <QHash>
+#include <QMap>
+#include "searchindex.h"
 
 // 前向声明 Product 类，实际会包含 "product.h"
 class Product;
@@ -21,15 +26,28 @@ public:
 
     // 从 ProductModel 改编而来的数据管理方法
     QList<Product*> getAllProducts();
-    QList<Product*> searchProducts(const QString &keyword, int searchType, double minPrice, double maxPrice);
+    // 结果按 (排序键降序, ID 升序) 排列，*rankKeys 为对应的排序键：有关键词时是相关度，只按价格筛选时是售价的相反数，
+    // 都没有时为 0（按 ID 顺序）。分页游标记住上一页最后一个商品的 (键, ID)，从它之后继续，增删商品不会使后面的页整体错位
+    QList<Product*> searchProducts(const QString &keyword, int searchType, double minPrice, double maxPrice,
+                                   QList<double>* rankKeys = nullptr);
+    // id 为 0 时从本地计数器分配 ID；分片模式下由 0 号分片分配，其他分片按它给出的 id 创建，
+    // 这个 ID 已被占用时拒绝（不顺延，否则各分片上的 ID 会不一致）。成功时 *assignedId 为商品 ID
     bool addProduct(const QString& name, const QString& desc, double price, int stock,
-                    const QString& category, const QString& merchantUsername, const QString& imagePath);
+                    const QString& category, const QString& merchantUsername, const QString& imagePath,
+                    quint64 id = 0, quint64* assignedId = nullptr);
     bool updateProduct(const QString& originalProductName, const QString& merchantUsername, // 用原名和商家定位
                        const QString& newName, const QString& newDescription,
                        double newBasePrice, int newStock, const QString& newImagePath);
     void setCategoryDiscount(const QString& category, double discount); // discount 是 0.0 - 1.0 的值
 
-    Product* findProductByNameAndMerchant(const QString& name, const QString& merchantUsername); // 辅助函数
+    // 按 (名称, 商家) 查哈希索引，只用于商家按名称操作自己的商品和兼容旧客户端
+    Product* findProductByNameAndMerchant(const QString& name, const QString& merchantUsername);
+    // 按商品 ID 查找；购物车、订单只保存 ID，名称等字段在展示时才从商品上读取
+    Product* findProductById(quint64 id);
+    // 分页浏览：按 ID 升序返回 ID 大于 afterId 的前 limit 个商品。以 ID 为游标，翻页期间增删商品不会重复或跳过。
+    // 调用方持有读锁
+    QList<Product*> productsAfter(quint64 afterId, int limit) const;
+    qsizetype productCount() const { return m_byId.size(); } // 调用方持有读锁
 
     // 当订单支付成功，实际扣减库存并释放冻结库存
     bool confirmStockDeduction(Product* product, int quantity);
@@ -38,10 +56,53 @@ public:
     // 当订单创建时，尝试冻结库存
     bool freezeStock(Product* product, int quantity);
 
+    // 保护所有 Product 对象及分类折扣。返回的 Product* 在锁外读取字段前，调用方需持有读锁；
+    // 持有读锁时不能再调用上面会加写锁的方法（读锁无法升级为写锁）。
+    QReadWriteLock* lock() const { return &m_lock; }
+
+    // 目录版本号：每次发出下面的变更信号之前加一，读取时需持有锁。
+    // 变更流（"catalog" 主题的事件）带上这个版本号，只读副本据此发现丢失的事件。
+    quint64 version() const { return m_version; }
+    // 目录纪元：主服务器每次启动时重新生成（版本号不持久化，重启后从头计数），副本取快照中主服务器的值。
+    // (纪元, 版本号) 唯一确定目录内容，回复缓存以它为键。读取时需持有锁
+    QString epoch() const { return m_epoch; }
+    // 全量快照（含冻结库存和分类折扣），副本在订阅变更流之后用它建立初始状态；调用方持有读锁
+    QJsonObject snapshot() const;
+
+    // --- 只读副本：应用主服务器的快照和变更流，只改内存，不写文件 ---
+    void applySnapshot(const QJsonObject& snapshot);
+    void applyProductChange(const QJsonObject& data, quint64 version);
+    void applyDiscountChange(const QString& category, double discount, quint64 version);
+
+signals:
+    // 以下信号都在持有目录写锁时、于修改数据的线程中发出，只能用直接连接，且槽里不能再加写锁
+    void productAdded(Product* product);
+    void productChanged(Product* product, const QString& previousName); // 字段或库存变化；改名时 previousName 为旧名
+    void categoryDiscountChanged(const QString& category, double discount);
 
 private:
     QList<Product*> m_allProducts; // 内存中持有的所有商品
+    QHash<QString, Product*> m_index; // productKey(名称, 商家) -> 商品；与 m_allProducts 一同在写锁下维护
+    QMap<quint64, Product*> m_byId;   // 商品 ID -> 商品，同上；有序，分页按 ID 顺序取
+    SearchIndex m_search;             // 名称、描述的倒排索引，同上；改名、改描述时增量更新
+    // 分类 -> 按 (basePrice, ID) 排序的商品，同上。同一分类的折扣相同，售价区间换算成原价区间后二分查找，
+    // 改折扣不需要重新排序
+    QHash<QString, QList<Product*>> m_byPrice;
+    mutable QReadWriteLock m_lock{QReadWriteLock::Recursive};
+    quint64 m_version = 0;
+    QString m_epoch;
+    quint64 m_nextId = 1; // 下一个商品 ID，随 products.json 保存，只增不减
 
+    static Product* createProduct(const QString& category, const QString& name, const QString& desc, double price,
+                                  int stock, const QString& merchantUsername, const QString& imagePath);
+    static bool setDiscountFor(const QString& category, double discount); // 值有变化时返回 true
+    static QString productKey(const QString& name, const QString& merchantUsername) { return name + '\n' + merchantUsername; }
+    // 新商品的 ID 取自单调递增的计数器，与名称和历史无关，之后改名不改 ID。需持有写锁
+    quint64 allocateId() { return m_nextId++; }
+    void rebuildIndex();
+    void priceIndexInsert(Product* product);
+    void priceIndexRemove(Product* product); // 按当前 basePrice 定位，改价前调用
+    QList<Product*> productsInPriceRange(double minPrice, double maxPrice) const; // 按 (售价, ID) 升序；调用方持有锁
     void loadProductsFromFile();
     bool saveProductsToFile();
 };
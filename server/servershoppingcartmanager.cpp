@@ -6,21 +6,18 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QDebug>
+#include <QReadLocker>
 
 ServerShoppingCartManager::ServerShoppingCartManager(ServerProductManager* productMgr, QObject *parent)
     : QObject(parent), m_productManager(productMgr) {
     loadAllCartsFromFile();
 }
 
-QString ServerShoppingCartManager::getProductIdentifier(Product* product) {
-    if (!product) return QString();
-    return product->getName() + "_" + product->getMerchantUsername();
-}
-
-Product* ServerShoppingCartManager::findProductByIdentifier(const QString& identifier) {
-    QStringList parts = identifier.split('_');
-    if (parts.size() == 2) {
-        return m_productManager->findProductByNameAndMerchant(parts[0], parts[1]);
+Product* ServerShoppingCartManager::findProductByLegacyIdentifier(const QString& identifier) {
+    // 名称和商家名本身都可能含 '_'，逐个分割位置尝试
+    for (qsizetype pos = identifier.indexOf('_'); pos >= 0; pos = identifier.indexOf('_', pos + 1)) {
+        Product* product = m_productManager->findProductByNameAndMerchant(identifier.left(pos), identifier.mid(pos + 1));
+        if (product) return product;
     }
     return nullptr;
 }
@@ -29,26 +26,41 @@ Product* ServerShoppingCartManager::findProductByIdentifier(const QString& ident
 void ServerShoppingCartManager::loadAllCartsFromFile() {
     m_allUserCarts.clear();
     QVariantMap loadedCarts = FileManager::loadAllShoppingCarts(); // FileManager 返回 QVariantMap
+    int migrated = 0;
     for (auto userIt = loadedCarts.constBegin(); userIt != loadedCarts.constEnd(); ++userIt) {
         QString username = userIt.key();
         QVariantMap userCartData = userIt.value().toMap();
-        QMap<QString, int> cartForUser;
+        QMap<quint64, int> cartForUser;
         for (auto itemIt = userCartData.constBegin(); itemIt != userCartData.constEnd(); ++itemIt) {
-            // key 是 "productName_merchantUsername"
-            cartForUser.insert(itemIt.key(), itemIt.value().toInt());
+            bool isId = false;
+            quint64 productId = itemIt.key().toULongLong(&isId);
+            if (!isId) {
+                Product* product = findProductByLegacyIdentifier(itemIt.key());
+                if (!product) {
+                    qWarning() << "ServerShoppingCartManager: Dropping cart item" << itemIt.key() << "of" << username << ", product not found.";
+                    continue;
+                }
+                productId = product->getId();
+                ++migrated;
+            }
+            cartForUser[productId] += itemIt.value().toInt();
         }
-        m_allUserCarts.insert(username, cartForUser);
+        if (!cartForUser.isEmpty()) m_allUserCarts.insert(username, cartForUser);
     }
     qInfo() << "ServerShoppingCartManager: Loaded" << m_allUserCarts.count() << "user carts.";
+    if (migrated > 0) {
+        qInfo() << "ServerShoppingCartManager: Migrated" << migrated << "cart items to product ids.";
+        saveAllCartsToFile();
+    }
 }
 
 bool ServerShoppingCartManager::saveAllCartsToFile() {
     QVariantMap cartsToSave;
     for (auto userIt = m_allUserCarts.constBegin(); userIt != m_allUserCarts.constEnd(); ++userIt) {
         QVariantMap userCartVariantMap;
-        const QMap<QString, int>& cartItems = userIt.value();
+        const QMap<quint64, int>& cartItems = userIt.value();
         for (auto itemIt = cartItems.constBegin(); itemIt != cartItems.constEnd(); ++itemIt) {
-            userCartVariantMap.insert(itemIt.key(), itemIt.value());
+            userCartVariantMap.insert(QString::number(itemIt.key()), itemIt.value());
         }
         cartsToSave.insert(userIt.key(), userCartVariantMap);
     }
@@ -63,16 +75,19 @@ bool ServerShoppingCartManager::saveAllCartsToFile() {
 
 
 QVariantList ServerShoppingCartManager::getCartItems(const QString& username) {
+    QMutexLocker locker(&m_mutex);
+    QReadLocker catalogLocker(m_productManager->lock()); // 读取商品字段期间商品不能被修改
     QVariantList itemsList;
     if (!m_allUserCarts.contains(username)) {
         return itemsList;
     }
 
-    const QMap<QString, int>& userCart = m_allUserCarts[username];
+    const QMap<quint64, int>& userCart = m_allUserCarts[username];
     for (auto it = userCart.constBegin(); it != userCart.constEnd(); ++it) {
-        Product* product = findProductByIdentifier(it.key());
+        Product* product = m_productManager->findProductById(it.key());
         if (product) {
             QVariantMap itemMap;
+            itemMap["productId"] = qint64(it.key());
             itemMap["name"] = product->getName();
             itemMap["description"] = product->getDescription();
             itemMap["price"] = product->getPrice(); // Current price
@@ -81,90 +96,101 @@ QVariantList ServerShoppingCartManager::getCartItems(const QString& username) {
             itemMap["quantity"] = it.value();
             itemsList.append(itemMap);
         } else {
-            qWarning() << "ServerShoppingCartManager: Product for identifier" << it.key() << "not found while getting cart for" << username;
+            qWarning() << "ServerShoppingCartManager: Product" << it.key() << "not found while getting cart for" << username;
             // Optionally remove invalid item from cart here
         }
     }
     return itemsList;
 }
 
-bool ServerShoppingCartManager::addItem(const QString& username, const QString& productName, const QString& merchantUsername, int quantity) {
+bool ServerShoppingCartManager::addItem(const QString& username, quint64 productId, int quantity) {
     if (quantity <= 0) return false;
-    Product* product = m_productManager->findProductByNameAndMerchant(productName, merchantUsername);
+    QMutexLocker locker(&m_mutex);
+    QReadLocker catalogLocker(m_productManager->lock()); // 读取商品字段期间商品不能被修改
+    Product* product = m_productManager->findProductById(productId);
     if (!product) {
-        qWarning() << "ServerShoppingCartManager: Cannot add to cart, product not found:" << productName << "by" << merchantUsername;
+        qWarning() << "ServerShoppingCartManager: Cannot add to cart, product not found:" << productId;
         return false;
     }
 
-    QString identifier = getProductIdentifier(product);
-    int currentInCart = m_allUserCarts[username].value(identifier, 0);
+    int currentInCart = m_allUserCarts.value(username).value(productId, 0);
     int newTotalQuantity = currentInCart + quantity;
 
     if (product->getAvailableStock() < newTotalQuantity) { // Check against total desired in cart
-        qWarning() << "ServerShoppingCartManager: Not enough stock for" << productName << ". Available:" << product->getAvailableStock() << "Requested in cart:" << newTotalQuantity;
+        qWarning() << "ServerShoppingCartManager: Not enough stock for" << product->getName() << ". Available:" << product->getAvailableStock() << "Requested in cart:" << newTotalQuantity;
         return false;
     }
 
-    m_allUserCarts[username][identifier] = newTotalQuantity;
-    return saveAllCartsToFile();
+    m_allUserCarts[username][productId] = newTotalQuantity;
+    bool saved = saveAllCartsToFile();
+    emit cartChanged(username);
+    return saved;
 }
 
-bool ServerShoppingCartManager::removeItem(const QString& username, const QString& productName, const QString& merchantUsername) {
-    Product* product = m_productManager->findProductByNameAndMerchant(productName, merchantUsername);
-    if (!product) return false; // Or if identifier not found directly
-
-    QString identifier = getProductIdentifier(product);
-    if (m_allUserCarts.contains(username) && m_allUserCarts[username].contains(identifier)) {
-        m_allUserCarts[username].remove(identifier);
+bool ServerShoppingCartManager::removeItem(const QString& username, quint64 productId) {
+    QMutexLocker locker(&m_mutex);
+    // 按 ID 删除不需要商品仍然存在：已下架商品留在购物车里的条目也能删掉
+    if (m_allUserCarts.contains(username) && m_allUserCarts[username].contains(productId)) {
+        m_allUserCarts[username].remove(productId);
         if (m_allUserCarts[username].isEmpty()) {
             m_allUserCarts.remove(username);
         }
-        return saveAllCartsToFile();
+        bool saved = saveAllCartsToFile();
+        emit cartChanged(username);
+        return saved;
     }
     return false;
 }
 
-bool ServerShoppingCartManager::updateQuantity(const QString& username, const QString& productName, const QString& merchantUsername, int newQuantity) {
+bool ServerShoppingCartManager::updateQuantity(const QString& username, quint64 productId, int newQuantity) {
     if (newQuantity < 0) return false; // Cannot have negative quantity
     if (newQuantity == 0) {
-        return removeItem(username, productName, merchantUsername);
+        return removeItem(username, productId);
     }
+    QMutexLocker locker(&m_mutex);
+    QReadLocker catalogLocker(m_productManager->lock());
 
-    Product* product = m_productManager->findProductByNameAndMerchant(productName, merchantUsername);
+    Product* product = m_productManager->findProductById(productId);
     if (!product) {
-        qWarning() << "ServerShoppingCartManager: Cannot update cart, product not found:" << productName << "by" << merchantUsername;
+        qWarning() << "ServerShoppingCartManager: Cannot update cart, product not found:" << productId;
         return false;
     }
     if (product->getAvailableStock() < newQuantity) {
-        qWarning() << "ServerShoppingCartManager: Not enough stock for" << productName << "to update quantity to" << newQuantity;
+        qWarning() << "ServerShoppingCartManager: Not enough stock for" << product->getName() << "to update quantity to" << newQuantity;
         return false;
     }
 
-    QString identifier = getProductIdentifier(product);
-    m_allUserCarts[username][identifier] = newQuantity;
-    return saveAllCartsToFile();
+    m_allUserCarts[username][productId] = newQuantity;
+    bool saved = saveAllCartsToFile();
+    emit cartChanged(username);
+    return saved;
 }
 
 bool ServerShoppingCartManager::clearCart(const QString& username) {
+    QMutexLocker locker(&m_mutex);
     if (m_allUserCarts.contains(username)) {
         m_allUserCarts.remove(username);
-        return saveAllCartsToFile();
+        bool saved = saveAllCartsToFile();
+        emit cartChanged(username);
+        return saved;
     }
     return true; // Cart was already empty or user didn't exist, effectively cleared
 }
 
 QMap<Product*, int> ServerShoppingCartManager::getCartForUserInternal(const QString& username) {
+    QMutexLocker locker(&m_mutex);
+    QReadLocker catalogLocker(m_productManager->lock()); // 读取商品字段期间商品不能被修改
     QMap<Product*, int> cartMap;
     if (!m_allUserCarts.contains(username)) {
         return cartMap;
     }
-    const QMap<QString, int>& userCartIdentifiers = m_allUserCarts[username];
-    for (auto it = userCartIdentifiers.constBegin(); it != userCartIdentifiers.constEnd(); ++it) {
-        Product* product = findProductByIdentifier(it.key());
+    const QMap<quint64, int>& userCartIds = m_allUserCarts[username];
+    for (auto it = userCartIds.constBegin(); it != userCartIds.constEnd(); ++it) {
+        Product* product = m_productManager->findProductById(it.key());
         if (product) {
             cartMap.insert(product, it.value());
         } else {
-            qWarning() << "ServerShoppingCartManager: Product for identifier" << it.key() << "not found during internal cart retrieval for" << username;
+            qWarning() << "ServerShoppingCartManager: Product" << it.key() << "not found during internal cart retrieval for" << username;
         }
     }
     return cartMap;
@@ -5,6 +5,7 @@
 #include <QMap>
 #include <QString>
 #include <QVariantList>
+#include <QRecursiveMutex>
 
 class ServerProductManager; // 前向声明
 class Product;
@@ -15,27 +16,32 @@ public:
     // ServerProductManager 用于查找商品实例
     explicit ServerShoppingCartManager(ServerProductManager* productMgr, QObject *parent = nullptr);
 
-    // 返回的是可序列化的 QVariantList，每个元素是 QVariantMap 代表一个购物车项
+    // 返回的是可序列化的 QVariantList，每个元素是 QVariantMap 代表一个购物车项（含 productId，名称等取商品当前值）
     QVariantList getCartItems(const QString& username);
-    bool addItem(const QString& username, const QString& productName, const QString& merchantUsername, int quantity);
-    bool removeItem(const QString& username, const QString& productName, const QString& merchantUsername);
-    bool updateQuantity(const QString& username, const QString& productName, const QString& merchantUsername, int newQuantity);
+    // 商品以 ID 标识（ServerProductManager 分配），商品改名后购物车中的条目仍然有效
+    bool addItem(const QString& username, quint64 productId, int quantity);
+    bool removeItem(const QString& username, quint64 productId);
+    bool updateQuantity(const QString& username, quint64 productId, int newQuantity);
     bool clearCart(const QString& username); // 订单支付成功后调用
 
     // 内部辅助获取购物车，用于订单处理等
     QMap<Product*, int> getCartForUserInternal(const QString& username);
 
+signals:
+    // 某个用户的购物车被修改；在持有购物车锁时发出（直接连接的槽可以调用 getCartItems）
+    void cartChanged(const QString& username);
 
 private:
-    // username -> (product_identifier -> quantity)
-    // product_identifier 采用 "productName_merchantUsername" 的形式
-    QMap<QString, QMap<QString, int>> m_allUserCarts;
+    // username -> (商品 ID -> quantity)；文件中以十进制 ID 字符串为键
+    QMap<QString, QMap<quint64, int>> m_allUserCarts;
     ServerProductManager* m_productManager; // 依赖 ProductManager 查找商品
+    // 保护 m_allUserCarts；加锁顺序：本锁 -> 商品读锁（updateQuantity 会调用 removeItem，所以需要可重入）
+    QRecursiveMutex m_mutex;
 
     void loadAllCartsFromFile();
     bool saveAllCartsToFile();
-    QString getProductIdentifier(Product* product);
-    Product* findProductByIdentifier(const QString& identifier);
+    // 旧版本购物车文件以 "productName_merchantUsername" 为键，加载时换成商品 ID
+    Product* findProductByLegacyIdentifier(const QString& identifier);
 };
 
 #endif // SERVERSHOPPINGCARTMANAGER_H
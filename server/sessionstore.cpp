@@ -0,0 +1,95 @@
+#include "sessionstore.h"
+#include "servermetrics.h"
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <QByteArray>
+
+void SessionStore::setTtl(int ttlSeconds) {
+    QMutexLocker locker(&m_mutex);
+    m_ttlMs = qint64(ttlSeconds) * 1000;
+}
+
+int SessionStore::ttlSeconds() const {
+    QMutexLocker locker(&m_mutex);
+    return int(m_ttlMs / 1000);
+}
+
+void SessionStore::setMaxLifetime(int seconds) {
+    QMutexLocker locker(&m_mutex);
+    m_maxLifetimeMs = qint64(seconds) * 1000;
+}
+
+void SessionStore::setTokenPrefix(const QString& prefix) {
+    QMutexLocker locker(&m_mutex);
+    m_prefix = prefix;
+}
+
+int SessionStore::shardOfToken(const QString& token) {
+    const int dot = token.indexOf('.');
+    if (dot <= 0) return -1;
+    bool ok = false;
+    const int shard = token.left(dot).toInt(&ok);
+    return ok ? shard : -1;
+}
+
+QString SessionStore::issue(const QString& username, const QString& userType) {
+    // 256 位随机数，来自系统的安全随机源
+    quint32 words[8];
+    QRandomGenerator::system()->fillRange(words);
+    const QByteArray raw(reinterpret_cast<const char*>(words), sizeof(words));
+    const QString secret = QString::fromLatin1(raw.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&m_mutex);
+    const QString token = m_prefix.isEmpty() ? secret : m_prefix + '.' + secret;
+    const qint64 hardExpiresAt = now + m_maxLifetimeMs;
+    m_sessions.insert(token, Session{username, userType, qMin(now + m_ttlMs, hardExpiresAt), hardExpiresAt});
+    purgeExpired(now);
+    ServerMetrics::instance().setGauge("sessions", m_sessions.size());
+    return token;
+}
+
+bool SessionStore::resume(const QString& token, Session* session) {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&m_mutex);
+    auto it = m_sessions.find(token);
+    if (it == m_sessions.end()) return false;
+    if (it->expiresAtMs <= now) {
+        m_sessions.erase(it);
+        return false;
+    }
+    it->expiresAtMs = qMin(now + m_ttlMs, it->hardExpiresAtMs);
+    *session = it.value();
+    return true;
+}
+
+void SessionStore::revoke(const QString& token) {
+    QMutexLocker locker(&m_mutex);
+    m_sessions.remove(token);
+    ServerMetrics::instance().setGauge("sessions", m_sessions.size());
+}
+
+void SessionStore::revokeUser(const QString& username) {
+    // 按令牌索引，没有按用户的索引：修改密码很少见，扫一遍即可
+    QMutexLocker locker(&m_mutex);
+    int removed = 0;
+    for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+        if (it->username == username) {
+            it = m_sessions.erase(it);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    if (removed > 0) ServerMetrics::instance().increment("sessionsRevoked", removed);
+    ServerMetrics::instance().setGauge("sessions", m_sessions.size());
+}
+
+void SessionStore::purgeExpired(qint64 now) {
+    // 最多每个 TTL 的四分之一扫一遍，发放令牌的开销保持为常数
+    if (now < m_nextPurgeMs) return;
+    m_nextPurgeMs = now + qMax<qint64>(1000, m_ttlMs / 4);
+    for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+        if (it->expiresAtMs <= now) it = m_sessions.erase(it); else ++it;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+
+// 登录会话表：登录成功时发放不透明的会话令牌，断线重连后用 "resume" 凭令牌恢复登录状态，不再校验密码。
+// 只保存在内存中，服务器重启后令牌全部失效（客户端退回正常登录）。
+// 过期时间是滑动的：每次恢复都会重新计时，但从发放起最长不超过 maxLifetime，到期必须重新输入密码。
+// 修改密码时 revokeUser 作废该用户的全部令牌。所有方法线程安全。
+class SessionStore {
+public:
+    struct Session {
+        QString username;
+        QString userType;
+        qint64 expiresAtMs = 0;
+        qint64 hardExpiresAtMs = 0; // 发放时间 + maxLifetime，续期不会超过它
+    };
+
+    explicit SessionStore(int ttlSeconds = 3600, int maxLifetimeSeconds = 24 * 3600)
+        : m_ttlMs(qint64(ttlSeconds) * 1000), m_maxLifetimeMs(qint64(maxLifetimeSeconds) * 1000) {}
+
+    void setTtl(int ttlSeconds);
+    int ttlSeconds() const;
+    void setMaxLifetime(int seconds); // 只影响之后发放的令牌
+    // 分片模式下令牌带上 "<分片编号>." 前缀，路由器据此把 resume 发到正确的分片
+    void setTokenPrefix(const QString& prefix);
+    static int shardOfToken(const QString& token); // 没有前缀时返回 -1
+
+    QString issue(const QString& username, const QString& userType);
+    // 令牌有效时填写 *session 并续期
+    bool resume(const QString& token, Session* session);
+    void revoke(const QString& token);
+    void revokeUser(const QString& username); // 作废该用户的所有令牌（修改密码后）
+
+private:
+    void purgeExpired(qint64 now); // 持有 m_mutex
+
+    mutable QMutex m_mutex;
+    QHash<QString, Session> m_sessions;
+    qint64 m_ttlMs;
+    qint64 m_maxLifetimeMs;
+    qint64 m_nextPurgeMs = 0;
+    QString m_prefix;
+};
+
+#endif // SESSIONSTORE_H
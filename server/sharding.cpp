@@ -0,0 +1,221 @@
+#include "sharding.h"
+#include "wireprotocol.h"
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTcpSocket>
+#include <QSet>
+#include <QHash>
+#include <QVector>
+#include <QDebug>
+
+namespace Sharding {
+
+quint32 hashUsername(const QString& username) {
+    const QByteArray bytes = username.toUtf8();
+    quint32 h = 2166136261u;
+    for (char c : bytes) {
+        h ^= quint8(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool parseShardList(const QString& spec, QList<ShardAddress>* shards, QString* errorString) {
+    shards->clear();
+    const QStringList entries = spec.split(',', Qt::SkipEmptyParts);
+    for (const QString& entry : entries) {
+        const int colon = entry.lastIndexOf(':');
+        bool ok = false;
+        const quint16 port = colon > 0 ? entry.mid(colon + 1).toUShort(&ok) : 0;
+        if (!ok || port == 0) {
+            *errorString = "Invalid shard address: " + entry;
+            return false;
+        }
+        shards->append({entry.left(colon).trimmed(), port});
+    }
+    if (shards->isEmpty()) {
+        *errorString = "Shard list is empty.";
+        return false;
+    }
+    return true;
+}
+
+// --- 重新分片 ---
+// 直接处理 JSON 文件，不经过 FileManager 的对象模型，字段原样保留
+
+static QJsonDocument readJson(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QJsonDocument();
+    return QJsonDocument::fromJson(file.readAll());
+}
+
+static bool writeJson(const QString& path, const QJsonDocument& doc, QString* errorString) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *errorString = "Cannot write " + path + ": " + file.errorString();
+        return false;
+    }
+    file.write(doc.toJson());
+    return true;
+}
+
+bool rebalance(const QStringList& sourceDirs, const QStringList& targetDirs, QString* errorString) {
+    if (sourceDirs.isEmpty() || targetDirs.isEmpty()) {
+        *errorString = "Both source and target directories are required.";
+        return false;
+    }
+    const int count = int(targetDirs.size());
+
+    QJsonArray users;
+    QSet<QString> seenUsers;
+    QJsonObject carts;
+    QJsonArray orders;
+    QJsonObject categories;
+    qint64 nextId = 0; // 各分片商品 ID 计数器的最大值，新分片从这里继续分配
+    QJsonArray products;
+    QHash<QString, int> productIndex; // 商品 ID（旧文件没有 ID 时用 "name\nmerchant"）-> products 中的位置
+
+    for (const QString& dir : sourceDirs) {
+        const QString base = dir.endsWith('/') ? dir : dir + '/';
+        if (QFileInfo(base + "credit.outbox").size() > 0) {
+            // 还有没送到其他分片的商家入账，重新分片后幂等键和收款分片都可能对不上
+            *errorString = "Undelivered cross-shard credits in " + dir + ", run the shards until credit.outbox is empty before rebalancing.";
+            return false;
+        }
+        if (QFileInfo(base + "ledger.journal").size() > 0) {
+            // 余额变动还只在账本日志里，users.json 中的余额不是最新的；正常关闭一次分片就会写回
+            *errorString = "Unflushed balance journal in " + dir + ", start and stop that shard once before rebalancing.";
+            return false;
+        }
+        for (const QJsonValue& value : readJson(base + "users.json").array()) {
+            const QString name = value.toObject()["name"].toString();
+            if (seenUsers.contains(name)) {
+                qWarning() << "Rebalance: duplicate user" << name << "in" << dir << "ignored.";
+                continue;
+            }
+            seenUsers.insert(name);
+            users.append(value);
+        }
+        const QJsonObject sourceCarts = readJson(base + "shoppingCart.json").object();
+        for (auto it = sourceCarts.constBegin(); it != sourceCarts.constEnd(); ++it) {
+            if (!carts.contains(it.key())) carts.insert(it.key(), it.value());
+        }
+        for (const QJsonValue& value : readJson(base + "order.json").array()) orders.append(value);
+
+        // 各分片的目录内容相同，只是库存不同：合并时库存相加
+        const QJsonObject catalog = readJson(base + "products.json").object();
+        if (categories.isEmpty()) categories = catalog["categories"].toObject();
+        nextId = qMax(nextId, catalog["nextId"].toInteger());
+        for (const QJsonValue& value : catalog["products"].toArray()) {
+            QJsonObject product = value.toObject();
+            // 商品 ID 由 0 号分片统一分配，各分片一致；改过名的商品也能对上
+            nextId = qMax(nextId, product["id"].toInteger() + 1);
+            const QString key = product.contains("id") ? QString::number(product["id"].toInteger())
+                                                       : product["name"].toString() + '\n' + product["merchantUsername"].toString();
+            auto it = productIndex.constFind(key);
+            if (it == productIndex.constEnd()) {
+                // 冻结量属于待支付订单，订单迁移后可能换了分片，无法按分片拆分；重新分片前应先让待支付订单完成或取消
+                product["frozenStock"] = 0;
+                productIndex.insert(key, int(products.size()));
+                products.append(product);
+            } else {
+                QJsonObject merged = products[*it].toObject();
+                merged["stock"] = merged["stock"].toInt() + product["stock"].toInt();
+                products[*it] = merged;
+            }
+        }
+    }
+
+    QVector<QJsonArray> shardUsers(count);
+    QVector<QJsonObject> shardCarts(count);
+    QVector<QJsonArray> shardOrders(count);
+    for (const QJsonValue& value : std::as_const(users)) {
+        shardUsers[shardOf(value.toObject()["name"].toString(), count)].append(value);
+    }
+    for (auto it = carts.constBegin(); it != carts.constEnd(); ++it) {
+        shardCarts[shardOf(it.key(), count)].insert(it.key(), it.value());
+    }
+    for (const QJsonValue& value : std::as_const(orders)) {
+        const QJsonObject order = value.toObject();
+        // 旧文件里消费者字段有两种写法
+        const QString consumer = order.contains("consumerUsername") ? order["consumerUsername"].toString() : order["consumer"].toString();
+        shardOrders[shardOf(consumer, count)].append(value);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const QString base = targetDirs[i].endsWith('/') ? targetDirs[i] : targetDirs[i] + '/';
+        if (!QDir().mkpath(base)) {
+            *errorString = "Cannot create " + base;
+            return false;
+        }
+        QJsonArray shardProducts;
+        for (const QJsonValue& value : std::as_const(products)) {
+            QJsonObject product = value.toObject();
+            product["stock"] = stockForShard(product["stock"].toInt(), i, count);
+            shardProducts.append(product);
+        }
+        QJsonObject catalog;
+        catalog["categories"] = categories;
+        if (nextId > 0) catalog["nextId"] = nextId;
+        catalog["products"] = shardProducts;
+        if (!writeJson(base + "users.json", QJsonDocument(shardUsers[i]), errorString)
+            || !writeJson(base + "shoppingCart.json", QJsonDocument(shardCarts[i]), errorString)
+            || !writeJson(base + "order.json", QJsonDocument(shardOrders[i]), errorString)
+            || !writeJson(base + "products.json", QJsonDocument(catalog), errorString)) {
+            return false;
+        }
+        // 目标目录里旧的账本快照会覆盖 users.json 的余额
+        QFile::remove(base + "ledger.snapshot");
+        QFile::remove(base + "ledger.journal");
+        qInfo() << "Rebalance: shard" << i << "->" << base << ":" << shardUsers[i].size() << "users,"
+                << shardOrders[i].size() << "orders," << shardProducts.size() << "products";
+    }
+    return true;
+}
+
+// --- 分片之间的入账 ---
+// 支付时商家可能在另一个分片上，入账经 CreditOutbox 异步送达。这种调用很少（每笔支付每个外部商家一次），
+// 每次新建一条连接，使用默认的换行分帧 + JSON，不需要协商。
+bool deliverCredit(const ShardAddress& shard, const QString& secret, const QString& username, qint64 cents, const QString& key) {
+    static const int TimeoutMs = 3000;
+    QTcpSocket socket;
+    socket.connectToHost(shard.host, shard.port);
+    if (!socket.waitForConnected(TimeoutMs)) {
+        qWarning() << "Sharding: Cannot reach shard" << shard.host << shard.port << "-" << socket.errorString();
+        return false;
+    }
+
+    QJsonObject request;
+    request["action"] = "shardCredit";
+    request["requestId"] = key;
+    QJsonObject payload;
+    payload["secret"] = secret;
+    payload["username"] = username;
+    payload["cents"] = cents;
+    payload["key"] = key;
+    request["payload"] = payload;
+    socket.write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(request, WireProtocol::Encoding::Json),
+                                           WireProtocol::Framing::Newline));
+
+    FrameReader reader;
+    QByteArray frame;
+    while (socket.waitForReadyRead(TimeoutMs)) {
+        reader.append(socket.readAll());
+        if (reader.next(&frame) != FrameReader::FrameReady) continue;
+        QJsonObject response;
+        QString errorString;
+        if (!WireProtocol::decodeMessage(frame, WireProtocol::Encoding::Json, &response, &errorString)) break;
+        if (response["status"].toString() == "success") return true;
+        qWarning() << "Sharding: Shard" << shard.host << shard.port << "rejected credit" << key << "for" << username
+                   << "-" << response["message"].toString();
+        return false;
+    }
+    qWarning() << "Sharding: No reply from shard" << shard.host << shard.port << "for credit" << key << "of" << username;
+    return false;
+}
+
+} // namespace Sharding
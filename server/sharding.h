@@ -0,0 +1,54 @@
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+// 多进程分片：每个分片进程拥有一部分用户（按用户名哈希），以及这些用户的余额、购物车和订单；
+// 商品目录在每个分片上各有一份，库存按分片划分（每个分片只卖自己那一份）。
+// 客户端连接 ShardRouter，由它把请求转发到对应的分片。
+namespace Sharding {
+
+struct ShardAddress {
+    QString host;
+    quint16 port = 0;
+};
+
+// 用户名 UTF-8 字节的 FNV-1a，与进程和平台无关，路由器、各分片和重新分片工具算出的结果一致
+quint32 hashUsername(const QString& username);
+inline int shardOf(const QString& username, int shardCount) {
+    return shardCount <= 1 ? 0 : int(hashUsername(username) % quint32(shardCount));
+}
+
+// 库存按分片均分，余数给编号小的分片
+inline int stockForShard(int totalStock, int shardIndex, int shardCount) {
+    if (shardCount <= 1 || totalStock < 0) return totalStock;
+    return totalStock / shardCount + (shardIndex < totalStock % shardCount ? 1 : 0);
+}
+
+// "host:port,host:port,..."，顺序就是分片编号
+bool parseShardList(const QString& spec, QList<ShardAddress>* shards, QString* errorString);
+
+// 离线重新分片（所有分片进程停止时运行）：读取 sourceDirs 中的全部数据，
+// 按 targetDirs 的数量重新划分用户、购物车和订单；商品目录合并后把库存重新均分，冻结库存清零。
+bool rebalance(const QStringList& sourceDirs, const QStringList& targetDirs, QString* errorString);
+
+// 同步地给另一个分片上的用户入账，只在 CreditOutbox 的投递线程中调用；超时或被拒绝返回 false。
+// key 为幂等键：同一个键重发多次，对方只入账一次并都回复成功
+bool deliverCredit(const ShardAddress& shard, const QString& secret, const QString& username, qint64 cents, const QString& key);
+
+} // namespace Sharding
+
+// 本进程作为分片运行时的配置；count <= 1 表示不分片
+struct ShardConfig {
+    int index = 0;
+    int count = 1;
+    QString secret; // 路由器与分片之间内部 action 的共享密钥
+    QList<Sharding::ShardAddress> shards;
+
+    bool enabled() const { return count > 1; }
+    bool owns(const QString& username) const { return Sharding::shardOf(username, count) == index; }
+};
+
+#endif // SHARDING_H
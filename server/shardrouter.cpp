@@ -0,0 +1,466 @@
+#include "shardrouter.h"
+#include "outputqueue.h"
+#include "actionregistry.h"
+#include "logcategories.h"
+#include "sessionstore.h"
+#include <QTcpSocket>
+#include <QJsonArray>
+#include <QDebug>
+
+ShardRouter::ShardRouter(const ShardConfig& config, const CompressionConfig& compression, QObject* parent)
+    : QTcpServer(parent), m_config(config), m_compression(compression) {
+}
+
+void ShardRouter::incomingConnection(qintptr socketDescriptor) {
+    // 路由器只做转发，单线程足够；连接在客户端断开时自行删除
+    new RouterConnection(socketDescriptor, this);
+}
+
+RouterConnection::RouterConnection(qintptr socketDescriptor, ShardRouter* router)
+    : QObject(router), m_router(router), m_socket(new QTcpSocket(this)),
+    m_backends(router->config().count) {
+    m_socket->setSocketDescriptor(socketDescriptor);
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    m_output = new OutputQueue(m_socket, this);
+    connect(m_output, &OutputQueue::highWaterReached, this, [this]() { m_outputBlocked = true; });
+    connect(m_output, &OutputQueue::drained, this, [this]() {
+        m_outputBlocked = false;
+        processFrames();
+    });
+    connect(m_socket, &QTcpSocket::readyRead, this, &RouterConnection::onClientReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &RouterConnection::onClientDisconnected);
+    qCInfo(lcNet) << "ShardRouter: Client" << socketDescriptor << "connected.";
+}
+
+RouterConnection::~RouterConnection() {
+    for (Backend& b : m_backends) {
+        if (b.socket) b.socket->abort();
+    }
+}
+
+void RouterConnection::onClientReadyRead() {
+    m_reader.append(m_socket->readAll());
+    processFrames();
+}
+
+void RouterConnection::onClientDisconnected() {
+    qCInfo(lcNet) << "ShardRouter: Client disconnected.";
+    // 分片上的会话随后端连接一起关闭，在途请求由分片自行处理完
+    deleteLater();
+}
+
+void RouterConnection::processFrames() {
+    QByteArray frame;
+    bool compressed = false;
+    while (!m_waitingForLogin && !m_outputBlocked) {
+        FrameReader::Result result = m_reader.next(&frame, &compressed);
+        if (result == FrameReader::NeedMoreData) break;
+        if (result == FrameReader::FrameTooLarge) {
+            qWarning() << "ShardRouter: Frame exceeds size limit, closing connection.";
+            m_socket->abort();
+            return;
+        }
+        QJsonObject request;
+        QString errorString;
+        bool ok = true;
+        if (compressed) {
+            QByteArray inflated;
+            ok = m_compression != WireProtocol::Compression::None && WireProtocol::decompressPayload(frame, &inflated);
+            if (ok) frame = inflated; else errorString = "Invalid compressed frame";
+        }
+        ok = ok && WireProtocol::decodeMessage(frame, m_encoding, &request, &errorString);
+        if (!ok) {
+            QJsonObject errResponse;
+            errResponse["status"] = "error";
+            errResponse["message"] = "Invalid request: " + errorString;
+            errResponse["response_to_action"] = "unknown_malformed";
+            errResponse["requestId"] = "invalid_request";
+            sendToClient(errResponse);
+            continue;
+        }
+        route(request);
+    }
+}
+
+// 目录读取：已登录时用主分片（与购物车、下单看到的库存一致），否则在各分片之间轮流
+int RouterConnection::catalogShard() {
+    return m_homeShard >= 0 ? m_homeShard : m_router->nextCatalogShard();
+}
+
+void RouterConnection::route(const QJsonObject& request) {
+    const quint32 id = ClientSession::actionId(request["action"].toString());
+    const int count = m_router->config().count;
+    switch (id) {
+    case ActionId::Hello:
+        handleHello(request); // 必须在读下一帧之前完成
+        return;
+    case ActionId::ShardAuth:
+    case ActionId::ShardCredit:
+        replyError(request, "Action not allowed here: " + request["action"].toString());
+        return;
+    case ActionId::Login:
+        forward(Sharding::shardOf(request["payload"].toObject()["username"].toString(), count), request, PendingKind::Login);
+        m_waitingForLogin = true;
+        return;
+    case ActionId::Resume: {
+        // 令牌前缀是签发它的分片；格式不对时随便交给一个分片，由它回复令牌无效
+        const int tokenShard = SessionStore::shardOfToken(request["payload"].toObject()["token"].toString());
+        forward(tokenShard >= 0 && tokenShard < count ? tokenShard : 0, request, PendingKind::Login);
+        m_waitingForLogin = true;
+        return;
+    }
+    case ActionId::Logout:
+        forward(homeOrDefault(), request, PendingKind::Login);
+        m_waitingForLogin = true;
+        return;
+    case ActionId::Register:
+        forward(Sharding::shardOf(request["payload"].toObject()["username"].toString(), count), request, PendingKind::Forward);
+        return;
+    case ActionId::GetProducts:
+    case ActionId::SearchProducts:
+        forward(catalogShard(), request, PendingKind::Forward);
+        return;
+    case ActionId::AddProduct:
+    case ActionId::UpdateProduct:
+    case ActionId::SetCategoryDiscount:
+        routeFanout(request, id);
+        return;
+    case ActionId::Batch: {
+        // batch 整体在主分片上执行，里面不能有需要路由器介入的请求
+        const QJsonArray subRequests = request["payload"].toObject()["requests"].toArray();
+        for (const QJsonValue& sub : subRequests) {
+            const quint32 subId = ClientSession::actionId(sub.toObject()["action"].toString());
+            if (subId == ActionId::Login || subId == ActionId::Register || subId == ActionId::Resume
+                || subId == ActionId::Logout || subId == ActionId::AddProduct
+                || subId == ActionId::UpdateProduct || subId == ActionId::SetCategoryDiscount
+                || subId == ActionId::ShardAuth || subId == ActionId::ShardCredit) {
+                replyError(request, "Action not allowed inside a batch in sharded mode: " + sub.toObject()["action"].toString());
+                return;
+            }
+        }
+        forward(homeOrDefault(), request, PendingKind::Forward);
+        return;
+    }
+    default:
+        // 用户自己的数据（购物车、订单、余额）和订阅都在主分片；未登录时交给 0 号分片回复错误
+        forward(homeOrDefault(), request, PendingKind::Forward);
+        return;
+    }
+}
+
+// 商品目录在每个分片上各有一份：写操作发给所有分片，库存按分片拆开。
+// 新商品的 ID 只由 0 号分片分配：addProduct 先发给它，成功后带上 ID 再发给其他分片
+void RouterConnection::routeFanout(const QJsonObject& request, quint32 id) {
+    if (m_homeShard < 0) {
+        replyError(request, "Not logged in.");
+        return;
+    }
+    const int count = m_router->config().count;
+    const quint64 fanoutId = ++m_nextId;
+    Fanout& fanout = m_fanouts[fanoutId];
+    fanout.remaining = count;
+    fanout.request = request;
+    if (id == ActionId::AddProduct) {
+        fanout.waitingForId = true;
+        forwardFanout(fanoutId, 0, 0);
+        return;
+    }
+    for (int shard = 0; shard < count; ++shard) forwardFanout(fanoutId, shard, 0);
+}
+
+void RouterConnection::forwardFanout(quint64 fanoutId, int shard, quint64 productId) {
+    const QJsonObject request = m_fanouts.value(fanoutId).request;
+    QJsonObject shardRequest = request;
+    if (ClientSession::actionId(request["action"].toString()) != ActionId::SetCategoryDiscount) {
+        QJsonObject shardPayload = request["payload"].toObject();
+        shardPayload["stock"] = Sharding::stockForShard(shardPayload["stock"].toInt(), shard, m_router->config().count);
+        if (productId != 0) shardPayload["id"] = qint64(productId);
+        shardRequest["payload"] = shardPayload;
+    }
+    forward(shard, shardRequest, PendingKind::Fanout, fanoutId);
+}
+
+void RouterConnection::handleHello(const QJsonObject& request) {
+    // 与 ClientSession::handleHello 的协商规则相同
+    const QJsonObject payload = request["payload"].toObject();
+    WireProtocol::Framing framing = m_reader.framing();
+    WireProtocol::Encoding encoding = m_encoding;
+    WireProtocol::Compression compression = m_compression;
+    QString error;
+    if (payload.contains("framing") && !WireProtocol::framingFromString(payload["framing"].toString(), &framing)) {
+        error = "Unsupported framing: " + payload["framing"].toString();
+    } else if (payload.contains("encoding") && !WireProtocol::encodingFromString(payload["encoding"].toString(), &encoding)) {
+        error = "Unsupported encoding: " + payload["encoding"].toString();
+    } else if (encoding == WireProtocol::Encoding::Cbor && framing != WireProtocol::Framing::LengthPrefixed) {
+        error = "CBOR encoding requires length-prefixed framing.";
+    }
+    if (error.isEmpty() && payload.contains("compression")) {
+        const QJsonValue value = payload["compression"];
+        const QJsonArray offered = value.isArray() ? value.toArray() : QJsonArray{value};
+        compression = WireProtocol::Compression::None;
+        for (const QJsonValue& name : offered) {
+            WireProtocol::Compression candidate;
+            if (WireProtocol::compressionFromString(name.toString(), &candidate)) {
+                compression = candidate;
+                break;
+            }
+        }
+        if (m_router->compression().threshold <= 0) compression = WireProtocol::Compression::None;
+        if (compression != WireProtocol::Compression::None && framing != WireProtocol::Framing::LengthPrefixed) {
+            error = "Compression requires length-prefixed framing.";
+        }
+    }
+    if (!error.isEmpty()) {
+        replyError(request, error);
+        return;
+    }
+    QJsonObject data;
+    data["framing"] = WireProtocol::framingToString(framing);
+    data["encoding"] = WireProtocol::encodingToString(encoding);
+    data["compression"] = WireProtocol::compressionToString(compression);
+    if (compression != WireProtocol::Compression::None) data["compressThreshold"] = m_router->compression().threshold;
+    QJsonObject response;
+    response["requestId"] = request["requestId"].toString();
+    response["response_to_action"] = request["action"].toString();
+    response["status"] = "success";
+    response["data"] = data;
+    sendToClient(response); // 仍按旧设置发出
+    m_reader.setFraming(framing);
+    m_encoding = encoding;
+    m_compression = compression;
+}
+
+RouterConnection::Backend& RouterConnection::backend(int shard) {
+    Backend& b = m_backends[shard];
+    if (b.socket) return b;
+    const Sharding::ShardAddress& address = m_router->config().shards[shard];
+    b.socket = new QTcpSocket(this);
+    b.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(b.socket, &QTcpSocket::readyRead, this, [this, shard]() { onBackendData(shard); });
+    connect(b.socket, &QTcpSocket::disconnected, this, [this, shard]() { onBackendDisconnected(shard); });
+    connect(b.socket, &QTcpSocket::errorOccurred, this, [this, shard](QAbstractSocket::SocketError) {
+        if (m_backends[shard].socket && m_backends[shard].socket->state() == QAbstractSocket::UnconnectedState) {
+            onBackendDisconnected(shard);
+        }
+    });
+    b.socket->connectToHost(address.host, address.port);
+    // hello 按默认的换行 JSON 发送；分片在读下一帧之前就已切换，后面的请求可以直接跟上
+    QJsonObject hello;
+    hello["action"] = "hello";
+    hello["requestId"] = "router-hello";
+    QJsonObject payload;
+    payload["framing"] = WireProtocol::framingToString(WireProtocol::Framing::LengthPrefixed);
+    payload["encoding"] = WireProtocol::encodingToString(WireProtocol::Encoding::Cbor);
+    hello["payload"] = payload;
+    b.socket->write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(hello, WireProtocol::Encoding::Json),
+                                              WireProtocol::Framing::Newline));
+    qCDebug(lcNet) << "ShardRouter: Opened backend connection to shard" << shard << address.host << address.port;
+    return b;
+}
+
+// 让分片上的会话与路由器记录的登录用户一致；分片按到达顺序执行，之后的请求一定看到这个身份
+void RouterConnection::ensureAuth(int shard) {
+    Backend& b = backend(shard);
+    if (b.authUser == m_username) return;
+    QJsonObject request;
+    request["action"] = "shardAuth";
+    QJsonObject payload;
+    payload["secret"] = m_router->config().secret;
+    payload["username"] = m_username;
+    payload["userType"] = m_userType;
+    request["payload"] = payload;
+    b.authUser = m_username;
+    forward(shard, request, PendingKind::Internal);
+}
+
+void RouterConnection::forward(int shard, const QJsonObject& request, PendingKind kind, quint64 fanout) {
+    // 主分片的身份来自登录本身，其他分片需要先带上身份
+    if (kind != PendingKind::Internal && kind != PendingKind::Login && shard != m_homeShard) ensureAuth(shard);
+    Backend& b = backend(shard);
+    const QString internalId = QString("router-%1").arg(++m_nextId);
+    QJsonObject shardRequest = request;
+    shardRequest["requestId"] = internalId;
+    m_pending.insert(internalId, Pending{shard, kind, kind == PendingKind::Internal ? QJsonObject() : request, fanout});
+    b.socket->write(WireProtocol::encodeFrame(WireProtocol::encodeMessage(shardRequest, WireProtocol::Encoding::Cbor),
+                                              WireProtocol::Framing::LengthPrefixed));
+}
+
+void RouterConnection::onBackendData(int shard) {
+    Backend& b = m_backends[shard];
+    b.reader.append(b.socket->readAll());
+    QByteArray frame;
+    QList<QJsonObject> responses; // 先全部解析：处理回复时可能新建后端连接、修改 m_backends
+    while (true) {
+        FrameReader::Result result = b.reader.next(&frame);
+        if (result == FrameReader::NeedMoreData) break;
+        if (result == FrameReader::FrameTooLarge) {
+            qWarning() << "ShardRouter: Oversized frame from shard" << shard;
+            b.socket->abort();
+            return;
+        }
+        QJsonObject response;
+        QString errorString;
+        const WireProtocol::Encoding encoding = b.helloDone ? WireProtocol::Encoding::Cbor : WireProtocol::Encoding::Json;
+        if (!WireProtocol::decodeMessage(frame, encoding, &response, &errorString)) {
+            qWarning() << "ShardRouter: Bad response from shard" << shard << ":" << errorString;
+            continue;
+        }
+        if (!b.helloDone) {
+            // 第一条一定是 hello 的回复
+            b.helloDone = true;
+            b.reader.setFraming(WireProtocol::Framing::LengthPrefixed);
+            if (response["status"].toString() != "success") {
+                qWarning() << "ShardRouter: Shard" << shard << "rejected hello:" << response["message"].toString();
+                b.socket->abort();
+                return;
+            }
+            continue;
+        }
+        responses.append(response);
+    }
+    for (const QJsonObject& response : std::as_const(responses)) onBackendResponse(shard, response);
+}
+
+void RouterConnection::onBackendResponse(int shard, const QJsonObject& response) {
+    if (response["response_to_action"].toString() == "event") {
+        sendToClient(response); // 订阅都在主分片上，事件原样转给客户端
+        return;
+    }
+    auto it = m_pending.find(response["requestId"].toString());
+    if (it == m_pending.end()) {
+        qWarning() << "ShardRouter: Unexpected response from shard" << shard << response["response_to_action"].toString();
+        return;
+    }
+    const Pending pending = it.value();
+    m_pending.erase(it);
+
+    QJsonObject clientResponse = response;
+    clientResponse["requestId"] = pending.request["requestId"].toString();
+    switch (pending.kind) {
+    case PendingKind::Internal:
+        if (response["status"].toString() != "success") {
+            qWarning() << "ShardRouter: shardAuth on shard" << shard << "failed:" << response["message"].toString()
+                       << "(check --shard-secret)";
+        }
+        return;
+    case PendingKind::Fanout:
+        completeFanout(pending.fanout, clientResponse);
+        return;
+    case PendingKind::Login:
+        // login、resume 和 logout 都会改变分片上的登录用户；用户名以分片的回复为准（resume 请求里只有令牌）
+        if (response["status"].toString() == "success") {
+            const int previousHome = m_homeShard;
+            m_username = response["data"].toObject()["username"].toString();
+            m_userType = response["data"].toObject()["type"].toString();
+            m_homeShard = m_username.isEmpty() ? -1 : shard;
+            m_backends[shard].authUser = m_username;
+            // 原主分片上的会话切换为新用户，分片随之停止推送上一个用户的购物车和订单
+            if (previousHome >= 0 && previousHome != shard) ensureAuth(previousHome);
+            if (!m_username.isEmpty()) qCInfo(lcNet) << "ShardRouter: User" << m_username << "lives on shard" << shard;
+        }
+        sendToClient(clientResponse);
+        m_waitingForLogin = false;
+        processFrames();
+        return;
+    case PendingKind::Forward:
+        sendToClient(clientResponse);
+        return;
+    }
+}
+
+void RouterConnection::completeFanout(quint64 fanoutId, const QJsonObject& response) {
+    auto it = m_fanouts.find(fanoutId);
+    if (it == m_fanouts.end()) return;
+    if (it->waitingForId) {
+        // 0 号分片的回复：失败时其他分片什么都没做，直接回复客户端；成功时用它分配的 ID 发给其他分片
+        const quint64 productId = quint64(response["data"].toObject()["id"].toInteger());
+        if (response["status"].toString() != "success" || productId == 0) {
+            sendToClient(response);
+            m_fanouts.erase(it);
+            return;
+        }
+        it->waitingForId = false;
+        it->success = response;
+        --it->remaining;
+        const int count = m_router->config().count;
+        for (int shard = 1; shard < count; ++shard) forwardFanout(fanoutId, shard, productId);
+        return;
+    }
+    if (response["status"].toString() == "success") {
+        if (it->success.isEmpty()) it->success = response;
+    } else if (it->error.isEmpty()) {
+        it->error = response;
+    }
+    if (--it->remaining > 0) return;
+    if (!it->error.isEmpty() && !it->success.isEmpty()) {
+        // 部分分片成功：目录在各分片之间不一致，需要商家重试同一操作
+        qWarning() << "ShardRouter:" << it->request["action"].toString() << "succeeded on some shards only:"
+                   << it->error["message"].toString();
+    }
+    sendToClient(it->error.isEmpty() ? it->success : it->error);
+    m_fanouts.erase(it);
+}
+
+void RouterConnection::onBackendDisconnected(int shard) {
+    Backend& b = m_backends[shard];
+    if (!b.socket) return;
+    qWarning() << "ShardRouter: Lost connection to shard" << shard;
+    b.socket->disconnect(this);
+    b.socket->deleteLater();
+    b = Backend(); // 下次使用时重新连接并重新带上身份
+
+    // 发往这个分片、还没有回复的请求全部以错误结束
+    QList<Pending> failed;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (it->shard == shard) {
+            failed.append(it.value());
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const Pending& pending : std::as_const(failed)) {
+        if (pending.kind == PendingKind::Internal) continue;
+        QJsonObject response;
+        response["requestId"] = pending.request["requestId"].toString();
+        response["response_to_action"] = pending.request["action"].toString();
+        response["status"] = "error";
+        response["message"] = QString("Shard %1 unavailable.").arg(shard);
+        if (pending.kind == PendingKind::Fanout) {
+            completeFanout(pending.fanout, response);
+            continue;
+        }
+        sendToClient(response);
+        if (pending.kind == PendingKind::Login) {
+            m_waitingForLogin = false;
+            processFrames();
+        }
+    }
+    if (shard == m_homeShard) {
+        // 主分片上的登录状态随会话一起丢失
+        m_homeShard = -1;
+        m_username.clear();
+        m_userType.clear();
+    }
+}
+
+void RouterConnection::sendToClient(const QJsonObject& message) {
+    if (m_socket->state() != QAbstractSocket::ConnectedState) return;
+    QByteArray data = WireProtocol::encodeMessage(message, m_encoding);
+    bool compressed = false;
+    if (m_compression == WireProtocol::Compression::Zlib && data.size() >= m_router->compression().threshold) {
+        QByteArray packed = WireProtocol::compressPayload(data, m_router->compression().level);
+        compressed = !packed.isEmpty() && packed.size() < data.size();
+        if (compressed) data = packed;
+    }
+    m_output->enqueue(WireProtocol::encodeFrame(data, m_reader.framing(), compressed));
+}
+
+void RouterConnection::replyError(const QJsonObject& request, const QString& message) {
+    QJsonObject response;
+    response["requestId"] = request["requestId"].toString();
+    response["response_to_action"] = request["action"].toString();
+    response["status"] = "error";
+    response["message"] = message;
+    sendToClient(response);
+}
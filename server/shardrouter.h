@@ -0,0 +1,113 @@
+#ifndef SHARDROUTER_H
+#define SHARDROUTER_H
+
+#include <QTcpServer>
+#include <QHash>
+#include <QVector>
+#include "wireprotocol.h"
+#include "clientsession.h"
+#include "sharding.h"
+
+class QTcpSocket;
+class OutputQueue;
+class ShardRouter;
+
+// 路由器上的一个客户端连接。对客户端来说与直连服务器相同（hello 协商、分帧、编码、压缩都在这里完成），
+// 请求按用户名哈希转发到用户所在的主分片；商品写操作发给所有分片；目录读取可以由任意分片回答。
+// 每个客户端连接按需向每个分片建立一条后端连接，后端连接固定使用长度前缀 + CBOR。
+class RouterConnection : public QObject {
+    Q_OBJECT
+public:
+    RouterConnection(qintptr socketDescriptor, ShardRouter* router);
+    ~RouterConnection();
+
+private slots:
+    void onClientReadyRead();
+    void onClientDisconnected();
+
+private:
+    struct Backend {
+        QTcpSocket* socket = nullptr;
+        FrameReader reader;
+        bool helloDone = false; // hello 的回复（换行 JSON）已收到，之后按长度前缀 + CBOR 解析
+        QString authUser;       // 这个分片上本连接当前的身份
+    };
+
+    enum class PendingKind {
+        Forward,  // 原样转发回客户端
+        Login,    // 成功后确定主分片
+        Fanout,   // 多个分片的回复合并成一个
+        Internal  // 路由器自己发出的 shardAuth
+    };
+
+    struct Pending {
+        int shard;
+        PendingKind kind;
+        QJsonObject request; // 客户端的原始请求（Internal 为空）
+        quint64 fanout = 0;
+    };
+
+    struct Fanout {
+        int remaining = 0;
+        bool waitingForId = false; // addProduct：先由 0 号分片分配 ID，再发给其他分片
+        QJsonObject request;
+        QJsonObject success;
+        QJsonObject error;
+    };
+
+    void processFrames();
+    void route(const QJsonObject& request);
+    void routeFanout(const QJsonObject& request, quint32 id);
+    void forwardFanout(quint64 fanoutId, int shard, quint64 productId);
+    void handleHello(const QJsonObject& request);
+    void onBackendData(int shard);
+    void onBackendResponse(int shard, const QJsonObject& response);
+    void onBackendDisconnected(int shard);
+    void completeFanout(quint64 fanoutId, const QJsonObject& response);
+
+    Backend& backend(int shard); // 第一次使用时建立连接
+    void ensureAuth(int shard);
+    void forward(int shard, const QJsonObject& request, PendingKind kind, quint64 fanout = 0);
+    void sendToClient(const QJsonObject& message);
+    void replyError(const QJsonObject& request, const QString& message);
+    int catalogShard();
+    int homeOrDefault() const { return m_homeShard >= 0 ? m_homeShard : 0; }
+
+    ShardRouter* m_router;
+    QTcpSocket* m_socket;
+    OutputQueue* m_output;
+    FrameReader m_reader;
+    WireProtocol::Encoding m_encoding = WireProtocol::Encoding::Json;
+    WireProtocol::Compression m_compression = WireProtocol::Compression::None;
+    QVector<Backend> m_backends;
+    QHash<QString, Pending> m_pending; // 内部请求编号 -> 等待中的请求
+    QHash<quint64, Fanout> m_fanouts;
+    quint64 m_nextId = 0;
+
+    int m_homeShard = -1;
+    QString m_username;
+    QString m_userType;
+    bool m_waitingForLogin = false; // 登录结果决定后续请求发往哪里，期间不再读新请求
+    bool m_outputBlocked = false;   // 发给客户端的数据积压，暂停读新请求
+};
+
+// 分片模式下的前端进程：本身不持有任何数据，只负责转发
+class ShardRouter : public QTcpServer {
+    Q_OBJECT
+public:
+    ShardRouter(const ShardConfig& config, const CompressionConfig& compression, QObject* parent = nullptr);
+
+    const ShardConfig& config() const { return m_config; }
+    const CompressionConfig& compression() const { return m_compression; }
+    int nextCatalogShard() { return int(m_catalogCursor++ % quint32(m_config.count)); }
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    ShardConfig m_config;
+    CompressionConfig m_compression;
+    quint32 m_catalogCursor = 0; // 未登录连接的目录读取在各分片之间轮流
+};
+
+#endif // SHARDROUTER_H
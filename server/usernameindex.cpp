@@ -0,0 +1,61 @@
+#include "usernameindex.h"
+#include <QHash>
+
+// 双重哈希：第 i 个位置为 h1 + i * h2，两个种子不同的哈希足以模拟 k 个独立哈希
+static inline void bloomHashes(const QString& username, quint64* h1, quint64* h2) {
+    *h1 = quint64(qHash(username, 0x9e3779b9u));
+    *h2 = quint64(qHash(username, 0x85ebca6bu)) | 1;
+}
+
+void UsernameIndex::resizeBloom(qsizetype capacity) {
+    m_capacity = qMax(capacity, MinCapacity);
+    m_bitCount = quint64(m_capacity) * BitsPerName;
+    m_bits.fill(0, qsizetype((m_bitCount + 63) / 64));
+    for (const QString& name : std::as_const(m_names)) bloomAdd(name);
+}
+
+void UsernameIndex::bloomAdd(const QString& username) {
+    quint64 h1, h2;
+    bloomHashes(username, &h1, &h2);
+    for (int i = 0; i < HashCount; ++i) {
+        const quint64 bit = (h1 + quint64(i) * h2) % m_bitCount;
+        m_bits[qsizetype(bit / 64)] |= quint64(1) << (bit % 64);
+    }
+}
+
+bool UsernameIndex::bloomMayContain(const QString& username) const {
+    quint64 h1, h2;
+    bloomHashes(username, &h1, &h2);
+    for (int i = 0; i < HashCount; ++i) {
+        const quint64 bit = (h1 + quint64(i) * h2) % m_bitCount;
+        if (!(m_bits[qsizetype(bit / 64)] & (quint64(1) << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+void UsernameIndex::rebuild(const QStringList& usernames) {
+    QWriteLocker locker(&m_lock);
+    m_names = QSet<QString>(usernames.begin(), usernames.end());
+    resizeBloom(m_names.size() * 2); // 留出注册的余量
+}
+
+void UsernameIndex::insert(const QString& username) {
+    QWriteLocker locker(&m_lock);
+    if (m_names.contains(username)) return;
+    m_names.insert(username);
+    if (m_names.size() > m_capacity) {
+        resizeBloom(m_capacity * 2);
+    } else {
+        bloomAdd(username);
+    }
+}
+
+bool UsernameIndex::contains(const QString& username) const {
+    QReadLocker locker(&m_lock);
+    return bloomMayContain(username) && m_names.contains(username);
+}
+
+qsizetype UsernameIndex::size() const {
+    QReadLocker locker(&m_lock);
+    return m_names.size();
+}
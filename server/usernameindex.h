@@ -0,0 +1,38 @@
+#ifndef USERNAMEINDEX_H
+#define USERNAMEINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QVector>
+#include <QReadWriteLock>
+
+// 常驻内存的用户名索引：精确的哈希集合，前面加一个 Bloom 过滤器。
+// 过滤器说"没有"时一定没有，直接返回；说"可能有"时再查集合，所以结果总是精确的。
+// 启动时由已加载的用户一次性建立（只计算哈希，不读磁盘），注册时 insert。线程安全，查询只持读锁。
+class UsernameIndex {
+public:
+    UsernameIndex() { resizeBloom(0); }
+
+    void rebuild(const QStringList& usernames);
+    void insert(const QString& username);
+    bool contains(const QString& username) const;
+    qsizetype size() const;
+
+private:
+    static constexpr int BitsPerName = 10; // 约 1% 误判率
+    static constexpr int HashCount = 7;
+    static constexpr qsizetype MinCapacity = 1024;
+
+    void resizeBloom(qsizetype capacity); // 持有写锁（或尚未共享）
+    void bloomAdd(const QString& username);
+    bool bloomMayContain(const QString& username) const;
+
+    mutable QReadWriteLock m_lock;
+    QSet<QString> m_names;
+    QVector<quint64> m_bits;
+    quint64 m_bitCount = 0;
+    qsizetype m_capacity = 0; // 超过后按两倍容量重建过滤器，误判率不随注册增加而变差
+};
+
+#endif // USERNAMEINDEX_H
@@ -0,0 +1,291 @@
+#include "wireprotocol.h"
+#include <QtEndian>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QCborStreamWriter>
+#include <QCborValue>
+#include <QCborMap>
+#include <cmath>
+
+namespace WireProtocol {
+
+QString framingToString(Framing framing) {
+    switch (framing) {
+    case Framing::LengthPrefixed: return QStringLiteral("length");
+    case Framing::Newline:
+    default: return QStringLiteral("newline");
+    }
+}
+
+bool framingFromString(const QString& name, Framing* framing) {
+    if (name == QLatin1String("length")) {
+        *framing = Framing::LengthPrefixed;
+        return true;
+    }
+    if (name == QLatin1String("newline")) {
+        *framing = Framing::Newline;
+        return true;
+    }
+    return false;
+}
+
+QString encodingToString(Encoding encoding) {
+    switch (encoding) {
+    case Encoding::Cbor: return QStringLiteral("cbor");
+    case Encoding::Json:
+    default: return QStringLiteral("json");
+    }
+}
+
+bool encodingFromString(const QString& name, Encoding* encoding) {
+    if (name == QLatin1String("cbor")) {
+        *encoding = Encoding::Cbor;
+        return true;
+    }
+    if (name == QLatin1String("json")) {
+        *encoding = Encoding::Json;
+        return true;
+    }
+    return false;
+}
+
+QString compressionToString(Compression compression) {
+    switch (compression) {
+    case Compression::Zlib: return QStringLiteral("zlib");
+    case Compression::None:
+    default: return QStringLiteral("none");
+    }
+}
+
+bool compressionFromString(const QString& name, Compression* compression) {
+    if (name == QLatin1String("zlib")) {
+        *compression = Compression::Zlib;
+        return true;
+    }
+    if (name == QLatin1String("none")) {
+        *compression = Compression::None;
+        return true;
+    }
+    return false;
+}
+
+QByteArray encodeFrame(const QByteArray& payload, Framing framing, bool compressed) {
+    QByteArray frame;
+    if (framing == Framing::LengthPrefixed) {
+        frame.reserve(FrameHeaderSize + payload.size());
+        char header[FrameHeaderSize];
+        quint32 word = quint32(payload.size()) & FrameLengthMask;
+        if (compressed) word |= FrameCompressedFlag;
+        qToBigEndian<quint32>(word, header);
+        frame.append(header, FrameHeaderSize);
+        frame.append(payload);
+    } else {
+        frame.reserve(payload.size() + 1);
+        frame.append(payload);
+        frame.append('\n');
+    }
+    return frame;
+}
+
+QByteArray compressPayload(const QByteArray& payload, int level) {
+    return qCompress(payload, level);
+}
+
+bool decompressPayload(const QByteArray& payload, QByteArray* out) {
+    // qCompress 的前 4 字节是原始长度；先检查，避免为恶意声明的长度分配内存
+    if (payload.size() < 4) return false;
+    const quint32 expected = qFromBigEndian<quint32>(payload.constData());
+    if (expected > MaxFrameSize) return false;
+    *out = qUncompress(payload);
+    return !out->isEmpty() || expected == 0;
+}
+
+// 直接从 QJsonValue 流式写出 CBOR，不经过中间的 QCborValue 树。
+// 整数值的 double（库存、数量、整价）写成 CBOR 整数，更短，解码端 toDouble() 结果不变。
+static void writeCborValue(QCborStreamWriter& writer, const QJsonValue& value) {
+    switch (value.type()) {
+    case QJsonValue::Null:
+        writer.appendNull();
+        break;
+    case QJsonValue::Bool:
+        writer.append(value.toBool());
+        break;
+    case QJsonValue::Double: {
+        const double d = value.toDouble();
+        // 先确认在范围内再转换：NaN、无穷大和超出 qint64 的值直接转换是未定义行为
+        if (std::isfinite(d) && qAbs(d) < 9007199254740992.0 && double(qint64(d)) == d) { // 2^53 以内可精确表示
+            writer.append(qint64(d));
+        } else {
+            writer.append(d);
+        }
+        break;
+    }
+    case QJsonValue::String:
+        writer.append(value.toString());
+        break;
+    case QJsonValue::Array: {
+        const QJsonArray array = value.toArray();
+        writer.startArray(array.size());
+        for (const QJsonValue& v : array) writeCborValue(writer, v);
+        writer.endArray();
+        break;
+    }
+    case QJsonValue::Object: {
+        const QJsonObject object = value.toObject();
+        writer.startMap(object.size());
+        for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+            writer.append(it.key());
+            writeCborValue(writer, it.value());
+        }
+        writer.endMap();
+        break;
+    }
+    default:
+        writer.appendUndefined();
+        break;
+    }
+}
+
+QByteArray encodeMessage(const QJsonObject& message, Encoding encoding) {
+    if (encoding == Encoding::Cbor) {
+        QByteArray data;
+        QCborStreamWriter writer(&data);
+        writeCborValue(writer, message);
+        return data;
+    }
+    return QJsonDocument(message).toJson(QJsonDocument::Compact);
+}
+
+// CBOR map 头（主类型 5）；长度按 RFC 8949 选最短的写法
+static void appendCborMapHeader(QByteArray* out, quint32 size) {
+    const char major = char(5 << 5);
+    if (size < 24) {
+        out->append(char(major | char(size)));
+    } else if (size <= 0xff) {
+        out->append(char(major | 24));
+        out->append(char(size));
+    } else if (size <= 0xffff) {
+        out->append(char(major | 25));
+        char buf[2];
+        qToBigEndian<quint16>(quint16(size), buf);
+        out->append(buf, 2);
+    } else {
+        out->append(char(major | 26));
+        char buf[4];
+        qToBigEndian<quint32>(size, buf);
+        out->append(buf, 4);
+    }
+}
+
+QByteArray encodeMessageWith(const QJsonObject& message, const QString& key, const QByteArray& encodedValue, Encoding encoding) {
+    if (encoding == Encoding::Cbor) {
+        // 各段分别写到独立的缓冲区再拼接，不与 QCborStreamWriter 共用同一个 QByteArray
+        QByteArray keyData;
+        QByteArray rest;
+        {
+            QCborStreamWriter writer(&keyData);
+            writer.append(key);
+        }
+        {
+            QCborStreamWriter writer(&rest);
+            for (auto it = message.constBegin(); it != message.constEnd(); ++it) {
+                writer.append(it.key());
+                writeCborValue(writer, it.value());
+            }
+        }
+        QByteArray data;
+        data.reserve(5 + keyData.size() + encodedValue.size() + rest.size());
+        appendCborMapHeader(&data, quint32(message.size() + 1));
+        data.append(keyData).append(encodedValue).append(rest);
+        return data;
+    }
+    const QByteArray quotedKey = QJsonDocument(QJsonArray{key}).toJson(QJsonDocument::Compact); // ["key"]
+    const QByteArray head = QJsonDocument(message).toJson(QJsonDocument::Compact);            // {...}
+    QByteArray data;
+    data.reserve(quotedKey.size() + encodedValue.size() + head.size() + 1);
+    data.append('{').append(quotedKey.constData() + 1, quotedKey.size() - 2).append(':').append(encodedValue);
+    if (message.isEmpty()) {
+        data.append('}');
+    } else {
+        data.append(',').append(head.constData() + 1, head.size() - 1);
+    }
+    return data;
+}
+
+bool decodeMessage(const QByteArray& data, Encoding encoding, QJsonObject* message, QString* errorString) {
+    if (encoding == Encoding::Cbor) {
+        QCborParserError error;
+        QCborValue value = QCborValue::fromCbor(data, &error);
+        if (error.error != QCborError::NoError) {
+            if (errorString) *errorString = error.errorString();
+            return false;
+        }
+        if (!value.isMap()) {
+            if (errorString) *errorString = QStringLiteral("CBOR message is not a map");
+            return false;
+        }
+        *message = value.toMap().toJsonObject();
+        return true;
+    }
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError) {
+        if (errorString) *errorString = error.errorString();
+        return false;
+    }
+    if (!doc.isObject()) {
+        if (errorString) *errorString = QStringLiteral("JSON message is not an object");
+        return false;
+    }
+    *message = doc.object();
+    return true;
+}
+
+} // namespace WireProtocol
+
+void FrameReader::append(const QByteArray& data) {
+    // 之前取出的帧已经用完，此时可以安全地整理缓冲区
+    if (m_readPos > 0 && (m_readPos == m_buffer.size() || m_readPos >= m_buffer.size() / 2)) {
+        m_buffer.remove(0, m_readPos);
+        m_scanPos = qMax<qsizetype>(0, m_scanPos - m_readPos);
+        m_readPos = 0;
+    }
+    m_buffer.append(data);
+}
+
+FrameReader::Result FrameReader::next(QByteArray* frame, bool* compressed) {
+    const char* base = m_buffer.constData();
+    const qsizetype size = m_buffer.size();
+    if (compressed) *compressed = false;
+
+    if (m_framing == WireProtocol::Framing::LengthPrefixed) {
+        if (size - m_readPos < WireProtocol::FrameHeaderSize) return NeedMoreData;
+        const quint32 word = qFromBigEndian<quint32>(base + m_readPos);
+        const quint32 length = word & WireProtocol::FrameLengthMask;
+        if (length > WireProtocol::MaxFrameSize) return FrameTooLarge;
+        if (size - m_readPos - WireProtocol::FrameHeaderSize < qsizetype(length)) return NeedMoreData;
+        if (compressed) *compressed = (word & WireProtocol::FrameCompressedFlag) != 0;
+        *frame = QByteArray::fromRawData(base + m_readPos + WireProtocol::FrameHeaderSize, length);
+        m_readPos += WireProtocol::FrameHeaderSize + length;
+        m_scanPos = m_readPos;
+        return FrameReady;
+    }
+
+    // Newline 模式：只扫描上次之后新到的字节
+    while (true) {
+        qsizetype from = qMax(m_readPos, m_scanPos);
+        qsizetype newlinePos = m_buffer.indexOf('\n', from);
+        if (newlinePos == -1) {
+            m_scanPos = size;
+            if (size - m_readPos > qsizetype(WireProtocol::MaxFrameSize)) return FrameTooLarge;
+            return NeedMoreData;
+        }
+        qsizetype start = m_readPos;
+        m_readPos = newlinePos + 1;
+        m_scanPos = m_readPos;
+        if (newlinePos == start) continue; // 忽略空行
+        *frame = QByteArray::fromRawData(base + start, newlinePos - start);
+        return FrameReady;
+    }
+}
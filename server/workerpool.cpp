@@ -0,0 +1,59 @@
+#include "workerpool.h"
+#include <QThread>
+#include <QDebug>
+
+WorkerPool::WorkerPool(int threadCount, QObject *parent) : QObject(parent) {
+    if (threadCount <= 0) {
+        threadCount = qMax(1, QThread::idealThreadCount());
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        QThread* thread = new QThread(this);
+        thread->setObjectName(QStringLiteral("worker-%1").arg(i));
+        thread->start();
+        m_indexByThread.insert(thread, m_workers.count());
+        m_workers.append({thread, 0});
+    }
+    qInfo() << "WorkerPool: Started" << m_workers.count() << "event-loop threads.";
+}
+
+WorkerPool::~WorkerPool() {
+    for (const Worker& w : m_workers) {
+        w.thread->quit();
+    }
+    for (const Worker& w : m_workers) {
+        w.thread->wait();
+    }
+}
+
+QThread* WorkerPool::acquireThread() {
+    // 线程数很少（通常等于核数），线性扫描即可
+    int best = 0;
+    for (int i = 1; i < m_workers.count(); ++i) {
+        if (m_workers[i].connections < m_workers[best].connections) {
+            best = i;
+        }
+    }
+    m_workers[best].connections++;
+    return m_workers[best].thread;
+}
+
+void WorkerPool::releaseThread(QThread* thread) {
+    auto it = m_indexByThread.constFind(thread);
+    if (it == m_indexByThread.constEnd()) {
+        qWarning() << "WorkerPool: releaseThread called for unknown thread";
+        return;
+    }
+    Worker& w = m_workers[it.value()];
+    if (w.connections > 0) w.connections--;
+}
+
+int WorkerPool::connectionCount(QThread* thread) const {
+    auto it = m_indexByThread.constFind(thread);
+    return it == m_indexByThread.constEnd() ? 0 : m_workers[it.value()].connections;
+}
+
+int WorkerPool::totalConnections() const {
+    int total = 0;
+    for (const Worker& w : m_workers) total += w.connections;
+    return total;
+}
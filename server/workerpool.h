@@ -0,0 +1,38 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+
+class QThread;
+
+// 固定数量的事件循环线程，ClientHandler 按“连接数最少优先”分配到其中某个线程上。
+// 线程在服务器启动时创建，连接建立/断开时不再创建或销毁线程。
+class WorkerPool : public QObject {
+    Q_OBJECT
+public:
+    // threadCount <= 0 时使用 QThread::idealThreadCount()
+    explicit WorkerPool(int threadCount, QObject *parent = nullptr);
+    ~WorkerPool();
+
+    int threadCount() const { return m_workers.count(); }
+
+    // 选出当前承载连接最少的线程，并把它的连接计数加一
+    QThread* acquireThread();
+    // 连接结束后调用，归还该线程上的一个连接计数
+    void releaseThread(QThread* thread);
+
+    int connectionCount(QThread* thread) const;
+    int totalConnections() const;
+
+private:
+    struct Worker {
+        QThread* thread;
+        int connections;
+    };
+    QList<Worker> m_workers;
+    QHash<QThread*, int> m_indexByThread;
+};
+
+#endif // WORKERPOOL_H